@@ -0,0 +1,173 @@
+#include "alloc_tracker.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+#include <unistd.h>
+
+std::atomic<bool> allocationTrackingEnabled(false);
+std::atomic<bool> allocationAssertsEnabled(false);
+
+void enableAllocationTracking(bool enable) {
+	allocationTrackingEnabled.store(enable);
+}
+
+void enableAllocationAsserts(bool enable) {
+	allocationAssertsEnabled.store(enable);
+}
+
+//plain thread_local PODs, so touching them never allocates or registers destructors
+static thread_local AllocationCounts localCounts;
+static thread_local int forbiddenDepth = 0;
+static thread_local const char* forbiddenName = nullptr;
+
+AllocationCounts threadAllocationCounts() {
+	return localCounts;
+}
+
+[[noreturn]] static void allocationForbidden(std::size_t size) {
+	//no iostreams here, they might allocate
+	char message[256];
+	int length = snprintf(message, sizeof(message), "allocation of %zu bytes inside %s, which must not allocate\n", size, forbiddenName ? forbiddenName : "?");
+	if (write(STDERR_FILENO, message, length) < 0) {
+		//nothing left to report it with
+	}
+	abort();
+}
+
+static void recordAllocation(std::size_t size) {
+	if (forbiddenDepth > 0 && allocationAssertsEnabled.load(std::memory_order_relaxed)) {
+		allocationForbidden(size);
+	}
+	if (allocationTrackingEnabled.load(std::memory_order_relaxed)) {
+		localCounts.allocations++;
+		localCounts.bytes += size;
+	}
+}
+
+static void recordFree(void* ptr) {
+	if (ptr && allocationTrackingEnabled.load(std::memory_order_relaxed)) {
+		localCounts.frees++;
+	}
+}
+
+static void* allocate(std::size_t size, bool nothrow) {
+	recordAllocation(size);
+	void* ptr = malloc(size ? size : 1);
+	if (!ptr && !nothrow) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+static void* allocateAligned(std::size_t size, std::align_val_t alignment, bool nothrow) {
+	recordAllocation(size);
+	void* ptr = nullptr;
+	if (posix_memalign(&ptr, std::max(static_cast<std::size_t>(alignment), sizeof(void*)), size ? size : 1) != 0) {
+		ptr = nullptr;
+	}
+	if (!ptr && !nothrow) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+static void deallocate(void* ptr) {
+	recordFree(ptr);
+	free(ptr);
+}
+
+//the replaceable global allocation functions
+void* operator new(std::size_t size) { return allocate(size, false); }
+void* operator new[](std::size_t size) { return allocate(size, false); }
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept { return allocate(size, true); }
+void* operator new[](std::size_t size, std::nothrow_t const&) noexcept { return allocate(size, true); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment, false); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment, false); }
+void* operator new(std::size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept { return allocateAligned(size, alignment, true); }
+void* operator new[](std::size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept { return allocateAligned(size, alignment, true); }
+
+void operator delete(void* ptr) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr) noexcept { deallocate(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { deallocate(ptr); }
+void operator delete(void* ptr, std::nothrow_t const&) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr, std::nothrow_t const&) noexcept { deallocate(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { deallocate(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { deallocate(ptr); }
+void operator delete(void* ptr, std::align_val_t, std::nothrow_t const&) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr, std::align_val_t, std::nothrow_t const&) noexcept { deallocate(ptr); }
+
+AllocationStat::AllocationStat(std::string const& name) :
+	name(name),
+	calls(0),
+	allocations(0),
+	frees(0),
+	bytes(0)
+{
+	//EMPTY
+}
+
+void AllocationStat::Add(AllocationCounts const& counts) {
+	calls.fetch_add(1, std::memory_order_relaxed);
+	allocations.fetch_add(counts.allocations, std::memory_order_relaxed);
+	frees.fetch_add(counts.frees, std::memory_order_relaxed);
+	bytes.fetch_add(counts.bytes, std::memory_order_relaxed);
+}
+
+void AllocationStat::Reset() {
+	calls.store(0);
+	allocations.store(0);
+	frees.store(0);
+	bytes.store(0);
+}
+
+void AllocationStat::WriteText(std::ostream& os) const {
+	std::uint64_t n = Calls();
+	std::streamsize precision = os.precision(3);
+	os << name << ": " << n << " calls, " << Allocations() << " allocations (" << (n ? double(Allocations()) / n : 0.0) << " per call), "
+		<< frees.load(std::memory_order_relaxed) << " frees, " << Bytes() << " bytes" << std::endl;
+	os.precision(precision);
+}
+
+AllocationScope::AllocationScope(AllocationStat& stat) :
+	stat(stat),
+	tracking(allocationTrackingEnabled.load(std::memory_order_relaxed)),
+	forbidding(allocationAssertsEnabled.load(std::memory_order_relaxed))
+{
+	if (tracking) {
+		start = localCounts;
+	}
+	if (forbidding && forbiddenDepth++ == 0) {
+		forbiddenName = stat.GetName().c_str();
+	}
+}
+
+AllocationScope::~AllocationScope() {
+	if (forbidding) {
+		forbiddenDepth--;
+	}
+	if (tracking) {
+		AllocationCounts delta;
+		delta.allocations = localCounts.allocations - start.allocations;
+		delta.frees = localCounts.frees - start.frees;
+		delta.bytes = localCounts.bytes - start.bytes;
+		stat.Add(delta);
+	}
+}
+
+AllocationExemptScope::AllocationExemptScope() :
+	savedDepth(forbiddenDepth)
+{
+	forbiddenDepth = 0;
+}
+
+AllocationExemptScope::~AllocationExemptScope() {
+	forbiddenDepth = savedDepth;
+}
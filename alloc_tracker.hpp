@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+//opt-in accounting of heap allocations, by replacing the global operator new and delete
+//while tracking is off the hooks cost one relaxed load on top of malloc
+
+struct AllocationCounts {
+	std::uint64_t allocations = 0;
+	std::uint64_t frees = 0;
+	std::uint64_t bytes = 0;
+};
+
+extern std::atomic<bool> allocationTrackingEnabled;
+void enableAllocationTracking(bool enable);
+
+//abort as soon as a thread allocates inside an AllocationScope
+//enable once the program has warmed up (the chain reserved, every thread's instrumentation in place)
+extern std::atomic<bool> allocationAssertsEnabled;
+void enableAllocationAsserts(bool enable);
+
+//what this thread has allocated since tracking was enabled
+AllocationCounts threadAllocationCounts();
+
+//totals for a named scope, collected across threads
+class AllocationStat {
+public:
+	AllocationStat(std::string const& name);
+
+	AllocationStat(AllocationStat const&) = delete;
+	AllocationStat& operator=(AllocationStat const&) = delete;
+
+	void Add(AllocationCounts const& counts);
+	void Reset();
+
+	std::uint64_t Calls() const { return calls.load(std::memory_order_relaxed); }
+	std::uint64_t Allocations() const { return allocations.load(std::memory_order_relaxed); }
+	std::uint64_t Bytes() const { return bytes.load(std::memory_order_relaxed); }
+
+	void WriteText(std::ostream& os) const;
+
+	std::string const& GetName() const { return name; }
+
+private:
+	std::string name;
+	std::atomic<std::uint64_t> calls;
+	std::atomic<std::uint64_t> allocations;
+	std::atomic<std::uint64_t> frees;
+	std::atomic<std::uint64_t> bytes;
+};
+
+//counts the allocations made during a scope into a stat, and forbids them while asserts are enabled
+class AllocationScope {
+public:
+	AllocationScope(AllocationStat& stat);
+	~AllocationScope();
+
+	AllocationScope(AllocationScope const&) = delete;
+	AllocationScope& operator=(AllocationScope const&) = delete;
+
+private:
+	AllocationStat& stat;
+	AllocationCounts start;
+	bool tracking;
+	bool forbidding;
+};
+
+//lets instrumentation build its per-thread state inside a forbidden scope
+//those one-off allocations are still counted, they just don't trip the assert
+class AllocationExemptScope {
+public:
+	AllocationExemptScope();
+	~AllocationExemptScope();
+
+	AllocationExemptScope(AllocationExemptScope const&) = delete;
+	AllocationExemptScope& operator=(AllocationExemptScope const&) = delete;
+
+private:
+	int savedDepth;
+};
@@ -0,0 +1,455 @@
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include "bench.hpp"
+#include "change_feed.hpp"
+#include "export.hpp"
+#include "fast_clock.hpp"
+#include "generator.hpp"
+#include "ledger.hpp"
+#include "pool.hpp"
+#include "submission_queue.hpp"
+
+//the benchmark suite, built by "make bench" into its own binary
+//each benchmark runs some warmup repetitions, then timed repetitions that each report how many operations they did
+
+struct BenchOptions {
+	int warmup = 2;
+	int reps = 10;
+	std::uint64_t maxChain = 1000000; //10^8 needs about 5GB of memory
+	std::string filter;
+};
+
+static BenchOptions options;
+static std::vector<BenchStats> results;
+
+static void printHeader() {
+	std::cout << std::left << std::setw(44) << "benchmark" << std::right
+		<< std::setw(14) << "median"
+		<< std::setw(14) << "mean"
+		<< std::setw(12) << "+/- 95%"
+		<< std::setw(14) << "min"
+		<< std::setw(14) << "max"
+		<< std::setw(16) << "ops/sec"
+		<< "  unit" << std::endl;
+}
+
+static void printStats(BenchStats const& stats) {
+	std::cout << std::left << std::setw(44) << stats.name << std::right << std::fixed << std::setprecision(2)
+		<< std::setw(14) << stats.median
+		<< std::setw(14) << stats.mean
+		<< std::setw(12) << stats.confidence
+		<< std::setw(14) << stats.min
+		<< std::setw(14) << stats.max
+		<< std::setw(16) << std::setprecision(0) << (stats.median > 0 ? 1e9 / stats.median : 0)
+		<< "  ns/" << stats.unit << std::defaultfloat << std::endl;
+}
+
+static bool selected(std::string const& name) {
+	return options.filter.empty() || name.find(options.filter) != std::string::npos;
+}
+
+//body runs one repetition and returns the number of operations it performed
+static void runBench(std::string const& name, std::string const& unit, std::function<std::uint64_t()> body) {
+	if (!selected(name)) {
+		return;
+	}
+
+	for (int i = 0; i < options.warmup; i++) {
+		body();
+	}
+
+	BenchStats stats;
+	stats.name = name;
+	stats.unit = unit;
+
+	for (int i = 0; i < options.reps; i++) {
+		std::uint64_t start = TscClock::Ticks();
+		std::uint64_t ops = body();
+		std::uint64_t elapsed = TscClock::ElapsedNanoseconds(TscClock::Ticks() - start);
+		stats.samples.push_back(static_cast<double>(elapsed) / std::max<std::uint64_t>(ops, 1));
+	}
+
+	summarize(stats);
+	printStats(stats);
+	results.push_back(std::move(stats));
+}
+
+//keeps the optimizer from discarding a result
+static volatile unsigned sink;
+
+//a chain of receipts rotating through accounts 1..accounts, linked and mined at the trivial threshold
+//account accounts + 1 has a single receipt right after genesis, so looking it up scans the whole chain
+static void buildChain(std::uint64_t length, unsigned accounts) {
+	resetLedger();
+	blockVector.reserve(length);
+
+	Block genesis = generateBlock(generateBlank("sixpence bench!!"), 42);
+	genesis.nonce = 0;
+	genesis.threshold = UINT_MAX;
+	blockVector.push_back(genesis);
+
+	for (std::uint64_t i = 1; i < length; i++) {
+		unsigned account = i == 1 ? accounts + 1 : 1 + i % accounts;
+
+		Transaction transaction;
+		transaction.receipt = { TransactionType::RECEIPT, account, unsigned(-1), unsigned(i - 1), 1000 };
+
+		Block block = generateBlock(transaction, fnv_hash_1a_32(&blockVector.back(), sizeof(Block)));
+		block.nonce = 0;
+		block.threshold = UINT_MAX;
+		blockVector.push_back(block);
+	}
+}
+
+static void benchHashing() {
+	runBench("fnv/block", "hash", [] {
+		Block block = {};
+		const std::uint64_t count = 1000000;
+		for (std::uint64_t i = 0; i < count; i++) {
+			block.nonce = i;
+			sink = fnv_hash_1a_32(&block, sizeof(Block));
+		}
+		return count;
+	});
+
+	runBench("fnv/4KiB", "byte", [] {
+		static std::vector<unsigned char> buffer(4096, 0x5a);
+		const std::uint64_t count = 1000;
+		for (std::uint64_t i = 0; i < count; i++) {
+			buffer[0] = i;
+			sink = fnv_hash_1a_32(buffer.data(), buffer.size());
+		}
+		return count * buffer.size();
+	});
+}
+
+static void benchMining() {
+	for (int bits : { 24, 20, 16 }) {
+		//count hash attempts so runs at different difficulties compare per hash
+		runBench("hashBlock/threshold=2^" + std::to_string(bits), "hash", [bits] {
+			Block block = generateBlock(generateTransfer(0, 1, 50), 0);
+			std::uint64_t hashes = 0;
+			for (int i = 0; i < 16; i++) {
+				block.prevHash = i;
+				hashBlock(block, 1u << bits);
+				hashes += block.nonce;
+			}
+			return hashes;
+		});
+	}
+}
+
+static void benchLookups() {
+	const unsigned accounts = 1000;
+
+	for (std::uint64_t length = 1000; length <= options.maxChain; length *= 10) {
+		std::string suffix = "n=" + std::to_string(length);
+
+		//building a big chain takes a while, skip it when nothing here would run
+		if (!selected("generateTransfer/hot/" + suffix) && !selected("generateTransfer/cold/" + suffix) && !selected("generateReceipt/cold/" + suffix) && !selected("verifyChain/" + suffix)) {
+			continue;
+		}
+
+		buildChain(length, accounts);
+
+		//keep each repetition to about 10^7 blocks scanned
+		std::uint64_t coldCalls = std::max<std::uint64_t>(1, 10000000 / length);
+		unsigned hotAccount = blockVector.back().transaction.receipt.account;
+
+		runBench("generateTransfer/hot/" + suffix, "call", [hotAccount] {
+			const std::uint64_t count = 100000;
+			for (std::uint64_t i = 0; i < count; i++) {
+				sink = generateTransfer(hotAccount, hotAccount + 1, 1).transfer.prevReceipt;
+			}
+			return count;
+		});
+
+		runBench("generateTransfer/cold/" + suffix, "call", [coldCalls] {
+			for (std::uint64_t i = 0; i < coldCalls; i++) {
+				sink = generateTransfer(accounts + 1, 1, 1).transfer.prevReceipt;
+			}
+			return coldCalls;
+		});
+
+		runBench("generateReceipt/cold/" + suffix, "call", [coldCalls] {
+			Block transfer = {};
+			transfer.transaction.transfer = { TransactionType::TRANSFER, 1, accounts + 1, 0, 1 };
+			for (std::uint64_t i = 0; i < coldCalls; i++) {
+				sink = generateReceipt(transfer).receipt.balance;
+			}
+			return coldCalls;
+		});
+
+		runBench("verifyChain/" + suffix, "block", [] {
+			sink = verifyChain(blockVector);
+			return std::uint64_t(blockVector.size());
+		});
+	}
+
+	resetLedger();
+	blockVector.shrink_to_fit();
+}
+
+static void benchAppend() {
+	runBench("append/pushBlock", "block", [] {
+		resetLedger();
+		const std::uint64_t count = 1000000;
+		Block block = generateBlock(generateTransfer(0, 1, 50), 0);
+		for (std::uint64_t i = 0; i < count; i++) {
+			block.index = i;
+			pushBlock(block);
+		}
+		return count;
+	});
+
+	//the full sendAmount path at a trivial threshold, so validation and appending dominate
+	runBench("append/sendAmount", "block", [] {
+		resetLedger();
+		unsigned saved = threshold;
+		threshold = UINT_MAX;
+
+		pushBlock(generateBlock(generateBlank("sixpence bench!!"), 42));
+		for (unsigned i = 0; i < 10000; i++) {
+			sendAmount(0, 1 + i % 100, 50);
+			sendAmount(1 + i % 100, 1 + (i + 1) % 100, 10);
+		}
+
+		threshold = saved;
+		return std::uint64_t(blockVector.size());
+	});
+
+	resetLedger();
+}
+
+//what publishing a block costs the writer, with subscribers reading alongside it
+static void benchFeed() {
+	for (unsigned subscriberCount : { 0u, 1u, 4u, 16u }) {
+		BlockFeed feed(1 << 12);
+		std::atomic<bool> stop(false);
+		std::vector<std::thread> subscribers;
+		for (unsigned i = 0; i < subscriberCount; i++) {
+			subscribers.emplace_back([&] {
+				FeedSubscription subscription(feed, 0);
+				Block blocks[256];
+				while (!stop.load()) {
+					subscription.Wait(blocks, 256, std::chrono::milliseconds(1));
+				}
+			});
+		}
+
+		runBench("feed/publish/subscribers=" + std::to_string(subscriberCount), "block", [&] {
+			const std::uint64_t count = 1000000;
+			Block block = generateBlock(generateTransfer(0, 1, 50), 0);
+			for (std::uint64_t i = 0; i < count; i++) {
+				block.index = i;
+				feed.Publish(block);
+			}
+			return count;
+		});
+
+		stop.store(true);
+		for (std::thread& subscriber : subscribers) {
+			subscriber.join();
+		}
+	}
+}
+
+static void benchExport() {
+	//a realistic mix of block types, rather than buildChain's receipts
+	std::vector<Block> chain;
+	GeneratorOptions generatorOptions;
+	generatorOptions.blocks = std::min<std::uint64_t>(options.maxChain, 1000000);
+	generateChain(generatorOptions, chain);
+
+	int devNull = open("/dev/null", O_WRONLY);
+	for (ExportFormat format : { ExportFormat::TEXT, ExportFormat::CSV, ExportFormat::JSONL }) {
+		static const char* names[] = { "text", "csv", "jsonl" };
+		runBench(std::string("export/") + names[static_cast<int>(format)], "block", [&] {
+			exportChain(chain, format, devNull);
+			return std::uint64_t(chain.size());
+		});
+	}
+
+	runBench("export/text-single-thread", "block", [&] {
+		exportChain(chain, ExportFormat::TEXT, devNull, 1);
+		return std::uint64_t(chain.size());
+	});
+
+	//the old way, one printBlock at a time through the stream
+	runBench("export/printBlock", "block", [&] {
+		std::streambuf* saved = std::cout.rdbuf();
+		std::ofstream os("/dev/null");
+		std::cout.rdbuf(os.rdbuf());
+		for (Block const& block : chain) {
+			printBlock(block);
+		}
+		std::cout.rdbuf(saved);
+		return std::uint64_t(chain.size());
+	});
+	close(devNull);
+	resetLedger();
+}
+
+//bytes the heap holds but isn't using, i.e. what fragmentation and caching cost
+static std::size_t heapBytesFree() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+	return mallinfo2().fordblks;
+#else
+	return 0;
+#endif
+}
+
+//Submission objects made and retired in batches, the way clients and the ledger thread trade them
+//an allocator is a pair of functions: make one, and retire one (possibly on another thread)
+template<typename New, typename Delete>
+static void benchAllocator(std::string const& name, New make, Delete retire, std::function<std::size_t()> heldBytes) {
+	const std::uint64_t count = 1000000;
+	const std::size_t batch = LedgerWorker::batchSize;
+
+	runBench("alloc/" + name + "/same-thread", "object", [&] {
+		Submission* submissions[batch];
+		for (std::uint64_t i = 0; i < count; i += batch) {
+			for (std::size_t j = 0; j < batch; j++) {
+				submissions[j] = make();
+				submissions[j]->amount = j;
+			}
+			for (std::size_t j = 0; j < batch; j++) {
+				sink = submissions[j]->amount;
+				retire(submissions[j]);
+			}
+		}
+		return count;
+	});
+
+	std::size_t peakHeld = 0;
+	runBench("alloc/" + name + "/cross-thread", "object", [&] {
+		SubmissionQueue queue(4 * batch);
+		std::thread consumer([&] {
+			std::vector<Submission*> popped;
+			while (queue.PopBatch(popped, batch)) {
+				for (Submission* submission : popped) {
+					sink = submission->amount;
+					retire(submission);
+				}
+				popped.clear();
+			}
+		});
+
+		for (std::uint64_t i = 0; i < count; i++) {
+			Submission* submission = make();
+			submission->amount = i;
+			queue.Push(submission);
+		}
+		queue.Close();
+		consumer.join();
+
+		peakHeld = std::max(peakHeld, heldBytes());
+		return count;
+	});
+
+	if (selected("alloc/" + name + "/cross-thread")) {
+		std::cout << "  " << name << " holds " << peakHeld << " bytes with no live objects" << std::endl;
+	}
+}
+
+static void benchAllocators() {
+	benchAllocator("new-delete",
+		[] { return new Submission(); },
+		[](Submission* submission) { delete submission; },
+		heapBytesFree);
+
+	ObjectPool<Submission> pool;
+	benchAllocator("pool",
+		[&] { return pool.New(); },
+		[&](Submission* submission) { pool.Delete(submission); },
+		[&] { return pool.SlabBytes() - pool.Live() * sizeof(Submission); });
+}
+
+int main(int argc, char* argv[]) {
+	std::string jsonFile;
+	std::string commandLine = argv[0];
+	CompareOptions compareOptions;
+	std::vector<std::string> compareFiles;
+
+	for (int i = 1; i < argc; i++) {
+		commandLine += std::string(" ") + argv[i];
+	}
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--reps") && i + 1 < argc) {
+			options.reps = std::max(1, atoi(argv[++i]));
+		}
+		else if (!strcmp(argv[i], "--warmup") && i + 1 < argc) {
+			options.warmup = std::max(0, atoi(argv[++i]));
+		}
+		else if (!strcmp(argv[i], "--max-chain") && i + 1 < argc) {
+			options.maxChain = strtoull(argv[++i], nullptr, 0);
+		}
+		else if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+			options.filter = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--json") && i + 1 < argc) {
+			jsonFile = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--compare") && i + 2 < argc) {
+			compareFiles.push_back(argv[++i]);
+			compareFiles.push_back(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "--max-slowdown") && i + 1 < argc) {
+			compareOptions.maxSlowdown = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "--noise-floor") && i + 1 < argc) {
+			compareOptions.noiseFloor = atof(argv[++i]);
+		}
+		else {
+			std::cerr << "usage: " << argv[0] << " [--reps N] [--warmup N] [--max-chain N] [--filter substring] [--json results.json]" << std::endl;
+			std::cerr << "       " << argv[0] << " --compare base.json new.json [--max-slowdown percent] [--noise-floor ns]" << std::endl;
+			return 1;
+		}
+	}
+
+	//exit status is 0 when clean, 1 on regressions, 2 when the files can't be compared
+	if (!compareFiles.empty()) {
+		int regressions = compareBenchJson(compareFiles[0], compareFiles[1], compareOptions);
+		return regressions < 0 ? 2 : regressions > 0 ? 1 : 0;
+	}
+
+	verboseMining = false;
+
+	printHeader();
+	benchHashing();
+	benchMining();
+	benchLookups();
+	benchAppend();
+	benchAllocators();
+	benchFeed();
+	benchExport();
+
+	if (!jsonFile.empty() && !writeBenchJson(jsonFile, results, commandLine)) {
+		std::cerr << "failed to write " << jsonFile << std::endl;
+		return 2;
+	}
+
+	return 0;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct BenchStats {
+	std::string name;
+	std::string unit;
+	std::vector<double> samples; //nanoseconds per operation, one per repetition
+	double min = 0;
+	double median = 0;
+	double mean = 0;
+	double stddev = 0;
+	double max = 0;
+	double confidence = 0; //half-width of the 95% confidence interval of the mean
+};
+
+//two-sided 95% critical value of Student's t, fractional degrees round down
+double studentT95(double degrees);
+
+//fill in everything but the samples, name and unit
+void summarize(BenchStats& stats);
+
+//results plus the environment they were measured in (cpu, compiler, flags)
+bool writeBenchJson(std::string const& fname, std::vector<BenchStats> const& results, std::string const& commandLine);
+
+struct CompareOptions {
+	double maxSlowdown = 5.0; //percent; slower than this and statistically significant is a regression
+	double noiseFloor = 0.0; //nanoseconds per op; smaller differences are never flagged
+};
+
+//print a comparison of two result files, returns the number of regressions or -1 if a file can't be read
+int compareBenchJson(std::string const& baseFile, std::string const& newFile, CompareOptions const& options);
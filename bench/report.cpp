@@ -0,0 +1,443 @@
+#include "bench.hpp"
+
+#include "fast_clock.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#ifndef BENCH_CXXFLAGS
+#define BENCH_CXXFLAGS "unknown"
+#endif
+
+double studentT95(double degrees) {
+	static const double table[] = {
+		0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+		2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+		2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+	};
+	std::size_t index = degrees < 1 ? 0 : static_cast<std::size_t>(degrees);
+	if (index == 0) {
+		return table[1];
+	}
+	return index < sizeof(table) / sizeof(table[0]) ? table[index] : 1.96;
+}
+
+void summarize(BenchStats& stats) {
+	std::vector<double> sorted = stats.samples;
+	std::sort(sorted.begin(), sorted.end());
+
+	std::size_t n = sorted.size();
+	if (n == 0) {
+		return;
+	}
+
+	stats.min = sorted.front();
+	stats.max = sorted.back();
+	stats.median = n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+
+	double sum = 0;
+	for (double s : sorted) {
+		sum += s;
+	}
+	stats.mean = sum / n;
+
+	double squares = 0;
+	for (double s : sorted) {
+		squares += (s - stats.mean) * (s - stats.mean);
+	}
+	stats.stddev = n > 1 ? std::sqrt(squares / (n - 1)) : 0;
+	stats.confidence = n > 1 ? studentT95(n - 1) * stats.stddev / std::sqrt(static_cast<double>(n)) : 0;
+}
+
+//-------------------------
+//writing
+//-------------------------
+
+static std::string jsonEscape(std::string const& str) {
+	std::string out;
+	for (char c : str) {
+		switch (c) {
+			case '"': out += "\\\""; break;
+			case '\\': out += "\\\\"; break;
+			case '\n': out += "\\n"; break;
+			case '\t': out += "\\t"; break;
+			default:
+				if (static_cast<unsigned char>(c) >= 0x20) {
+					out += c;
+				}
+			break;
+		}
+	}
+	return out;
+}
+
+static std::string cpuModel() {
+	std::ifstream is("/proc/cpuinfo");
+	std::string line;
+	while (std::getline(is, line)) {
+		if (line.compare(0, 10, "model name") == 0) {
+			std::size_t colon = line.find(':');
+			if (colon != std::string::npos) {
+				return line.substr(line.find_first_not_of(' ', colon + 1));
+			}
+		}
+	}
+	return "unknown";
+}
+
+bool writeBenchJson(std::string const& fname, std::vector<BenchStats> const& results, std::string const& commandLine) {
+	std::ofstream os(fname);
+	if (!os.is_open()) {
+		return false;
+	}
+
+	char hostname[256] = "unknown";
+	gethostname(hostname, sizeof(hostname) - 1);
+
+	utsname uts = {};
+	uname(&uts);
+
+	char date[32] = "";
+	std::time_t now = std::time(nullptr);
+	std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+	os << std::setprecision(10);
+	os << "{\n";
+	os << "\"environment\":{"
+		<< "\"date\":\"" << date << "\","
+		<< "\"host\":\"" << jsonEscape(hostname) << "\","
+		<< "\"kernel\":\"" << jsonEscape(std::string(uts.sysname) + " " + uts.release) << "\","
+		<< "\"cpu\":\"" << jsonEscape(cpuModel()) << "\","
+		<< "\"cores\":" << std::thread::hardware_concurrency() << ","
+		<< "\"tsc\":" << (TscClock::UsingTsc() ? "true" : "false") << ","
+		<< "\"tscTicksPerNanosecond\":" << TscClock::TicksPerNanosecond() << ","
+		<< "\"compiler\":\"" << jsonEscape(__VERSION__) << "\","
+		<< "\"flags\":\"" << jsonEscape(BENCH_CXXFLAGS) << "\","
+		<< "\"commandLine\":\"" << jsonEscape(commandLine) << "\""
+		<< "},\n";
+
+	os << "\"benchmarks\":[\n";
+	for (std::size_t i = 0; i < results.size(); i++) {
+		BenchStats const& stats = results[i];
+		os << "{\"name\":\"" << jsonEscape(stats.name) << "\",\"unit\":\"" << jsonEscape(stats.unit) << "\""
+			<< ",\"reps\":" << stats.samples.size()
+			<< ",\"median\":" << stats.median
+			<< ",\"mean\":" << stats.mean
+			<< ",\"stddev\":" << stats.stddev
+			<< ",\"min\":" << stats.min
+			<< ",\"max\":" << stats.max
+			<< ",\"ci95\":" << stats.confidence
+			<< ",\"samples\":[";
+		for (std::size_t j = 0; j < stats.samples.size(); j++) {
+			os << (j ? "," : "") << stats.samples[j];
+		}
+		os << "]}" << (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	os << "]\n}\n";
+
+	return os.good();
+}
+
+//-------------------------
+//reading, just enough JSON for the files written above
+//-------------------------
+
+struct JsonValue {
+	enum Type { NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT } type = NUL;
+	double number = 0;
+	std::string string;
+	std::vector<JsonValue> array;
+	std::vector<std::pair<std::string, JsonValue>> object;
+
+	JsonValue const* Find(std::string const& key) const {
+		for (auto const& member : object) {
+			if (member.first == key) {
+				return &member.second;
+			}
+		}
+		return nullptr;
+	}
+};
+
+class JsonParser {
+public:
+	JsonParser(std::string const& text) : p(text.data()), end(text.data() + text.size()) {}
+
+	bool Parse(JsonValue& value) {
+		return ParseValue(value) && (SkipSpace(), p == end);
+	}
+
+private:
+	void SkipSpace() {
+		while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) {
+			p++;
+		}
+	}
+
+	bool Expect(const char* word) {
+		std::size_t len = strlen(word);
+		if (static_cast<std::size_t>(end - p) < len || std::string(p, len) != word) {
+			return false;
+		}
+		p += len;
+		return true;
+	}
+
+	bool ParseString(std::string& out) {
+		if (p >= end || *p != '"') {
+			return false;
+		}
+		p++;
+		while (p < end && *p != '"') {
+			if (*p == '\\' && p + 1 < end) {
+				p++;
+				switch (*p) {
+					case 'n': out += '\n'; break;
+					case 't': out += '\t'; break;
+					case 'u': p += 4; out += '?'; break; //never written by writeBenchJson
+					default: out += *p; break;
+				}
+				p++;
+				continue;
+			}
+			out += *p++;
+		}
+		if (p >= end) {
+			return false;
+		}
+		p++;
+		return true;
+	}
+
+	bool ParseValue(JsonValue& value) {
+		SkipSpace();
+		if (p >= end) {
+			return false;
+		}
+
+		switch (*p) {
+			case '{': {
+				value.type = JsonValue::OBJECT;
+				p++;
+				SkipSpace();
+				if (p < end && *p == '}') {
+					p++;
+					return true;
+				}
+				for (;;) {
+					SkipSpace();
+					std::pair<std::string, JsonValue> member;
+					if (!ParseString(member.first)) {
+						return false;
+					}
+					SkipSpace();
+					if (p >= end || *p++ != ':' || !ParseValue(member.second)) {
+						return false;
+					}
+					value.object.push_back(std::move(member));
+					SkipSpace();
+					if (p < end && *p == ',') {
+						p++;
+						continue;
+					}
+					return p < end && *p++ == '}';
+				}
+			}
+
+			case '[': {
+				value.type = JsonValue::ARRAY;
+				p++;
+				SkipSpace();
+				if (p < end && *p == ']') {
+					p++;
+					return true;
+				}
+				for (;;) {
+					value.array.emplace_back();
+					if (!ParseValue(value.array.back())) {
+						return false;
+					}
+					SkipSpace();
+					if (p < end && *p == ',') {
+						p++;
+						continue;
+					}
+					return p < end && *p++ == ']';
+				}
+			}
+
+			case '"':
+				value.type = JsonValue::STRING;
+				return ParseString(value.string);
+
+			case 't':
+				value.type = JsonValue::BOOLEAN;
+				value.number = 1;
+				return Expect("true");
+
+			case 'f':
+				value.type = JsonValue::BOOLEAN;
+				return Expect("false");
+
+			case 'n':
+				return Expect("null");
+
+			default: {
+				char* after = nullptr;
+				std::string rest(p, std::min<std::size_t>(end - p, 64));
+				value.type = JsonValue::NUMBER;
+				value.number = strtod(rest.c_str(), &after);
+				if (after == rest.c_str()) {
+					return false;
+				}
+				p += after - rest.c_str();
+				return true;
+			}
+		}
+	}
+
+	const char* p;
+	const char* end;
+};
+
+static bool readBenchJson(std::string const& fname, std::vector<BenchStats>& results, std::string& description) {
+	std::ifstream is(fname);
+	if (!is.is_open()) {
+		std::cerr << "can't open " << fname << std::endl;
+		return false;
+	}
+	std::stringstream buffer;
+	buffer << is.rdbuf();
+
+	JsonValue root;
+	if (!JsonParser(buffer.str()).Parse(root) || root.type != JsonValue::OBJECT) {
+		std::cerr << "can't parse " << fname << std::endl;
+		return false;
+	}
+
+	if (JsonValue const* environment = root.Find("environment")) {
+		JsonValue const* cpu = environment->Find("cpu");
+		JsonValue const* flags = environment->Find("flags");
+		JsonValue const* date = environment->Find("date");
+		description = (date ? date->string : "") + ", " + (cpu ? cpu->string : "") + ", " + (flags ? flags->string : "");
+	}
+
+	JsonValue const* benchmarks = root.Find("benchmarks");
+	if (!benchmarks || benchmarks->type != JsonValue::ARRAY) {
+		std::cerr << fname << " has no benchmarks" << std::endl;
+		return false;
+	}
+
+	for (JsonValue const& entry : benchmarks->array) {
+		BenchStats stats;
+		if (JsonValue const* name = entry.Find("name")) {
+			stats.name = name->string;
+		}
+		if (JsonValue const* unit = entry.Find("unit")) {
+			stats.unit = unit->string;
+		}
+		if (JsonValue const* samples = entry.Find("samples")) {
+			for (JsonValue const& sample : samples->array) {
+				stats.samples.push_back(sample.number);
+			}
+		}
+		summarize(stats);
+		results.push_back(std::move(stats));
+	}
+
+	return true;
+}
+
+//-------------------------
+//comparing
+//-------------------------
+
+int compareBenchJson(std::string const& baseFile, std::string const& newFile, CompareOptions const& options) {
+	std::vector<BenchStats> baseResults, newResults;
+	std::string baseDescription, newDescription;
+	if (!readBenchJson(baseFile, baseResults, baseDescription) || !readBenchJson(newFile, newResults, newDescription)) {
+		return -1;
+	}
+
+	std::cout << "base: " << baseFile << " (" << baseDescription << ")" << std::endl;
+	std::cout << "new:  " << newFile << " (" << newDescription << ")" << std::endl;
+	std::cout << std::left << std::setw(44) << "benchmark" << std::right
+		<< std::setw(14) << "base median"
+		<< std::setw(14) << "new median"
+		<< std::setw(10) << "change"
+		<< std::setw(10) << "t"
+		<< "  verdict" << std::endl;
+
+	int regressions = 0;
+
+	for (BenchStats const& after : newResults) {
+		auto iter = std::find_if(baseResults.begin(), baseResults.end(), [&after](BenchStats const& b) { return b.name == after.name; });
+		if (iter == baseResults.end()) {
+			std::cout << std::left << std::setw(44) << after.name << std::right << "  (new benchmark)" << std::endl;
+			continue;
+		}
+		BenchStats const& before = *iter;
+
+		//Welch's t-test on the per-repetition samples, which doesn't assume equal variances
+		double a = before.stddev * before.stddev / std::max<std::size_t>(before.samples.size(), 1);
+		double b = after.stddev * after.stddev / std::max<std::size_t>(after.samples.size(), 1);
+		double difference = after.mean - before.mean;
+
+		double t = 0;
+		bool significant;
+		if (a + b > 0) {
+			t = difference / std::sqrt(a + b);
+			double degrees = (a + b) * (a + b) / (
+				(before.samples.size() > 1 ? a * a / (before.samples.size() - 1) : 0) +
+				(after.samples.size() > 1 ? b * b / (after.samples.size() - 1) : 0) + 1e-300
+			);
+			significant = std::fabs(t) > studentT95(degrees);
+		}
+		else {
+			significant = difference != 0;
+		}
+
+		double change = before.mean > 0 ? difference / before.mean * 100 : 0;
+		bool material = std::fabs(difference) >= options.noiseFloor;
+
+		const char* verdict = "~";
+		if (significant && material && change > options.maxSlowdown) {
+			verdict = "REGRESSION";
+			regressions++;
+		}
+		else if (significant && material && change < -options.maxSlowdown) {
+			verdict = "faster";
+		}
+		else if (significant && material) {
+			verdict = change > 0 ? "slower (within threshold)" : "faster (within threshold)";
+		}
+
+		std::cout << std::left << std::setw(44) << after.name << std::right << std::fixed << std::setprecision(2)
+			<< std::setw(14) << before.median
+			<< std::setw(14) << after.median
+			<< std::setw(9) << std::showpos << change << '%' << std::noshowpos
+			<< std::setw(10) << t
+			<< "  " << verdict << std::defaultfloat << std::endl;
+	}
+
+	for (BenchStats const& before : baseResults) {
+		if (std::none_of(newResults.begin(), newResults.end(), [&before](BenchStats const& n) { return n.name == before.name; })) {
+			std::cout << std::left << std::setw(44) << before.name << std::right << "  (missing from new results)" << std::endl;
+		}
+	}
+
+	std::cout << regressions << " regression(s) beyond " << options.maxSlowdown << "%" << std::endl;
+	return regressions;
+}
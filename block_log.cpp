@@ -0,0 +1,320 @@
+#include "block_log.hpp"
+
+#include "export.hpp"
+#include "futex.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char magic[8] = { 'S', 'P', 'X', 'L', 'O', 'G', '1', '\n' };
+
+static_assert(sizeof(BlockLogHeader) <= BlockLogWriter::headerSize, "the log header outgrew its page");
+
+static const std::size_t reservedBytes = BlockLogWriter::headerSize + BlockLogWriter::maxBlocks * sizeof(Block);
+
+//writer
+BlockLogWriter::~BlockLogWriter() {
+	Close();
+}
+
+bool BlockLogWriter::Open(std::string const& fname, std::uint64_t initialBlocks) {
+	Close();
+
+	if (sysconf(_SC_PAGESIZE) > static_cast<long>(headerSize)) {
+		error = "page size larger than the log header";
+		return false;
+	}
+
+	fd = open(fname.c_str(), O_RDWR | O_CREAT, 0644);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		error = "failed to open " + fname + ": " + strerror(errno);
+		Close();
+		return false;
+	}
+
+	bool created = st.st_size == 0;
+	if (created && ftruncate(fd, headerSize + std::max<std::uint64_t>(initialBlocks, 1) * sizeof(Block)) != 0) {
+		error = "failed to size " + fname + ": " + strerror(errno);
+		Close();
+		return false;
+	}
+
+	//the whole reservation at once; pages past the end of the file are never touched
+	void* base = mmap(nullptr, reservedBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, fd, 0);
+	if (base == MAP_FAILED) {
+		error = std::string("mmap: ") + strerror(errno);
+		Close();
+		return false;
+	}
+	header = static_cast<BlockLogHeader*>(base);
+	blocks = reinterpret_cast<Block*>(static_cast<char*>(base) + headerSize);
+
+	if (created) {
+		header->blockSize = sizeof(Block);
+		header->headerSize = headerSize;
+		header->committed.store(0);
+		header->fileBlocks.store(std::max<std::uint64_t>(initialBlocks, 1));
+		header->sequence.store(0);
+		header->waiters.store(0);
+		memcpy(header->magic, magic, sizeof(magic)); //last, so a half-made log is never mistaken for a good one
+		return true;
+	}
+
+	if (static_cast<std::uint64_t>(st.st_size) < headerSize || memcmp(header->magic, magic, sizeof(magic)) != 0 || header->blockSize != sizeof(Block)) {
+		error = fname + " is not a block log from this build";
+		Close();
+		return false;
+	}
+
+	//trust the file over the header for how much room there is
+	header->fileBlocks.store((st.st_size - headerSize) / sizeof(Block));
+	if (header->committed.load() > header->fileBlocks.load()) {
+		error = fname + " is truncated";
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void BlockLogWriter::Close() {
+	if (header) {
+		munmap(header, reservedBytes);
+		header = nullptr;
+		blocks = nullptr;
+	}
+	if (fd >= 0) {
+		close(fd);
+		fd = -1;
+	}
+}
+
+bool BlockLogWriter::Reserve(std::uint64_t count) {
+	std::uint64_t needed = header->committed.load(std::memory_order_relaxed) + count;
+	std::uint64_t have = header->fileBlocks.load(std::memory_order_relaxed);
+	if (needed <= have) {
+		return true;
+	}
+	if (needed > maxBlocks) {
+		error = "the log is full";
+		return false;
+	}
+
+	std::uint64_t grown = std::min(maxBlocks, std::max(needed, have * 2));
+	if (ftruncate(fd, headerSize + grown * sizeof(Block)) != 0) {
+		error = std::string("failed to grow the log: ") + strerror(errno);
+		return false;
+	}
+	header->fileBlocks.store(grown);
+	return true;
+}
+
+bool BlockLogWriter::Append(Block const& block) {
+	return Append(&block, 1);
+}
+
+bool BlockLogWriter::Append(Block const* source, std::size_t count) {
+	if (!header || !Reserve(count)) {
+		return false;
+	}
+
+	std::uint64_t position = header->committed.load(std::memory_order_relaxed);
+	memcpy(blocks + position, source, count * sizeof(Block));
+
+	//publish, then wake anyone who went to sleep before seeing it
+	//sequentially consistent so a reader registering as a waiter either sees the commit or gets woken
+	header->committed.store(position + count);
+	header->sequence.fetch_add(1);
+	if (header->waiters.load() > 0) {
+		futexWake(&header->sequence);
+	}
+	return true;
+}
+
+bool BlockLogWriter::Sync() {
+	if (!header) {
+		return false;
+	}
+	std::size_t bytes = headerSize + header->committed.load() * sizeof(Block);
+	return msync(header, bytes, MS_SYNC) == 0;
+}
+
+std::uint64_t BlockLogWriter::Committed() const {
+	return header ? header->committed.load(std::memory_order_acquire) : 0;
+}
+
+//reader
+BlockLogReader::~BlockLogReader() {
+	Close();
+}
+
+bool BlockLogReader::Open(std::string const& fname) {
+	Close();
+
+	//the header page is writable so this reader can register as a waiter; the blocks are read-only
+	fd = open(fname.c_str(), O_RDWR);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		error = "failed to open " + fname + ": " + strerror(errno);
+		Close();
+		return false;
+	}
+	if (static_cast<std::uint64_t>(st.st_size) < BlockLogWriter::headerSize) {
+		error = fname + " is not a block log";
+		Close();
+		return false;
+	}
+
+	void* headerPage = mmap(nullptr, BlockLogWriter::headerSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	void* data = mmap(nullptr, reservedBytes - BlockLogWriter::headerSize, PROT_READ, MAP_SHARED | MAP_NORESERVE, fd, BlockLogWriter::headerSize);
+	if (headerPage == MAP_FAILED || data == MAP_FAILED) {
+		error = std::string("mmap: ") + strerror(errno);
+		if (headerPage != MAP_FAILED) {
+			munmap(headerPage, BlockLogWriter::headerSize);
+		}
+		if (data != MAP_FAILED) {
+			munmap(data, reservedBytes - BlockLogWriter::headerSize);
+		}
+		Close();
+		return false;
+	}
+	header = static_cast<BlockLogHeader*>(headerPage);
+	blocks = static_cast<Block const*>(data);
+
+	if (memcmp(header->magic, magic, sizeof(magic)) != 0 || header->blockSize != sizeof(Block)) {
+		error = fname + " is not a block log from this build";
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void BlockLogReader::Close() {
+	if (header) {
+		munmap(header, BlockLogWriter::headerSize);
+		header = nullptr;
+	}
+	if (blocks) {
+		munmap(const_cast<Block*>(blocks), reservedBytes - BlockLogWriter::headerSize);
+		blocks = nullptr;
+	}
+	if (fd >= 0) {
+		close(fd);
+		fd = -1;
+	}
+}
+
+std::uint64_t BlockLogReader::Committed() const {
+	return header ? header->committed.load(std::memory_order_acquire) : 0;
+}
+
+std::uint64_t BlockLogReader::Wait(std::uint64_t known, std::chrono::milliseconds timeout) {
+	std::uint64_t committed = Committed();
+	if (committed > known || !header) {
+		return committed;
+	}
+
+	header->waiters.fetch_add(1);
+	std::uint32_t sequence = header->sequence.load();
+	if (header->committed.load() <= known) {
+		futexWait(&header->sequence, sequence, timeout);
+	}
+	header->waiters.fetch_sub(1);
+	return Committed();
+}
+
+std::size_t BlockLogSource::Read(std::uint64_t position, Block* out, std::size_t max) {
+	std::uint64_t committed = log.Committed();
+	if (position >= committed) {
+		return 0;
+	}
+
+	std::size_t count = static_cast<std::size_t>(std::min<std::uint64_t>(max, committed - position));
+	memcpy(out, log.Blocks() + position, count * sizeof(Block));
+	return count;
+}
+
+int tailMain(int argc, char* argv[]) {
+	const char* fname = nullptr;
+	std::uint64_t position = 0;
+	bool follow = false;
+	ExportFormat format = ExportFormat::TEXT;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--from") && i + 1 < argc) {
+			position = strtoull(argv[++i], nullptr, 0);
+		}
+		else if (!strcmp(argv[i], "--follow")) {
+			follow = true;
+		}
+		else if (!strcmp(argv[i], "--format") && i + 1 < argc && parseExportFormat(argv[i + 1], format)) {
+			i++;
+		}
+		else if (!fname && argv[i][0] != '-') {
+			fname = argv[i];
+		}
+		else {
+			fname = nullptr;
+			break;
+		}
+	}
+
+	if (!fname) {
+		std::cerr << "usage: sixpence tail log [--from N] [--follow] [--format text|csv|jsonl]" << std::endl;
+		return 1;
+	}
+
+	BlockLogReader reader;
+	if (!reader.Open(fname)) {
+		std::cerr << reader.GetError() << std::endl;
+		return 1;
+	}
+
+	std::string header = exportHeader(format);
+	if (write(STDOUT_FILENO, header.data(), header.size()) < 0) {
+		return 1;
+	}
+
+	//formatted straight from the mapping, a buffer at a time
+	const std::size_t batch = 4096;
+	std::vector<char> buffer(batch * maxFormattedBlock);
+
+	for (;;) {
+		std::uint64_t committed = reader.Committed();
+		if (position >= committed) {
+			if (!follow) {
+				return 0;
+			}
+			reader.Wait(position, std::chrono::milliseconds(1000));
+			continue;
+		}
+
+		std::uint64_t end = std::min(committed, position + batch);
+		char* p = buffer.data();
+		for (; position < end; position++) {
+			p += formatBlock(p, reader.Blocks()[position], format);
+		}
+
+		for (const char* q = buffer.data(); q < p;) {
+			ssize_t written = write(STDOUT_FILENO, q, p - q);
+			if (written < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return errno == EPIPE ? 0 : 1;
+			}
+			q += written;
+		}
+	}
+}
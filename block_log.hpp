@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "change_feed.hpp"
+#include "ledger.hpp"
+
+//an append-only log of blocks that other processes on the host can follow
+//the file is a header page followed by raw Blocks; the header holds the commit count, which only
+//moves forward once the blocks before it are fully written, and a futex word the writer bumps on
+//every commit so tailing processes can sleep instead of polling
+//both sides map the file once with a large fixed reservation, so growing the file never moves the
+//mapping and pointers into it stay valid; readers get the blocks zero-copy, with no IPC per block
+
+struct BlockLogHeader {
+	char magic[8];
+	std::uint32_t blockSize;
+	std::uint32_t headerSize;
+	std::atomic<std::uint64_t> committed; //blocks readers may use
+	std::atomic<std::uint64_t> fileBlocks; //blocks the file currently has room for
+	alignas(64) std::atomic<std::uint32_t> sequence; //futex word, bumped on every commit
+	std::atomic<std::uint32_t> waiters; //readers asleep on sequence, so the writer knows to wake them
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "the log header needs address-free atomics");
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free, "the log header needs address-free atomics");
+
+class BlockLogWriter {
+public:
+	static constexpr std::size_t headerSize = 4096;
+	static constexpr std::uint64_t maxBlocks = std::uint64_t(1) << 31; //the address space reserved, about 96GB
+
+	BlockLogWriter() = default;
+	~BlockLogWriter();
+
+	BlockLogWriter(BlockLogWriter const&) = delete;
+	BlockLogWriter& operator=(BlockLogWriter const&) = delete;
+
+	//create the log, or reopen it and continue after its last committed block
+	bool Open(std::string const& fname, std::uint64_t initialBlocks = 1 << 16);
+	void Close();
+
+	//write and commit, one commit (and at most one wake) per call
+	bool Append(Block const& block);
+	bool Append(Block const* blocks, std::size_t count);
+
+	//flush what is committed to disk; tailing readers don't need this, it is for crashes
+	bool Sync();
+
+	std::uint64_t Committed() const;
+	Block const* Blocks() const { return blocks; }
+
+	std::string const& GetError() const { return error; }
+
+private:
+	bool Reserve(std::uint64_t count);
+
+	int fd = -1;
+	BlockLogHeader* header = nullptr;
+	Block* blocks = nullptr;
+	std::string error;
+};
+
+class BlockLogReader {
+public:
+	BlockLogReader() = default;
+	~BlockLogReader();
+
+	BlockLogReader(BlockLogReader const&) = delete;
+	BlockLogReader& operator=(BlockLogReader const&) = delete;
+
+	bool Open(std::string const& fname);
+	void Close();
+
+	std::uint64_t Committed() const;
+
+	//the first Committed() blocks are complete and never change; the pointer stays valid until Close()
+	Block const* Blocks() const { return blocks; }
+
+	//sleep until more than known blocks are committed or the timeout passes, returns Committed()
+	std::uint64_t Wait(std::uint64_t known, std::chrono::milliseconds timeout);
+
+	std::string const& GetError() const { return error; }
+
+private:
+	int fd = -1;
+	BlockLogHeader* header = nullptr;
+	Block const* blocks = nullptr;
+	std::string error;
+};
+
+//the change feed's fallback, for subscribers lapped by the ring
+class BlockLogSource : public BlockSource {
+public:
+	BlockLogSource(BlockLogWriter const& log) : log(log) {}
+
+	std::size_t Read(std::uint64_t position, Block* out, std::size_t max) override;
+
+private:
+	BlockLogWriter const& log;
+};
+
+//"sixpence tail log [--from N] [--follow] [--format text|csv|jsonl]", run from another process
+int tailMain(int argc, char* argv[]);
@@ -0,0 +1,126 @@
+#include "change_feed.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+ReservedChainSource::ReservedChainSource(std::vector<Block> const& chain, std::atomic<std::uint64_t> const& published) :
+	chain(chain),
+	published(published)
+{
+	//EMPTY
+}
+
+std::size_t ReservedChainSource::Read(std::uint64_t position, Block* out, std::size_t max) {
+	//only what the feed has published is guaranteed to be fully written
+	std::uint64_t end = published.load(std::memory_order_acquire);
+	if (position >= end) {
+		return 0;
+	}
+
+	std::size_t count = static_cast<std::size_t>(std::min<std::uint64_t>(max, end - position));
+	memcpy(out, chain.data() + position, count * sizeof(Block));
+	return count;
+}
+
+BlockFeed::BlockFeed(std::size_t capacity, std::uint64_t start) :
+	first(start),
+	published(start)
+{
+	std::size_t size = 1;
+	while (size < capacity) {
+		size <<= 1;
+	}
+	slots.reset(new Slot[size]);
+	mask = size - 1;
+}
+
+void BlockFeed::Publish(Block const& block) {
+	std::uint64_t position = published.load(std::memory_order_relaxed);
+	Slot& slot = slots[position & mask];
+
+	slot.sequence.store(2 * position + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(&slot.block, &block, sizeof(Block));
+	slot.sequence.store(2 * position + 2, std::memory_order_release);
+
+	published.store(position + 1, std::memory_order_release);
+}
+
+FeedSubscription::FeedSubscription(BlockFeed& feed, std::uint64_t start, BlockSource* fallback) :
+	feed(feed),
+	fallback(fallback),
+	position(start)
+{
+	//EMPTY
+}
+
+std::size_t FeedSubscription::Poll(Block* out, std::size_t max) {
+	for (;;) {
+		std::uint64_t head = feed.published.load(std::memory_order_acquire);
+		if (position >= head || max == 0) {
+			return 0;
+		}
+
+		//lapped: the ring no longer holds our next block
+		std::uint64_t oldest = std::max(feed.first, head > feed.Capacity() ? head - feed.Capacity() : 0);
+		if (position < oldest) {
+			std::size_t count = fallback ? fallback->Read(position, out, static_cast<std::size_t>(std::min<std::uint64_t>(max, oldest - position))) : 0;
+			if (count > 0) {
+				fallbackReads += count;
+				position += count;
+				return count;
+			}
+			lagged += oldest - position;
+			position = oldest;
+		}
+
+		std::size_t wanted = static_cast<std::size_t>(std::min<std::uint64_t>(max, head - position));
+		std::size_t count = 0;
+		for (; count < wanted; count++) {
+			std::uint64_t target = position + count;
+			BlockFeed::Slot const& slot = feed.slots[target & feed.mask];
+
+			std::uint64_t before = slot.sequence.load(std::memory_order_acquire);
+			if (before != 2 * target + 2) {
+				break; //overwritten since we looked at head
+			}
+			memcpy(&out[count], &slot.block, sizeof(Block));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.sequence.load(std::memory_order_relaxed) != before) {
+				break; //torn by the writer lapping us mid-copy
+			}
+		}
+
+		if (count > 0) {
+			ringReads += count;
+			position += count;
+			return count;
+		}
+		//lapped between reading head and the slot, go round again and take the slow path
+	}
+}
+
+std::size_t FeedSubscription::Wait(Block* out, std::size_t max, std::chrono::nanoseconds timeout) {
+	auto deadline = std::chrono::steady_clock::now() + timeout;
+
+	for (int attempt = 0;; attempt++) {
+		std::size_t count = Poll(out, max);
+		if (count > 0) {
+			return count;
+		}
+
+		if (attempt < 64) {
+			//spin briefly, blocks usually arrive in bursts
+		}
+		else if (attempt < 128) {
+			std::this_thread::yield();
+		}
+		else {
+			if (std::chrono::steady_clock::now() >= deadline) {
+				return 0;
+			}
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+		}
+	}
+}
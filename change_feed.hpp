@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ledger.hpp"
+
+//a change feed of appended blocks
+//the ledger publishes every block, once it's final, into a fixed broadcast ring; subscribers read from the ring
+//at their own pace without any lock, and the writer never waits for them, so fan-out costs it nothing
+//a subscriber that falls more than a ring behind is lapped, and catches up from a BlockSource (the
+//block store) if it has one, or skips ahead and counts what it lost
+//positions are places in the chain, not block indices, which have gaps
+
+//somewhere to read blocks the ring has already dropped
+class BlockSource {
+public:
+	virtual ~BlockSource() = default;
+
+	//copy up to max blocks starting at position into out, returns how many were available
+	virtual std::size_t Read(std::uint64_t position, Block* out, std::size_t max) = 0;
+};
+
+//reads straight out of a chain vector that was reserved up front
+//the vector must not reallocate while the source is in use, see reserveLedger()
+class ReservedChainSource : public BlockSource {
+public:
+	ReservedChainSource(std::vector<Block> const& chain, std::atomic<std::uint64_t> const& published);
+
+	std::size_t Read(std::uint64_t position, Block* out, std::size_t max) override;
+
+private:
+	std::vector<Block> const& chain;
+	std::atomic<std::uint64_t> const& published;
+};
+
+class BlockFeed {
+public:
+	//capacity is rounded up to a power of two
+	//start is the position of the first block that will be published, normally the tip's, as the
+	//ledger publishes a block once the next has been pushed (see setBlockFeed())
+	BlockFeed(std::size_t capacity = 1 << 12, std::uint64_t start = 0);
+
+	BlockFeed(BlockFeed const&) = delete;
+	BlockFeed& operator=(BlockFeed const&) = delete;
+
+	//single writer
+	void Publish(Block const& block);
+
+	//blocks published so far, i.e. the position the next block will have
+	std::uint64_t Published() const { return published.load(std::memory_order_acquire); }
+	std::atomic<std::uint64_t> const& PublishedCounter() const { return published; }
+
+	std::size_t Capacity() const { return mask + 1; }
+
+private:
+	friend class FeedSubscription;
+
+	//seqlock per slot: 2 * position + 1 while being written, 2 * position + 2 once it holds position
+	struct Slot {
+		std::atomic<std::uint64_t> sequence{0};
+		Block block;
+	};
+
+	std::unique_ptr<Slot[]> slots;
+	std::size_t mask;
+	std::uint64_t first; //blocks before this were never in the ring
+	alignas(64) std::atomic<std::uint64_t> published{0};
+};
+
+class FeedSubscription {
+public:
+	FeedSubscription(BlockFeed& feed, std::uint64_t start, BlockSource* fallback = nullptr);
+
+	//copy up to max newly appended blocks into out without waiting, returns how many
+	std::size_t Poll(Block* out, std::size_t max);
+
+	//like Poll, but backs off (spin, yield, then short sleeps) until something arrives or the timeout passes
+	std::size_t Wait(Block* out, std::size_t max, std::chrono::nanoseconds timeout);
+
+	//the position of the next block this subscriber will receive
+	std::uint64_t Position() const { return position; }
+
+	//blocks received from the ring and from the fallback, and blocks lost to being lapped with no fallback
+	std::uint64_t RingReads() const { return ringReads; }
+	std::uint64_t FallbackReads() const { return fallbackReads; }
+	std::uint64_t Lagged() const { return lagged; }
+
+private:
+	BlockFeed& feed;
+	BlockSource* fallback;
+	std::uint64_t position;
+	std::uint64_t ringReads = 0;
+	std::uint64_t fallbackReads = 0;
+	std::uint64_t lagged = 0;
+};
@@ -0,0 +1,703 @@
+#include "columnar.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+
+static const char magic[8] = { 'S', 'P', 'X', 'C', 'O', 'L', '1', '\n' };
+
+static const struct {
+	const char* name;
+	ColumnType type;
+} schema[COLUMN_COUNT] = {
+	{ "index", ColumnType::UINT32 },
+	{ "prev_hash", ColumnType::UINT32 },
+	{ "nonce", ColumnType::UINT32 },
+	{ "threshold", ColumnType::UINT32 },
+	{ "timestamp", ColumnType::INT64 },
+	{ "type", ColumnType::INT8 },
+	{ "sender", ColumnType::UINT32 },
+	{ "account", ColumnType::UINT32 },
+	{ "prev_receipt", ColumnType::UINT32 },
+	{ "prev_transfer", ColumnType::UINT32 },
+	{ "amount", ColumnType::UINT32 },
+	{ "balance", ColumnType::UINT32 },
+	{ "reserved", ColumnType::UINT32 },
+};
+
+const char* columnName(ColumnarColumn column) {
+	return schema[column].name;
+}
+
+ColumnType columnType(ColumnarColumn column) {
+	return schema[column].type;
+}
+
+static std::size_t typeWidth(ColumnType type) {
+	switch (type) {
+		case ColumnType::INT8: return 1;
+		case ColumnType::UINT32: return 4;
+		case ColumnType::INT64: return 8;
+	}
+	return 8;
+}
+
+static const char* encodingName(ColumnEncoding encoding) {
+	switch (encoding) {
+		case ColumnEncoding::PLAIN: return "plain";
+		case ColumnEncoding::DELTA: return "delta";
+		case ColumnEncoding::RLE: return "rle";
+	}
+	return "?";
+}
+
+//rows and blocks
+static void splitBlock(Block const& block, std::int64_t row[COLUMN_COUNT]) {
+	std::uint32_t words[5];
+	memcpy(words, &block.transaction, sizeof(words));
+
+	row[COLUMN_INDEX] = block.index;
+	row[COLUMN_PREV_HASH] = block.prevHash;
+	row[COLUMN_NONCE] = block.nonce;
+	row[COLUMN_THRESHOLD] = block.threshold;
+	row[COLUMN_TIMESTAMP] = block.timestamp.count();
+	row[COLUMN_TYPE] = static_cast<int>(block.transaction.type);
+	row[COLUMN_RESERVED] = block.reserved;
+
+	for (int c = COLUMN_SENDER; c <= COLUMN_BALANCE; c++) {
+		row[c] = 0;
+	}
+
+	switch (block.transaction.type) {
+		case TransactionType::GENERATE:
+		case TransactionType::TRANSFER:
+			row[COLUMN_SENDER] = words[1];
+			row[COLUMN_ACCOUNT] = words[2];
+			row[COLUMN_PREV_RECEIPT] = words[3];
+			row[COLUMN_AMOUNT] = words[4];
+		break;
+
+		case TransactionType::RECEIPT:
+			row[COLUMN_ACCOUNT] = words[1];
+			row[COLUMN_PREV_RECEIPT] = words[2];
+			row[COLUMN_PREV_TRANSFER] = words[3];
+			row[COLUMN_BALANCE] = words[4];
+		break;
+
+		default:
+			row[COLUMN_SENDER] = words[1];
+			row[COLUMN_ACCOUNT] = words[2];
+			row[COLUMN_PREV_RECEIPT] = words[3];
+			row[COLUMN_PREV_TRANSFER] = words[4];
+		break;
+	}
+}
+
+static Block joinBlock(std::int64_t const row[COLUMN_COUNT]) {
+	Block block;
+	memset(&block, 0, sizeof(Block));
+	block.index = row[COLUMN_INDEX];
+	block.prevHash = row[COLUMN_PREV_HASH];
+	block.nonce = row[COLUMN_NONCE];
+	block.threshold = row[COLUMN_THRESHOLD];
+	block.timestamp = Clock::duration(row[COLUMN_TIMESTAMP]);
+
+	std::uint32_t words[5] = { static_cast<std::uint32_t>(row[COLUMN_TYPE]) };
+	switch (static_cast<TransactionType>(row[COLUMN_TYPE])) {
+		case TransactionType::GENERATE:
+		case TransactionType::TRANSFER:
+			words[1] = row[COLUMN_SENDER];
+			words[2] = row[COLUMN_ACCOUNT];
+			words[3] = row[COLUMN_PREV_RECEIPT];
+			words[4] = row[COLUMN_AMOUNT];
+		break;
+
+		case TransactionType::RECEIPT:
+			words[1] = row[COLUMN_ACCOUNT];
+			words[2] = row[COLUMN_PREV_RECEIPT];
+			words[3] = row[COLUMN_PREV_TRANSFER];
+			words[4] = row[COLUMN_BALANCE];
+		break;
+
+		default:
+			words[1] = row[COLUMN_SENDER];
+			words[2] = row[COLUMN_ACCOUNT];
+			words[3] = row[COLUMN_PREV_RECEIPT];
+			words[4] = row[COLUMN_PREV_TRANSFER];
+		break;
+	}
+	memcpy(&block.transaction, words, sizeof(words));
+	block.reserved = row[COLUMN_RESERVED];
+	return block;
+}
+
+//encodings
+static std::uint64_t zigzag(std::int64_t value) {
+	return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+}
+
+static std::int64_t unzigzag(std::uint64_t value) {
+	return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+}
+
+static void putVarint(std::vector<unsigned char>& out, std::uint64_t value) {
+	while (value >= 0x80) {
+		out.push_back(static_cast<unsigned char>(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back(static_cast<unsigned char>(value));
+}
+
+static bool getVarint(const unsigned char*& p, const unsigned char* end, std::uint64_t& value) {
+	value = 0;
+	for (int shift = 0; shift < 64 && p < end; shift += 7) {
+		unsigned char byte = *p++;
+		value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void putFixed(std::vector<unsigned char>& out, std::uint64_t value, std::size_t width) {
+	for (std::size_t i = 0; i < width; i++) {
+		out.push_back(static_cast<unsigned char>(value >> (8 * i)));
+	}
+}
+
+static std::uint64_t getFixed(const unsigned char* p, std::size_t width) {
+	std::uint64_t value = 0;
+	for (std::size_t i = 0; i < width; i++) {
+		value |= static_cast<std::uint64_t>(p[i]) << (8 * i);
+	}
+	return value;
+}
+
+static void encodeDelta(std::vector<std::int64_t> const& values, std::vector<unsigned char>& out) {
+	std::int64_t previous = 0;
+	for (std::int64_t value : values) {
+		putVarint(out, zigzag(static_cast<std::int64_t>(static_cast<std::uint64_t>(value) - static_cast<std::uint64_t>(previous))));
+		previous = value;
+	}
+}
+
+static void encodeRle(std::vector<std::int64_t> const& values, std::vector<unsigned char>& out) {
+	for (std::size_t i = 0; i < values.size();) {
+		std::size_t run = 1;
+		while (i + run < values.size() && values[i + run] == values[i]) {
+			run++;
+		}
+		putVarint(out, zigzag(values[i]));
+		putVarint(out, run);
+		i += run;
+	}
+}
+
+//pick the smallest encoding; scratch holds one buffer per encoding, reused between calls,
+//and the chosen one is returned through out
+static ColumnEncoding encodeColumn(std::vector<std::int64_t> const& values, ColumnType type, std::vector<unsigned char> scratch[3], std::vector<unsigned char>*& out) {
+	std::vector<unsigned char>& plain = scratch[static_cast<int>(ColumnEncoding::PLAIN)];
+	std::vector<unsigned char>& delta = scratch[static_cast<int>(ColumnEncoding::DELTA)];
+	std::vector<unsigned char>& rle = scratch[static_cast<int>(ColumnEncoding::RLE)];
+
+	delta.clear();
+	rle.clear();
+	encodeDelta(values, delta);
+	encodeRle(values, rle);
+
+	std::size_t plainSize = values.size() * typeWidth(type);
+	if (rle.size() <= delta.size() && rle.size() < plainSize) {
+		out = &rle;
+		return ColumnEncoding::RLE;
+	}
+	if (delta.size() < plainSize) {
+		out = &delta;
+		return ColumnEncoding::DELTA;
+	}
+
+	plain.clear();
+	for (std::int64_t value : values) {
+		putFixed(plain, static_cast<std::uint64_t>(value), typeWidth(type));
+	}
+	out = &plain;
+	return ColumnEncoding::PLAIN;
+}
+
+//sign-extend or zero-extend a fixed-width value back to the column's type
+static std::int64_t widen(std::uint64_t raw, ColumnType type) {
+	switch (type) {
+		case ColumnType::INT8: return static_cast<std::int8_t>(raw);
+		case ColumnType::UINT32: return static_cast<std::uint32_t>(raw);
+		case ColumnType::INT64: return static_cast<std::int64_t>(raw);
+	}
+	return static_cast<std::int64_t>(raw);
+}
+
+static bool decodeColumn(ColumnEncoding encoding, ColumnType type, const unsigned char* p, const unsigned char* end, std::uint64_t rows, std::vector<std::int64_t>& out) {
+	out.clear();
+	out.reserve(rows);
+
+	switch (encoding) {
+		case ColumnEncoding::PLAIN: {
+			std::size_t width = typeWidth(type);
+			if (static_cast<std::uint64_t>(end - p) != rows * width) {
+				return false;
+			}
+			for (std::uint64_t i = 0; i < rows; i++, p += width) {
+				out.push_back(widen(getFixed(p, width), type));
+			}
+			return true;
+		}
+
+		case ColumnEncoding::DELTA: {
+			std::uint64_t previous = 0;
+			for (std::uint64_t i = 0; i < rows; i++) {
+				std::uint64_t raw;
+				if (!getVarint(p, end, raw)) {
+					return false;
+				}
+				previous += static_cast<std::uint64_t>(unzigzag(raw));
+				out.push_back(static_cast<std::int64_t>(previous));
+			}
+			return p == end;
+		}
+
+		case ColumnEncoding::RLE: {
+			while (out.size() < rows) {
+				std::uint64_t raw, run;
+				if (!getVarint(p, end, raw) || !getVarint(p, end, run) || run > rows - out.size()) {
+					return false;
+				}
+				out.insert(out.end(), run, unzigzag(raw));
+			}
+			return p == end;
+		}
+	}
+	return false;
+}
+
+//writer
+ColumnarWriter::ColumnarWriter(std::size_t rowGroupSize) :
+	rowGroupSize(std::max<std::size_t>(rowGroupSize, 1))
+{
+	for (std::vector<std::int64_t>& column : columns) {
+		column.reserve(this->rowGroupSize);
+	}
+}
+
+ColumnarWriter::~ColumnarWriter() {
+	if (fp) {
+		fclose(fp);
+	}
+}
+
+bool ColumnarWriter::Open(std::string const& fname) {
+	fp = fopen(fname.c_str(), "wb");
+	if (!fp) {
+		error = "failed to open " + fname;
+		return false;
+	}
+	if (fwrite(magic, sizeof(magic), 1, fp) != 1) {
+		error = "failed to write " + fname;
+		return false;
+	}
+	offset = sizeof(magic);
+	return true;
+}
+
+void ColumnarWriter::Append(Block const& block) {
+	std::int64_t row[COLUMN_COUNT];
+	splitBlock(block, row);
+	for (int c = 0; c < COLUMN_COUNT; c++) {
+		columns[c].push_back(row[c]);
+	}
+
+	if (columns[0].size() >= rowGroupSize) {
+		FlushRowGroup();
+	}
+}
+
+bool ColumnarWriter::FlushRowGroup() {
+	if (columns[0].empty() || !fp) {
+		return fp != nullptr;
+	}
+
+	RowGroupInfo info;
+	info.rows = columns[0].size();
+
+	for (int c = 0; c < COLUMN_COUNT; c++) {
+		ColumnChunkInfo& chunk = info.columns[c];
+		auto range = std::minmax_element(columns[c].begin(), columns[c].end());
+		chunk.min = *range.first;
+		chunk.max = *range.second;
+		std::vector<unsigned char>* encoded;
+		chunk.encoding = encodeColumn(columns[c], schema[c].type, scratch, encoded);
+		chunk.offset = offset;
+		chunk.length = encoded->size();
+
+		if (fwrite(encoded->data(), 1, encoded->size(), fp) != encoded->size()) {
+			error = "write failed";
+			return false;
+		}
+		offset += encoded->size();
+		columns[c].clear();
+	}
+
+	rowGroups.push_back(info);
+	return true;
+}
+
+bool ColumnarWriter::Close() {
+	if (!fp) {
+		return false;
+	}
+
+	bool ok = FlushRowGroup() && error.empty();
+
+	std::vector<unsigned char> footer;
+	footer.push_back(COLUMN_COUNT);
+	for (auto const& column : schema) {
+		footer.push_back(static_cast<unsigned char>(column.type));
+		footer.push_back(static_cast<unsigned char>(strlen(column.name)));
+		footer.insert(footer.end(), column.name, column.name + strlen(column.name));
+	}
+
+	putFixed(footer, rowGroups.size(), 8);
+	for (RowGroupInfo const& info : rowGroups) {
+		putFixed(footer, info.rows, 8);
+		for (ColumnChunkInfo const& chunk : info.columns) {
+			putFixed(footer, chunk.offset, 8);
+			putFixed(footer, chunk.length, 8);
+			footer.push_back(static_cast<unsigned char>(chunk.encoding));
+			putFixed(footer, static_cast<std::uint64_t>(chunk.min), 8);
+			putFixed(footer, static_cast<std::uint64_t>(chunk.max), 8);
+		}
+	}
+	putFixed(footer, footer.size(), 8);
+	footer.insert(footer.end(), magic, magic + sizeof(magic));
+
+	if (fwrite(footer.data(), 1, footer.size(), fp) != footer.size()) {
+		error = "write failed";
+		ok = false;
+	}
+	if (fclose(fp) != 0) {
+		error = "close failed";
+		ok = false;
+	}
+	fp = nullptr;
+	return ok;
+}
+
+//reader
+ColumnarReader::~ColumnarReader() {
+	if (fp) {
+		fclose(fp);
+	}
+}
+
+bool ColumnarReader::Open(std::string const& fname) {
+	fp = fopen(fname.c_str(), "rb");
+	if (!fp) {
+		error = "failed to open " + fname;
+		return false;
+	}
+
+	//the trailer: footer length, then the magic again
+	unsigned char trailer[16];
+	if (fseek(fp, -16, SEEK_END) != 0 || fread(trailer, 1, sizeof(trailer), fp) != sizeof(trailer) || memcmp(trailer + 8, magic, sizeof(magic)) != 0) {
+		error = fname + " is not a columnar chain file";
+		return false;
+	}
+
+	std::uint64_t footerLength = getFixed(trailer, 8);
+	long end = ftell(fp) - 16;
+	if (footerLength > static_cast<std::uint64_t>(end) - sizeof(magic)) {
+		error = "corrupt footer";
+		return false;
+	}
+
+	std::vector<unsigned char> footer(footerLength);
+	if (fseek(fp, end - static_cast<long>(footerLength), SEEK_SET) != 0 || fread(footer.data(), 1, footer.size(), fp) != footer.size()) {
+		error = "failed to read the footer";
+		return false;
+	}
+
+	const unsigned char* p = footer.data();
+	const unsigned char* footerEnd = p + footer.size();
+	auto need = [&](std::size_t bytes) { return static_cast<std::size_t>(footerEnd - p) >= bytes; };
+
+	//the schema must be the one this build writes
+	if (!need(1) || *p++ != COLUMN_COUNT) {
+		error = "unsupported schema";
+		return false;
+	}
+	for (auto const& column : schema) {
+		std::size_t length = strlen(column.name);
+		if (!need(2 + length) || p[0] != static_cast<unsigned char>(column.type) || p[1] != length || memcmp(p + 2, column.name, length) != 0) {
+			error = "unsupported schema";
+			return false;
+		}
+		p += 2 + length;
+	}
+
+	if (!need(8)) {
+		error = "corrupt footer";
+		return false;
+	}
+	std::uint64_t count = getFixed(p, 8);
+	p += 8;
+
+	const std::size_t chunkBytes = 8 + 8 + 1 + 8 + 8;
+	if (count > static_cast<std::uint64_t>(footerEnd - p) / (8 + COLUMN_COUNT * chunkBytes)) {
+		error = "corrupt footer";
+		return false;
+	}
+
+	rowGroups.resize(count);
+	for (RowGroupInfo& info : rowGroups) {
+		info.rows = getFixed(p, 8);
+		p += 8;
+		for (ColumnChunkInfo& chunk : info.columns) {
+			chunk.offset = getFixed(p, 8);
+			chunk.length = getFixed(p + 8, 8);
+			chunk.encoding = static_cast<ColumnEncoding>(p[16]);
+			chunk.min = static_cast<std::int64_t>(getFixed(p + 17, 8));
+			chunk.max = static_cast<std::int64_t>(getFixed(p + 25, 8));
+			p += chunkBytes;
+
+			if (chunk.offset + chunk.length > static_cast<std::uint64_t>(end) - footerLength || chunk.encoding > ColumnEncoding::RLE) {
+				error = "corrupt footer";
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+std::uint64_t ColumnarReader::RowCount() const {
+	std::uint64_t rows = 0;
+	for (RowGroupInfo const& info : rowGroups) {
+		rows += info.rows;
+	}
+	return rows;
+}
+
+bool ColumnarReader::ReadColumn(std::size_t rowGroup, ColumnarColumn column, std::vector<std::int64_t>& out) {
+	if (!fp || rowGroup >= rowGroups.size()) {
+		error = "no such row group";
+		return false;
+	}
+
+	RowGroupInfo const& info = rowGroups[rowGroup];
+	ColumnChunkInfo const& chunk = info.columns[column];
+
+	scratch.resize(chunk.length);
+	if (fseek(fp, static_cast<long>(chunk.offset), SEEK_SET) != 0 || fread(scratch.data(), 1, scratch.size(), fp) != scratch.size()) {
+		error = "failed to read column " + std::string(columnName(column));
+		return false;
+	}
+
+	if (!decodeColumn(chunk.encoding, schema[column].type, scratch.data(), scratch.data() + scratch.size(), info.rows, out)) {
+		error = "corrupt column " + std::string(columnName(column));
+		return false;
+	}
+	return true;
+}
+
+bool ColumnarReader::ReadRowGroup(std::size_t rowGroup, std::vector<Block>& out) {
+	std::vector<std::int64_t> columns[COLUMN_COUNT];
+	for (int c = 0; c < COLUMN_COUNT; c++) {
+		if (!ReadColumn(rowGroup, static_cast<ColumnarColumn>(c), columns[c])) {
+			return false;
+		}
+	}
+
+	std::int64_t row[COLUMN_COUNT];
+	for (std::uint64_t i = 0; i < rowGroups[rowGroup].rows; i++) {
+		for (int c = 0; c < COLUMN_COUNT; c++) {
+			row[c] = columns[c][i];
+		}
+		out.push_back(joinBlock(row));
+	}
+	return true;
+}
+
+//command line
+static int columnarWrite(int argc, char* argv[]) {
+	const char* inFile = nullptr;
+	const char* outFile = nullptr;
+	std::size_t rowGroupSize = 1 << 16;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--in") && i + 1 < argc) {
+			inFile = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+			outFile = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--row-group") && i + 1 < argc) {
+			rowGroupSize = strtoull(argv[++i], nullptr, 0);
+		}
+		else {
+			inFile = nullptr;
+			break;
+		}
+	}
+
+	if (!inFile || !outFile) {
+		std::cerr << "usage: sixpence columnar write --in chain.bin --out chain.spxc [--row-group N]" << std::endl;
+		return 1;
+	}
+
+	FILE* in = fopen(inFile, "rb");
+	if (!in) {
+		std::cerr << "failed to open " << inFile << std::endl;
+		return 1;
+	}
+
+	ColumnarWriter writer(rowGroupSize);
+	if (!writer.Open(outFile)) {
+		std::cerr << writer.GetError() << std::endl;
+		fclose(in);
+		return 1;
+	}
+
+	//streamed a batch at a time, the chain is never held in memory
+	std::vector<Block> batch(1 << 14);
+	std::uint64_t blocks = 0;
+	std::size_t count;
+	while ((count = fread(batch.data(), sizeof(Block), batch.size(), in)) > 0) {
+		for (std::size_t i = 0; i < count; i++) {
+			writer.Append(batch[i]);
+		}
+		blocks += count;
+	}
+	fclose(in);
+
+	if (!writer.Close()) {
+		std::cerr << "failed to write " << outFile << ": " << writer.GetError() << std::endl;
+		return 1;
+	}
+
+	std::cout << blocks << " blocks written to " << outFile << std::endl;
+	return 0;
+}
+
+static int columnarRead(int argc, char* argv[]) {
+	const char* file = nullptr;
+	const char* checkFile = nullptr;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--check") && i + 1 < argc) {
+			checkFile = argv[++i];
+		}
+		else if (!file && argv[i][0] != '-') {
+			file = argv[i];
+		}
+		else {
+			file = nullptr;
+			break;
+		}
+	}
+
+	if (!file) {
+		std::cerr << "usage: sixpence columnar read chain.spxc [--check chain.bin]" << std::endl;
+		return 1;
+	}
+
+	ColumnarReader reader;
+	if (!reader.Open(file)) {
+		std::cerr << reader.GetError() << std::endl;
+		return 1;
+	}
+
+	std::vector<RowGroupInfo> const& rowGroups = reader.GetRowGroups();
+	std::cout << reader.RowCount() << " rows in " << rowGroups.size() << " row groups" << std::endl;
+
+	//per column totals across row groups
+	std::cout << std::left << std::setw(16) << "column" << std::setw(8) << "type" << std::right
+		<< std::setw(14) << "bytes" << std::setw(10) << "b/row" << std::setw(24) << "min" << std::setw(24) << "max" << "  encodings" << std::endl;
+	for (int c = 0; c < COLUMN_COUNT; c++) {
+		std::uint64_t bytes = 0;
+		std::int64_t min = std::numeric_limits<std::int64_t>::max();
+		std::int64_t max = std::numeric_limits<std::int64_t>::min();
+		std::uint64_t encodings[3] = {};
+
+		for (RowGroupInfo const& info : rowGroups) {
+			bytes += info.columns[c].length;
+			min = std::min(min, info.columns[c].min);
+			max = std::max(max, info.columns[c].max);
+			encodings[static_cast<int>(info.columns[c].encoding)]++;
+		}
+
+		static const char* typeNames[] = { "int8", "uint32", "int64" };
+		std::cout << std::left << std::setw(16) << schema[c].name << std::setw(8) << typeNames[static_cast<int>(schema[c].type)] << std::right
+			<< std::setw(14) << bytes << std::setw(10) << std::fixed << std::setprecision(2) << (reader.RowCount() ? double(bytes) / reader.RowCount() : 0.0) << std::defaultfloat
+			<< std::setw(24) << (rowGroups.empty() ? 0 : min) << std::setw(24) << (rowGroups.empty() ? 0 : max) << " ";
+		for (int e = 0; e < 3; e++) {
+			if (encodings[e]) {
+				std::cout << " " << encodingName(static_cast<ColumnEncoding>(e)) << "x" << encodings[e];
+			}
+		}
+		std::cout << std::endl;
+	}
+
+	if (!checkFile) {
+		return 0;
+	}
+
+	//round trip, one row group at a time against the raw chain
+	FILE* original = fopen(checkFile, "rb");
+	if (!original) {
+		std::cerr << "failed to open " << checkFile << std::endl;
+		return 1;
+	}
+
+	std::vector<Block> blocks;
+	std::vector<Block> expected;
+	std::uint64_t position = 0;
+	for (std::size_t g = 0; g < rowGroups.size(); g++) {
+		blocks.clear();
+		if (!reader.ReadRowGroup(g, blocks)) {
+			std::cerr << reader.GetError() << std::endl;
+			fclose(original);
+			return 1;
+		}
+
+		expected.resize(blocks.size());
+		if (fread(expected.data(), sizeof(Block), expected.size(), original) != expected.size() || memcmp(expected.data(), blocks.data(), blocks.size() * sizeof(Block)) != 0) {
+			std::cerr << "round trip mismatch in row group " << g << " (rows " << position << " to " << position + blocks.size() << ")" << std::endl;
+			fclose(original);
+			return 1;
+		}
+		position += blocks.size();
+	}
+
+	Block extra;
+	bool trailing = fread(&extra, sizeof(Block), 1, original) == 1;
+	fclose(original);
+	if (trailing) {
+		std::cerr << "round trip mismatch: " << checkFile << " has more than " << position << " blocks" << std::endl;
+		return 1;
+	}
+
+	std::cout << "round trip matches " << checkFile << std::endl;
+	return 0;
+}
+
+int columnarMain(int argc, char* argv[]) {
+	if (argc > 1 && !strcmp(argv[1], "write")) {
+		return columnarWrite(argc - 1, argv + 1);
+	}
+	if (argc > 1 && !strcmp(argv[1], "read")) {
+		return columnarRead(argc - 1, argv + 1);
+	}
+
+	std::cerr << "usage: sixpence columnar write|read ..." << std::endl;
+	return 1;
+}
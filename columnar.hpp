@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "ledger.hpp"
+
+//a self-contained columnar file for offline analytics
+//blocks are appended one at a time and buffered into row groups; each row group stores every column
+//separately, with whichever of plain, delta or run-length encoding is smallest, plus its min and max
+//so readers can skip row groups without decoding them
+//
+//layout: magic, row group data..., footer (schema, then per row group the row count and per column
+//the offset, length, encoding, min and max), footer length (u64), magic
+//the transaction union is split into typed columns; the words a transaction type doesn't use read as
+//0, except for INVALID (blank) blocks, whose payload words are kept in sender, account, prev_receipt
+//and prev_transfer so the round trip is exact
+
+enum class ColumnType : std::uint8_t {
+	INT8,
+	UINT32,
+	INT64,
+};
+
+enum class ColumnEncoding : std::uint8_t {
+	PLAIN, //fixed width, little endian
+	DELTA, //zigzag varint of the first value, then of each difference
+	RLE, //zigzag varint value, varint run length
+};
+
+enum ColumnarColumn {
+	COLUMN_INDEX,
+	COLUMN_PREV_HASH,
+	COLUMN_NONCE,
+	COLUMN_THRESHOLD,
+	COLUMN_TIMESTAMP, //Clock ticks since the epoch
+	COLUMN_TYPE, //TransactionType
+	COLUMN_SENDER, //transfers
+	COLUMN_ACCOUNT, //the account credited: a transfer's receiver, or a receipt's owner
+	COLUMN_PREV_RECEIPT,
+	COLUMN_PREV_TRANSFER, //receipts
+	COLUMN_AMOUNT, //transfers
+	COLUMN_BALANCE, //receipts
+	COLUMN_RESERVED, //Block::reserved, zero but hashed along with everything else
+	COLUMN_COUNT,
+};
+
+struct ColumnChunkInfo {
+	std::uint64_t offset = 0;
+	std::uint64_t length = 0;
+	ColumnEncoding encoding = ColumnEncoding::PLAIN;
+	std::int64_t min = 0;
+	std::int64_t max = 0;
+};
+
+struct RowGroupInfo {
+	std::uint64_t rows = 0;
+	ColumnChunkInfo columns[COLUMN_COUNT];
+};
+
+const char* columnName(ColumnarColumn column);
+ColumnType columnType(ColumnarColumn column);
+
+class ColumnarWriter {
+public:
+	ColumnarWriter(std::size_t rowGroupSize = 1 << 16);
+	~ColumnarWriter();
+
+	ColumnarWriter(ColumnarWriter const&) = delete;
+	ColumnarWriter& operator=(ColumnarWriter const&) = delete;
+
+	bool Open(std::string const& fname);
+	void Append(Block const& block);
+
+	//flush the last row group and write the footer
+	bool Close();
+
+	std::string const& GetError() const { return error; }
+
+private:
+	bool FlushRowGroup();
+
+	std::size_t rowGroupSize;
+	FILE* fp = nullptr;
+	std::uint64_t offset = 0;
+	std::vector<std::int64_t> columns[COLUMN_COUNT];
+	std::vector<RowGroupInfo> rowGroups;
+	std::vector<unsigned char> scratch[3]; //one per encoding
+	std::string error;
+};
+
+class ColumnarReader {
+public:
+	ColumnarReader() = default;
+	~ColumnarReader();
+
+	ColumnarReader(ColumnarReader const&) = delete;
+	ColumnarReader& operator=(ColumnarReader const&) = delete;
+
+	//reads the footer only
+	bool Open(std::string const& fname);
+
+	std::vector<RowGroupInfo> const& GetRowGroups() const { return rowGroups; }
+	std::uint64_t RowCount() const;
+
+	//decode one column of one row group
+	bool ReadColumn(std::size_t rowGroup, ColumnarColumn column, std::vector<std::int64_t>& out);
+
+	//decode a whole row group back into blocks, appended to out
+	bool ReadRowGroup(std::size_t rowGroup, std::vector<Block>& out);
+
+	std::string const& GetError() const { return error; }
+
+private:
+	FILE* fp = nullptr;
+	std::vector<RowGroupInfo> rowGroups;
+	std::vector<unsigned char> scratch;
+	std::string error;
+};
+
+//"sixpence columnar write --in chain.bin --out chain.spxc [--row-group N]"
+//"sixpence columnar read chain.spxc [--check chain.bin]"
+int columnarMain(int argc, char* argv[]);
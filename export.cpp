@@ -0,0 +1,360 @@
+#include "export.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+bool parseExportFormat(std::string const& name, ExportFormat& format) {
+	if (name == "text") {
+		format = ExportFormat::TEXT;
+	}
+	else if (name == "csv") {
+		format = ExportFormat::CSV;
+	}
+	else if (name == "jsonl") {
+		format = ExportFormat::JSONL;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+//appends into a buffer the caller has already sized
+class BlockWriter {
+public:
+	BlockWriter(char* out) : begin(out), p(out) {}
+
+	template<std::size_t N>
+	BlockWriter& operator<<(const char (&literal)[N]) {
+		memcpy(p, literal, N - 1);
+		p += N - 1;
+		return *this;
+	}
+
+	BlockWriter& operator<<(unsigned value) {
+		p = std::to_chars(p, p + 10, value).ptr;
+		return *this;
+	}
+
+	BlockWriter& operator<<(long long value) {
+		p = std::to_chars(p, p + 20, value).ptr;
+		return *this;
+	}
+
+	std::size_t Length() const { return p - begin; }
+
+private:
+	char* begin;
+	char* p;
+};
+
+static std::size_t formatText(char* out, Block const& block) {
+	BlockWriter w(out);
+	w << block.index << " (#" << block.prevHash << "): ";
+
+	Transfer const& transfer = block.transaction.transfer;
+	Receipt const& receipt = block.transaction.receipt;
+
+	switch (block.transaction.type) {
+		case TransactionType::INVALID:
+			w << "INVALID\n";
+		break;
+
+		case TransactionType::GENERATE:
+			w << "GENERATE " << transfer.receiverAccount << " received " << transfer.amount << "\n";
+		break;
+
+		case TransactionType::TRANSFER:
+			w << "TRANSFER " << transfer.senderAccount << " sent " << transfer.amount << " to " << transfer.receiverAccount << "\n";
+		break;
+
+		case TransactionType::RECEIPT:
+			w << "RECEIPT " << receipt.account << " now has " << receipt.balance << "\n";
+		break;
+
+		default:
+			w << "error\n";
+		break;
+	}
+	return w.Length();
+}
+
+static std::size_t formatCsv(char* out, Block const& block) {
+	BlockWriter w(out);
+	w << block.index << "," << block.prevHash << "," << block.nonce << "," << block.threshold << ","
+		<< static_cast<long long>(block.timestamp.count()) << ",";
+
+	Transfer const& transfer = block.transaction.transfer;
+	Receipt const& receipt = block.transaction.receipt;
+
+	switch (block.transaction.type) {
+		case TransactionType::GENERATE:
+			w << "GENERATE," << transfer.senderAccount << "," << transfer.receiverAccount << ",," << transfer.prevReceipt << ",," << transfer.amount << ",\n";
+		break;
+
+		case TransactionType::TRANSFER:
+			w << "TRANSFER," << transfer.senderAccount << "," << transfer.receiverAccount << ",," << transfer.prevReceipt << ",," << transfer.amount << ",\n";
+		break;
+
+		case TransactionType::RECEIPT:
+			w << "RECEIPT,,," << receipt.account << "," << receipt.prevReceipt << "," << receipt.prevTransfer << ",," << receipt.balance << "\n";
+		break;
+
+		default:
+			w << "INVALID,,,,,,,\n";
+		break;
+	}
+	return w.Length();
+}
+
+static std::size_t formatJsonl(char* out, Block const& block) {
+	BlockWriter w(out);
+	w << "{\"index\":" << block.index << ",\"prevHash\":" << block.prevHash << ",\"nonce\":" << block.nonce
+		<< ",\"threshold\":" << block.threshold << ",\"timestamp\":" << static_cast<long long>(block.timestamp.count());
+
+	Transfer const& transfer = block.transaction.transfer;
+	Receipt const& receipt = block.transaction.receipt;
+
+	switch (block.transaction.type) {
+		case TransactionType::GENERATE:
+			w << ",\"type\":\"GENERATE\",\"receiver\":" << transfer.receiverAccount << ",\"prevReceipt\":" << transfer.prevReceipt
+				<< ",\"amount\":" << transfer.amount << "}\n";
+		break;
+
+		case TransactionType::TRANSFER:
+			w << ",\"type\":\"TRANSFER\",\"sender\":" << transfer.senderAccount << ",\"receiver\":" << transfer.receiverAccount
+				<< ",\"prevReceipt\":" << transfer.prevReceipt << ",\"amount\":" << transfer.amount << "}\n";
+		break;
+
+		case TransactionType::RECEIPT:
+			w << ",\"type\":\"RECEIPT\",\"account\":" << receipt.account << ",\"prevReceipt\":" << receipt.prevReceipt
+				<< ",\"prevTransfer\":" << receipt.prevTransfer << ",\"balance\":" << receipt.balance << "}\n";
+		break;
+
+		default:
+			w << ",\"type\":\"INVALID\"}\n";
+		break;
+	}
+	return w.Length();
+}
+
+std::size_t formatBlock(char* out, Block const& block, ExportFormat format) {
+	switch (format) {
+		case ExportFormat::TEXT: return formatText(out, block);
+		case ExportFormat::CSV: return formatCsv(out, block);
+		case ExportFormat::JSONL: return formatJsonl(out, block);
+	}
+	return 0;
+}
+
+std::string exportHeader(ExportFormat format) {
+	if (format == ExportFormat::CSV) {
+		return "index,prev_hash,nonce,threshold,timestamp_ns,type,sender,receiver,account,prev_receipt,prev_transfer,amount,balance\n";
+	}
+	return "";
+}
+
+static bool writeAll(int fd, const char* data, std::size_t length) {
+	while (length > 0) {
+		ssize_t written = write(fd, data, length);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		data += written;
+		length -= written;
+	}
+	return true;
+}
+
+//blocks per chunk; a chunk is formatted by one thread into one buffer and written with one call
+constexpr std::size_t exportChunkBlocks = 1 << 14;
+
+//the longest line each format can produce, every number at its widest
+static std::size_t maxFormattedLength(ExportFormat format) {
+	switch (format) {
+		case ExportFormat::TEXT: return 96;
+		case ExportFormat::CSV: return 192;
+		case ExportFormat::JSONL: return maxFormattedBlock;
+	}
+	return maxFormattedBlock;
+}
+
+bool exportChain(std::vector<Block> const& chain, ExportFormat format, int fd, unsigned threads) {
+	std::string header = exportHeader(format);
+	if (!writeAll(fd, header.data(), header.size())) {
+		return false;
+	}
+
+	const std::size_t chunks = (chain.size() + exportChunkBlocks - 1) / exportChunkBlocks;
+	if (chunks == 0) {
+		return true;
+	}
+
+	//past a handful of threads the writes are the bottleneck, and every thread costs two chunk buffers
+	threads = threads ? threads : std::min(8u, std::max(1u, std::thread::hardware_concurrency()));
+	threads = static_cast<unsigned>(std::min<std::size_t>(threads, chunks));
+
+	//chunk c is formatted into slot c % slots; a slot is reused once the writer is done with it,
+	//so formatting runs up to one slot per thread ahead of the writes
+	struct Slot {
+		std::unique_ptr<char[]> buffer;
+		std::size_t length = 0;
+		std::size_t chunk = SIZE_MAX; //the chunk ready in this slot
+	};
+
+	const std::size_t slotCount = 2 * threads;
+	std::unique_ptr<Slot[]> slots(new Slot[slotCount]);
+	for (std::size_t i = 0; i < slotCount; i++) {
+		slots[i].buffer.reset(new char[exportChunkBlocks * maxFormattedLength(format)]);
+	}
+
+	std::mutex mutex;
+	std::condition_variable ready;
+	std::condition_variable freed;
+	std::size_t written = 0;
+	std::atomic<std::size_t> nextChunk(0);
+	std::atomic<bool> failed(false);
+
+	std::vector<std::thread> workers;
+	for (unsigned t = 0; t < threads; t++) {
+		workers.emplace_back([&] {
+			for (;;) {
+				std::size_t chunk = nextChunk.fetch_add(1);
+				if (chunk >= chunks) {
+					return;
+				}
+
+				Slot& slot = slots[chunk % slotCount];
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					freed.wait(lock, [&] { return chunk < written + slotCount || failed.load(); });
+				}
+				if (failed.load()) {
+					return;
+				}
+
+				char* p = slot.buffer.get();
+				std::size_t end = std::min(chain.size(), (chunk + 1) * exportChunkBlocks);
+				for (std::size_t i = chunk * exportChunkBlocks; i < end; i++) {
+					p += formatBlock(p, chain[i], format);
+				}
+
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					slot.length = p - slot.buffer.get();
+					slot.chunk = chunk;
+				}
+				ready.notify_all();
+			}
+		});
+	}
+
+	//write the chunks in order as they become ready
+	for (std::size_t chunk = 0; chunk < chunks && !failed.load(); chunk++) {
+		Slot& slot = slots[chunk % slotCount];
+		std::size_t length;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			ready.wait(lock, [&] { return slot.chunk == chunk; });
+			length = slot.length;
+		}
+
+		if (!writeAll(fd, slot.buffer.get(), length)) {
+			failed.store(true);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			written++;
+		}
+		freed.notify_all();
+	}
+
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+	return !failed.load();
+}
+
+bool exportChain(std::vector<Block> const& chain, ExportFormat format, std::string const& fname, unsigned threads) {
+	int fd = open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return false;
+	}
+
+	bool ok = exportChain(chain, format, fd, threads);
+	return close(fd) == 0 && ok;
+}
+
+int exportMain(int argc, char* argv[]) {
+	const char* inFile = nullptr;
+	const char* outFile = nullptr;
+	ExportFormat format = ExportFormat::TEXT;
+	unsigned threads = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--in") && i + 1 < argc) {
+			inFile = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+			outFile = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--format") && i + 1 < argc && parseExportFormat(argv[i + 1], format)) {
+			i++;
+		}
+		else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+			threads = strtoul(argv[++i], nullptr, 0);
+		}
+		else {
+			inFile = nullptr;
+			break;
+		}
+	}
+
+	if (!inFile) {
+		std::cerr << "usage: sixpence export --in chain.bin [--format text|csv|jsonl] [--out file] [--threads N]" << std::endl;
+		return 1;
+	}
+
+	//raw Block structs, as written by "sixpence generate --out"
+	FILE* fp = fopen(inFile, "rb");
+	if (!fp) {
+		std::cerr << "failed to open " << inFile << std::endl;
+		return 1;
+	}
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	std::vector<Block> chain(size > 0 ? size / sizeof(Block) : 0);
+	if (fread(chain.data(), sizeof(Block), chain.size(), fp) != chain.size()) {
+		std::cerr << "failed to read " << inFile << std::endl;
+		fclose(fp);
+		return 1;
+	}
+	fclose(fp);
+
+	bool ok = outFile ? exportChain(chain, format, std::string(outFile), threads) : exportChain(chain, format, STDOUT_FILENO, threads);
+	if (!ok) {
+		std::cerr << "failed to write " << (outFile ? outFile : "stdout") << ": " << strerror(errno) << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "ledger.hpp"
+
+//dumping chains quickly
+//blocks are formatted with std::to_chars into large per-chunk buffers, chunks are formatted in
+//parallel and written in order, so a dump is a handful of big write() calls
+
+enum class ExportFormat {
+	TEXT, //the printBlock format
+	CSV, //one header line, then one row per block
+	JSONL, //one JSON object per line
+};
+
+//"text", "csv" or "jsonl"
+bool parseExportFormat(std::string const& name, ExportFormat& format);
+
+//no formatted block is longer than this
+constexpr std::size_t maxFormattedBlock = 256;
+
+//format one block (with its trailing newline) into out, which must hold maxFormattedBlock bytes
+//returns the number of bytes written
+std::size_t formatBlock(char* out, Block const& block, ExportFormat format);
+
+//the CSV header line, empty for the other formats
+std::string exportHeader(ExportFormat format);
+
+//write the whole chain to a file descriptor, threads = 0 picks a count from the cores available
+bool exportChain(std::vector<Block> const& chain, ExportFormat format, int fd, unsigned threads = 0);
+bool exportChain(std::vector<Block> const& chain, ExportFormat format, std::string const& fname, unsigned threads = 0);
+
+//"sixpence export --in chain.bin [--format text|csv|jsonl] [--out file] [--threads N]"
+int exportMain(int argc, char* argv[]);
@@ -0,0 +1,69 @@
+#include "fast_clock.hpp"
+
+#include <cstdlib>
+
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+TscClock::Calibration TscClock::calibration;
+
+static bool invariantTsc() {
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned eax, ebx, ecx, edx;
+	if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007) {
+		return false;
+	}
+	__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+	return (edx & (1 << 8)) != 0;
+#else
+	return false;
+#endif
+}
+
+struct TscCalibrator {
+	TscCalibrator() {
+		if (!invariantTsc() || std::getenv("SIXPENCE_NO_TSC")) {
+			return;
+		}
+
+#if defined(__x86_64__) || defined(__i386__)
+		typedef std::chrono::steady_clock Steady;
+
+		//bracket each counter read with steady_clock reads, and spin long enough for the error to be tiny
+		Steady::time_point steadyStart = Steady::now();
+		std::uint64_t tscStart = __rdtsc();
+		Steady::time_point steadyEnd;
+		std::uint64_t tscEnd;
+		do {
+			steadyEnd = Steady::now();
+			tscEnd = __rdtsc();
+		} while (steadyEnd - steadyStart < std::chrono::milliseconds(20));
+
+		std::uint64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(steadyEnd - steadyStart).count();
+		std::uint64_t ticks = tscEnd - tscStart;
+		if (ticks == 0) {
+			return;
+		}
+
+		TscClock::calibration.multiplier = static_cast<std::uint64_t>((static_cast<unsigned __int128>(nanoseconds) << 32) / ticks);
+		TscClock::calibration.baseTicks = tscEnd;
+		TscClock::calibration.baseNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(steadyEnd.time_since_epoch()).count();
+		TscClock::calibration.useTsc = true;
+#endif
+	}
+};
+
+static TscCalibrator calibrator;
+
+CoarseClock::time_point CoarseClock::now() noexcept {
+	timespec ts;
+#ifdef CLOCK_REALTIME_COARSE
+	clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+#else
+	clock_gettime(CLOCK_REALTIME, &ts);
+#endif
+	return time_point(duration(std::int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec));
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+//steady clock read from the time stamp counter, calibrated against std::chrono::steady_clock at startup
+//falls back to steady_clock when the TSC is missing or not invariant (or SIXPENCE_NO_TSC is set)
+class TscClock {
+public:
+	typedef std::chrono::nanoseconds duration;
+	typedef duration::rep rep;
+	typedef duration::period period;
+	typedef std::chrono::time_point<TscClock> time_point;
+	static constexpr bool is_steady = true;
+
+	static time_point now() noexcept {
+		return time_point(duration(ToNanoseconds(Ticks())));
+	}
+
+	//raw counter, cheaper than now() when only differences are needed
+	static std::uint64_t Ticks() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+		if (calibration.useTsc) {
+			return __rdtsc();
+		}
+#endif
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	//ticks since the steady_clock epoch, in nanoseconds
+	static std::uint64_t ToNanoseconds(std::uint64_t ticks) noexcept {
+		return calibration.baseNanoseconds + ElapsedNanoseconds(ticks - calibration.baseTicks);
+	}
+
+	//a difference of two Ticks() values, in nanoseconds
+	static std::uint64_t ElapsedNanoseconds(std::uint64_t ticks) noexcept {
+		return static_cast<std::uint64_t>((static_cast<unsigned __int128>(ticks) * calibration.multiplier) >> 32);
+	}
+
+	static bool UsingTsc() noexcept {
+		return calibration.useTsc;
+	}
+
+	static double TicksPerNanosecond() noexcept {
+		return 4294967296.0 / calibration.multiplier;
+	}
+
+private:
+	//constant-initialized to the fallback, so reads before calibration still work
+	struct Calibration {
+		bool useTsc = false;
+		std::uint64_t multiplier = std::uint64_t(1) << 32; //nanoseconds per tick, 32.32 fixed point
+		std::uint64_t baseTicks = 0;
+		std::uint64_t baseNanoseconds = 0;
+	};
+
+	static Calibration calibration;
+
+	friend struct TscCalibrator;
+};
+
+//CLOCK_REALTIME_COARSE: wall time at scheduler tick resolution (~1-4ms), without reading the hardware clock
+class CoarseClock {
+public:
+	typedef std::chrono::nanoseconds duration;
+	typedef duration::rep rep;
+	typedef duration::period period;
+	typedef std::chrono::time_point<CoarseClock> time_point;
+	static constexpr bool is_steady = false;
+
+	static time_point now() noexcept;
+};
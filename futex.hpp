@@ -0,0 +1,35 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+//shared (not private) futexes, so waiters and wakers can be in different processes
+inline void futexWake(std::atomic<std::uint32_t>* word) {
+	syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+//returns at once unless word still holds expected
+inline void futexWait(std::atomic<std::uint32_t>* word, std::uint32_t expected, std::chrono::milliseconds timeout) {
+	timespec ts;
+	ts.tv_sec = timeout.count() / 1000;
+	ts.tv_nsec = (timeout.count() % 1000) * 1000000;
+	syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+}
+
+//in spin loops, so a spinning core leaves its sibling hyperthread alone
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+	_mm_pause();
+#endif
+}
@@ -0,0 +1,290 @@
+#include "generator.hpp"
+
+#include "fast_clock.hpp"
+#include "random.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+//one random transfer request, before the ledger has decided whether it is valid
+struct PlannedOperation {
+	unsigned sender; //0 mints
+	unsigned receiver;
+	unsigned amount;
+};
+
+//operations are sampled in fixed-size chunks, each seeded by its position, so the chain
+//depends only on the seed and never on the thread count
+constexpr std::size_t chunkSize = 1 << 16;
+constexpr std::size_t batchChunks = 16;
+
+static void sampleChunk(GeneratorOptions const& options, ZipfSampler const& zipf, std::uint64_t chunk, PlannedOperation* out) {
+	std::uint64_t state = options.seed * 0x2545f4914f6cdd1dULL + chunk;
+
+	for (std::size_t i = 0; i < chunkSize; i++) {
+		PlannedOperation& op = out[i];
+		op.sender = uniform(state) < options.generateFraction ? 0 : zipf.Sample(state);
+		do {
+			op.receiver = zipf.Sample(state);
+		} while (op.receiver == op.sender && options.accounts > 1);
+		op.amount = exponentialAmount(state, options.meanAmount);
+	}
+}
+
+//hashBlock's order, raising the threshold after a full loop of nonces, so the chain is the one it would mine
+static unsigned mine(Block& block, unsigned threshold, std::uint64_t& hashes) {
+	block.nonce = 1;
+	block.threshold = threshold;
+
+	for (;;) {
+		unsigned first = block.nonce;
+		unsigned hash = searchNonces(block, UINT_MAX, block.threshold);
+		hashes += block.nonce - std::uint64_t(first) + 1;
+		if (hash <= block.threshold) {
+			return hash;
+		}
+		block.nonce = 0;
+		block.threshold++;
+	}
+}
+
+GeneratorStats generateChain(GeneratorOptions const& options, std::vector<Block>& chain) {
+	GeneratorStats stats;
+
+	const unsigned threadCount = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+	const std::uint64_t target = chain.size() + options.blocks;
+	const ZipfSampler zipf(options.accounts, options.zipfExponent);
+
+	//the linker reads blocks while they are appended, so the storage must never move
+	chain.reserve(target + 3);
+	Block* blocks = chain.data();
+
+	//ledger state, indexed by account
+	std::vector<unsigned> balances(options.accounts + 1, 0);
+	std::vector<unsigned> lastReceipts(options.accounts + 1, unsigned(-1));
+
+	unsigned nextIndex = chain.empty() ? 0 : chain.back().index + 1;
+	for (Block const& block : chain) {
+		if (block.transaction.type == TransactionType::RECEIPT && block.transaction.receipt.account <= options.accounts) {
+			balances[block.transaction.receipt.account] = block.transaction.receipt.balance;
+			lastReceipts[block.transaction.receipt.account] = block.index;
+		}
+	}
+
+	//synthetic timestamps, one millisecond apart and ending now
+	Clock::duration timestamp = Clock::now().time_since_epoch() - std::chrono::milliseconds(options.blocks);
+
+	auto append = [&](Transaction const& transaction, unsigned index) {
+		Block block = {};
+		block.index = index;
+		block.timestamp = timestamp += std::chrono::milliseconds(1);
+		block.transaction = transaction;
+		chain.push_back(block);
+	};
+
+	if (chain.empty()) {
+		append(generateBlank("sixpence synth!!"), nextIndex++);
+		chain.back().prevHash = 42;
+	}
+
+	//stage 3: link and mine every block as soon as it has been appended
+	std::atomic<std::uint64_t> appended(chain.size());
+	std::atomic<bool> finished(false);
+	std::uint64_t hashes = 0;
+
+	std::size_t firstUnlinked = chain.size() - 1;
+
+	std::thread linker([&] {
+		std::size_t position = firstUnlinked;
+		unsigned hash = 0;
+		bool haveHash = false;
+
+		for (;;) {
+			bool done = finished.load(std::memory_order_acquire);
+			std::uint64_t available = appended.load(std::memory_order_acquire);
+
+			for (; position < available; position++) {
+				if (haveHash) {
+					blocks[position].prevHash = hash;
+				}
+				hash = mine(blocks[position], options.threshold, hashes);
+				haveHash = true;
+			}
+
+			if (done && position >= appended.load(std::memory_order_acquire)) {
+				break;
+			}
+			std::this_thread::yield();
+		}
+	});
+
+	//stage 1 runs a batch ahead of stage 2
+	std::unique_ptr<PlannedOperation[]> current(new PlannedOperation[chunkSize * batchChunks]);
+	std::unique_ptr<PlannedOperation[]> next(new PlannedOperation[chunkSize * batchChunks]);
+
+	auto sampleBatch = [&](std::uint64_t batch, PlannedOperation* out) {
+		std::vector<std::thread> samplers;
+		for (unsigned t = 0; t < threadCount; t++) {
+			samplers.emplace_back([&, t] {
+				for (std::size_t c = t; c < batchChunks; c += threadCount) {
+					sampleChunk(options, zipf, batch * batchChunks + c, out + c * chunkSize);
+				}
+			});
+		}
+		for (std::thread& sampler : samplers) {
+			sampler.join();
+		}
+	};
+
+	sampleBatch(0, current.get());
+
+	//stage 2: apply each operation exactly as sendAmount would
+	for (std::uint64_t batch = 0; chain.size() < target; batch++) {
+		std::thread prefetch([&] { sampleBatch(batch + 1, next.get()); });
+
+		for (std::size_t i = 0; i < chunkSize * batchChunks && chain.size() < target; i++) {
+			PlannedOperation const& op = current[i];
+			Transaction transaction;
+
+			//sendAmount turns these away before taking an index, only possible with a single account
+			if (op.sender == op.receiver) {
+				stats.rejected++;
+				continue;
+			}
+			if (op.sender != 0 && balances[op.sender] < op.amount) {
+				nextIndex++; //the rejected transfer block still took an index
+				stats.rejected++;
+				continue;
+			}
+
+			//the transfer
+			unsigned transferIndex = nextIndex++;
+			transaction.transfer = {
+				op.sender == 0 ? TransactionType::GENERATE : TransactionType::TRANSFER,
+				op.sender,
+				op.receiver,
+				op.sender == 0 ? unsigned(-1) : lastReceipts[op.sender],
+				op.amount
+			};
+			append(transaction, transferIndex);
+
+			//the receiver's receipt
+			unsigned receiptIndex = nextIndex++;
+			transaction.receipt = { TransactionType::RECEIPT, op.receiver, lastReceipts[op.receiver], transferIndex, balances[op.receiver] + op.amount };
+			append(transaction, receiptIndex);
+			balances[op.receiver] += op.amount;
+			lastReceipts[op.receiver] = receiptIndex;
+
+			//the sender's change; GENERATE returns are built but never appended
+			unsigned returnIndex = nextIndex++;
+			if (op.sender == 0) {
+				stats.generates++;
+			}
+			else {
+				//prevReceipt holds the sender's account here, just as generateReturn writes it
+				transaction.receipt = { TransactionType::RECEIPT, op.sender, op.sender, receiptIndex, balances[op.sender] - op.amount };
+				append(transaction, returnIndex);
+				balances[op.sender] -= op.amount;
+				lastReceipts[op.sender] = returnIndex;
+				stats.transfers++;
+			}
+
+			appended.store(chain.size(), std::memory_order_release);
+		}
+
+		prefetch.join();
+		std::swap(current, next);
+	}
+
+	finished.store(true, std::memory_order_release);
+	linker.join();
+
+	setNextBlockIndex(nextIndex);
+	stats.hashes = hashes;
+	return stats;
+}
+
+int generatorMain(int argc, char* argv[]) {
+	GeneratorOptions options;
+	const char* outFile = nullptr;
+	bool verify = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--blocks") && i + 1 < argc) {
+			options.blocks = strtoull(argv[++i], nullptr, 0);
+		}
+		else if (!strcmp(argv[i], "--accounts") && i + 1 < argc) {
+			options.accounts = std::max(1ul, strtoul(argv[++i], nullptr, 0));
+		}
+		else if (!strcmp(argv[i], "--zipf") && i + 1 < argc) {
+			options.zipfExponent = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "--mean-amount") && i + 1 < argc) {
+			options.meanAmount = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "--generate-fraction") && i + 1 < argc) {
+			options.generateFraction = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+			options.threads = strtoul(argv[++i], nullptr, 0);
+		}
+		else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+			options.seed = strtoull(argv[++i], nullptr, 0);
+		}
+		else if (!strcmp(argv[i], "--threshold") && i + 1 < argc) {
+			options.threshold = strtoul(argv[++i], nullptr, 0);
+		}
+		else if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+			outFile = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--verify")) {
+			verify = true;
+		}
+		else {
+			std::cerr << "usage: sixpence generate [--blocks N] [--accounts N] [--zipf s] [--mean-amount N] [--generate-fraction f]"
+				" [--threads N] [--seed N] [--threshold N] [--out chain.bin] [--verify]" << std::endl;
+			return 1;
+		}
+	}
+
+	resetLedger();
+
+	std::uint64_t start = TscClock::Ticks();
+	GeneratorStats stats = generateChain(options, blockVector);
+	double seconds = TscClock::ElapsedNanoseconds(TscClock::Ticks() - start) / 1e9;
+
+	std::cout << blockVector.size() << " blocks in " << seconds << "s (" << blockVector.size() / seconds << " blocks/s): "
+		<< stats.generates << " generates, " << stats.transfers << " transfers, " << stats.rejected << " rejected, "
+		<< stats.hashes << " hashes" << std::endl;
+
+	if (verify) {
+		std::size_t bad = verifyChain(blockVector);
+		if (bad != blockVector.size()) {
+			std::cerr << "verification failed at block " << bad << std::endl;
+			return 1;
+		}
+		std::cout << "chain verified" << std::endl;
+	}
+
+	//raw Block structs, in chain order
+	if (outFile) {
+		FILE* fp = fopen(outFile, "wb");
+		if (!fp || fwrite(blockVector.data(), sizeof(Block), blockVector.size(), fp) != blockVector.size()) {
+			std::cerr << "failed to write " << outFile << std::endl;
+			if (fp) {
+				fclose(fp);
+			}
+			return 1;
+		}
+		fclose(fp);
+	}
+
+	return 0;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <climits>
+#include <cstdint>
+#include <vector>
+
+#include "ledger.hpp"
+
+//builds large, realistic chains quickly for scale testing
+//the blocks are exactly what sendAmount would have produced for the same sequence of transfers
+//(including index gaps for rejected transfers and discarded returns), but mining uses a trivial threshold
+
+struct GeneratorOptions {
+	std::uint64_t blocks = 1000000;
+	unsigned accounts = 10000;
+	double zipfExponent = 1.1; //activity skew, 0 is uniform
+	double meanAmount = 50; //transfer sizes are exponentially distributed around this
+	double generateFraction = 0.1; //share of operations that mint new coins
+	unsigned threads = 0; //0 uses every core
+	std::uint64_t seed = 1;
+	unsigned threshold = UINT_MAX; //UINT_MAX accepts the first nonce, i.e. trusted mode
+};
+
+struct GeneratorStats {
+	std::uint64_t generates = 0;
+	std::uint64_t transfers = 0;
+	std::uint64_t rejected = 0; //sender couldn't cover the amount, sendAmount would return -2
+	std::uint64_t hashes = 0;
+};
+
+//append options.blocks blocks to chain, which must be empty or end in a mined block
+GeneratorStats generateChain(GeneratorOptions const& options, std::vector<Block>& chain);
+
+//"sixpence generate ...", fills blockVector and optionally writes the raw blocks to a file
+int generatorMain(int argc, char* argv[]);
@@ -0,0 +1,166 @@
+#include "histogram.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+std::atomic<bool> LatencyTimer::latencyEnabled(false);
+
+LatencyHistogram::LatencyHistogram(std::string const& name) :
+	name(name)
+{
+	Reset();
+}
+
+int LatencyHistogram::BucketIndex(std::uint64_t value) {
+	//the first two groups hold small values exactly
+	if (value < (std::uint64_t(2) << subBucketBits)) {
+		return static_cast<int>(value);
+	}
+
+	int exponent = 63 - __builtin_clzll(value);
+	int shift = exponent - subBucketBits;
+	return ((shift + 1) << subBucketBits) + static_cast<int>((value >> shift) - subBucketCount);
+}
+
+std::uint64_t LatencyHistogram::BucketLowest(int index) {
+	int group = index >> subBucketBits;
+	std::uint64_t sub = index & (subBucketCount - 1);
+	if (group == 0) {
+		return sub;
+	}
+	return (sub + subBucketCount) << (group - 1);
+}
+
+std::uint64_t LatencyHistogram::BucketHighest(int index) {
+	int group = index >> subBucketBits;
+	if (group == 0) {
+		return BucketLowest(index);
+	}
+	return BucketLowest(index) + ((std::uint64_t(1) << (group - 1)) - 1);
+}
+
+void LatencyHistogram::Record(std::uint64_t nanoseconds) {
+	buckets[BucketIndex(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+	//min and max rarely change once warm, so the CAS loops almost never run
+	std::uint64_t current = min.load(std::memory_order_relaxed);
+	while (nanoseconds < current && !min.compare_exchange_weak(current, nanoseconds, std::memory_order_relaxed));
+
+	current = max.load(std::memory_order_relaxed);
+	while (nanoseconds > current && !max.compare_exchange_weak(current, nanoseconds, std::memory_order_relaxed));
+}
+
+void LatencyHistogram::Merge(LatencyHistogram const& other) {
+	for (int i = 0; i < bucketCount; i++) {
+		std::uint64_t n = other.buckets[i].load(std::memory_order_relaxed);
+		if (n) {
+			buckets[i].fetch_add(n, std::memory_order_relaxed);
+		}
+	}
+	count.fetch_add(other.count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	sum.fetch_add(other.sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+	std::uint64_t otherMin = other.min.load(std::memory_order_relaxed);
+	std::uint64_t current = min.load(std::memory_order_relaxed);
+	while (otherMin < current && !min.compare_exchange_weak(current, otherMin, std::memory_order_relaxed));
+
+	std::uint64_t otherMax = other.max.load(std::memory_order_relaxed);
+	current = max.load(std::memory_order_relaxed);
+	while (otherMax > current && !max.compare_exchange_weak(current, otherMax, std::memory_order_relaxed));
+}
+
+void LatencyHistogram::Reset() {
+	for (auto& bucket : buckets) {
+		bucket.store(0, std::memory_order_relaxed);
+	}
+	count.store(0, std::memory_order_relaxed);
+	sum.store(0, std::memory_order_relaxed);
+	min.store(UINT64_MAX, std::memory_order_relaxed);
+	max.store(0, std::memory_order_relaxed);
+}
+
+std::uint64_t LatencyHistogram::Count() const {
+	return count.load(std::memory_order_relaxed);
+}
+
+std::uint64_t LatencyHistogram::Min() const {
+	return Count() ? min.load(std::memory_order_relaxed) : 0;
+}
+
+std::uint64_t LatencyHistogram::Max() const {
+	return max.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::Mean() const {
+	std::uint64_t n = Count();
+	return n ? static_cast<double>(sum.load(std::memory_order_relaxed)) / n : 0.0;
+}
+
+std::uint64_t LatencyHistogram::Percentile(double fraction) const {
+	//count the buckets rather than trusting count, which may lag behind under concurrent recording
+	std::uint64_t total = 0;
+	for (auto const& bucket : buckets) {
+		total += bucket.load(std::memory_order_relaxed);
+	}
+	if (total == 0) {
+		return 0;
+	}
+
+	std::uint64_t target = static_cast<std::uint64_t>(fraction * total + 0.5);
+	if (target < 1) {
+		target = 1;
+	}
+
+	std::uint64_t seen = 0;
+	for (int i = 0; i < bucketCount; i++) {
+		seen += buckets[i].load(std::memory_order_relaxed);
+		if (seen >= target) {
+			//never report past the largest value actually recorded
+			return std::min(BucketHighest(i), Max());
+		}
+	}
+	return Max();
+}
+
+void LatencyHistogram::WriteText(std::ostream& os) const {
+	std::streamsize precision = os.precision();
+	os << std::left << std::setw(24) << name << std::right
+		<< " count " << std::setw(10) << Count()
+		<< " min " << std::setw(10) << Min()
+		<< " p50 " << std::setw(10) << Percentile(0.50)
+		<< " p99 " << std::setw(10) << Percentile(0.99)
+		<< " p99.9 " << std::setw(10) << Percentile(0.999)
+		<< " max " << std::setw(10) << Max()
+		<< " mean " << std::setw(12) << std::fixed << std::setprecision(1) << Mean() << std::defaultfloat
+		<< " (ns)\n";
+	os.precision(precision);
+}
+
+void LatencyHistogram::WriteJson(std::ostream& os) const {
+	std::streamsize precision = os.precision();
+	os << "{\"name\":\"" << name << "\""
+		<< ",\"count\":" << Count()
+		<< ",\"min\":" << Min()
+		<< ",\"max\":" << Max()
+		<< ",\"mean\":" << std::fixed << std::setprecision(1) << Mean() << std::defaultfloat
+		<< ",\"p50\":" << Percentile(0.50)
+		<< ",\"p90\":" << Percentile(0.90)
+		<< ",\"p99\":" << Percentile(0.99)
+		<< ",\"p999\":" << Percentile(0.999)
+		<< ",\"buckets\":[";
+	os.precision(precision);
+
+	//sparse [lowest, highest, count] triples, enough to rebuild the histogram elsewhere
+	bool first = true;
+	for (int i = 0; i < bucketCount; i++) {
+		std::uint64_t n = buckets[i].load(std::memory_order_relaxed);
+		if (n) {
+			os << (first ? "" : ",") << '[' << BucketLowest(i) << ',' << BucketHighest(i) << ',' << n << ']';
+			first = false;
+		}
+	}
+	os << "]}";
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+#include "fast_clock.hpp"
+
+//log-linear latency histogram in the style of HdrHistogram
+//each power of two is split into 2^subBucketBits buckets, so any recorded value is
+//reported within 1 / 2^subBucketBits (about 1.6%) of its true value
+//recording is a few relaxed atomic adds, so one histogram can be shared by many threads,
+//or each thread can keep its own and Merge() them when reporting
+class LatencyHistogram {
+public:
+	static constexpr int subBucketBits = 6;
+	static constexpr int subBucketCount = 1 << subBucketBits;
+	static constexpr int bucketCount = (64 - subBucketBits + 1) << subBucketBits;
+
+	LatencyHistogram(std::string const& name);
+
+	LatencyHistogram(LatencyHistogram const&) = delete;
+	LatencyHistogram& operator=(LatencyHistogram const&) = delete;
+
+	void Record(std::uint64_t nanoseconds);
+	void Merge(LatencyHistogram const& other);
+	void Reset();
+
+	std::uint64_t Count() const;
+	std::uint64_t Min() const;
+	std::uint64_t Max() const;
+	double Mean() const;
+
+	//the value at or below which the given fraction of samples fall (0.99 for p99)
+	std::uint64_t Percentile(double fraction) const;
+
+	void WriteText(std::ostream& os) const;
+	void WriteJson(std::ostream& os) const;
+
+	std::string const& GetName() const { return name; }
+
+	static int BucketIndex(std::uint64_t value);
+	static std::uint64_t BucketLowest(int index);
+	static std::uint64_t BucketHighest(int index);
+
+private:
+	std::string name;
+	std::atomic<std::uint64_t> buckets[bucketCount];
+	std::atomic<std::uint64_t> count;
+	std::atomic<std::uint64_t> sum;
+	std::atomic<std::uint64_t> min;
+	std::atomic<std::uint64_t> max;
+};
+
+//records the lifetime of a scope into a histogram, when latency recording is enabled
+class LatencyTimer {
+public:
+	LatencyTimer(LatencyHistogram& histogram) : histogram(histogram) {
+		if (latencyEnabled.load(std::memory_order_relaxed)) {
+			startTicks = TscClock::Ticks();
+		}
+	}
+
+	~LatencyTimer() {
+		if (startTicks) {
+			histogram.Record(TscClock::ElapsedNanoseconds(TscClock::Ticks() - startTicks));
+		}
+	}
+
+	LatencyTimer(LatencyTimer const&) = delete;
+	LatencyTimer& operator=(LatencyTimer const&) = delete;
+
+	static std::atomic<bool> latencyEnabled;
+
+private:
+	LatencyHistogram& histogram;
+	std::uint64_t startTicks = 0;
+};
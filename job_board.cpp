@@ -0,0 +1,422 @@
+#include "job_board.hpp"
+
+#include "futex.hpp"
+#include "mining_pool.hpp"
+#include "process.hpp"
+#include "spec_options.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static const char magic[8] = { 'S', 'P', 'X', 'J', 'O', 'B', '1', '\n' };
+
+static std::int64_t nanosecondsNow() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+JobBoard::JobBoard(JobBoardOptions const& options) : options(options) {
+	//EMPTY
+}
+
+JobBoard::~JobBoard() {
+	if (header) {
+		header->closed.store(1);
+		futexWake(&header->sequence);
+		munmap(header, sizeof(JobBoardHeader));
+	}
+	if (fd >= 0) {
+		close(fd);
+		unlink(options.path.c_str());
+	}
+}
+
+bool JobBoard::Create(std::string& error) {
+	options.rangeBits = std::min(std::max(options.rangeBits, 1u), 32u);
+
+	//with one core, spinning only keeps the process being waited for off it
+	if (std::thread::hardware_concurrency() < 2) {
+		options.spin = 0;
+	}
+
+	fd = open(options.path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0 || ftruncate(fd, sizeof(JobBoardHeader)) != 0) {
+		error = options.path + ": " + strerror(errno);
+		return false;
+	}
+
+	void* base = mmap(nullptr, sizeof(JobBoardHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (base == MAP_FAILED) {
+		error = std::string("mmap: ") + strerror(errno);
+		return false;
+	}
+
+	//the file starts zeroed, which is every field's starting value
+	header = static_cast<JobBoardHeader*>(base);
+	memcpy(header->magic, magic, sizeof(magic));
+	header->blockSize = sizeof(Block);
+	header->rangeBits = options.rangeBits;
+	return true;
+}
+
+bool JobBoard::WaitForWorkers(std::size_t count, double seconds) {
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+	while (WorkerCount() < count && std::chrono::steady_clock::now() < deadline) {
+		usleep(1000);
+	}
+	return WorkerCount() >= count;
+}
+
+std::size_t JobBoard::WorkerCount() const {
+	std::size_t count = 0;
+	for (JobBoardWorkerSlot const& slot : header->workers) {
+		count += slot.pid.load() != 0;
+	}
+	return count;
+}
+
+std::size_t JobBoard::ReapWorkers() {
+	for (JobBoardWorkerSlot& slot : header->workers) {
+		//a worker we spawned lingers as a zombie until it's waited for
+		std::int32_t pid = slot.pid.load();
+		if (pid != 0 && (waitpid(pid, nullptr, WNOHANG) == pid || (kill(pid, 0) != 0 && errno == ESRCH))) {
+			slot.pid.compare_exchange_strong(pid, 0);
+		}
+	}
+	return WorkerCount();
+}
+
+std::uint64_t JobBoard::Hashes() const {
+	std::uint64_t hashes = 0;
+	for (JobBoardWorkerSlot const& slot : header->workers) {
+		hashes += slot.hashes.load(std::memory_order_relaxed);
+	}
+	return hashes;
+}
+
+void JobBoard::Post(Block const& block, unsigned threshold) {
+	std::uint32_t writing = header->sequence.load(std::memory_order_relaxed) + 1;
+	header->sequence.store(writing, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	header->block = block;
+	header->block.threshold = threshold;
+	header->postedAt = nanosecondsNow();
+	header->pickedUpAt.store(0, std::memory_order_relaxed);
+	header->claimed.store(writing, std::memory_order_relaxed);
+	header->nextRange.store(std::uint64_t(writing + 1) << 32, std::memory_order_relaxed);
+
+	//pairs with a worker announcing itself in jobWaiters before it sleeps
+	header->sequence.store(writing + 1);
+	if (header->jobWaiters.load() > 0) {
+		futexWake(&header->sequence);
+	}
+}
+
+unsigned JobBoard::Mine(Block& block, unsigned threshold) {
+	//no system calls here, dead workers are only looked for once a job has taken a while
+	bool anyWorker = std::any_of(std::begin(header->workers), std::end(header->workers), [](JobBoardWorkerSlot const& slot) { return slot.pid.load(std::memory_order_relaxed) != 0; });
+	if (!anyWorker) {
+		localBlocks++;
+		blocks++;
+		return hashBlock(block, threshold);
+	}
+
+	Post(block, threshold);
+	std::uint32_t sequence = header->sequence.load(std::memory_order_relaxed);
+
+	for (unsigned attempt = 0;; attempt++) {
+		std::uint32_t found = header->found.load(std::memory_order_acquire);
+		if (found == sequence) {
+			break;
+		}
+		if (attempt < options.spin) {
+			cpuRelax();
+			continue;
+		}
+
+		header->foundWaiters.fetch_add(1);
+		if (header->found.load() == found) {
+			futexWait(&header->found, found, std::chrono::milliseconds(100));
+		}
+		header->foundWaiters.fetch_sub(1);
+
+		//every worker has gone: take the job back; a worker that claimed the solution and died before
+		//writing it up leaves claimed at sequence for good, so it's only needed to keep out workers that
+		//turn up now, and if one has claimed it since, it holds a slot again
+		if (header->found.load() != sequence && ReapWorkers() == 0) {
+			std::uint32_t open = sequence - 1;
+			bool taken = header->claimed.compare_exchange_strong(open, sequence);
+			if (taken || (ReapWorkers() == 0 && header->found.load() != sequence)) {
+				localBlocks++;
+				blocks++;
+				return hashBlock(block, threshold);
+			}
+		}
+	}
+
+	handoffLatency.Record(std::max<std::int64_t>(nanosecondsNow() - header->foundAt, 0));
+	std::int64_t pickedUpAt = header->pickedUpAt.load(std::memory_order_relaxed);
+	if (pickedUpAt > 0) {
+		pickupLatency.Record(std::max<std::int64_t>(pickedUpAt - header->postedAt, 0));
+	}
+
+	//one hash to make sure of another process's answer
+	Block solved = block;
+	solved.nonce = header->nonce;
+	solved.threshold = header->threshold;
+	unsigned hash = fnv_hash_1a_32(&solved, sizeof(Block));
+	if (hash != header->hash || hash > solved.threshold || solved.threshold < threshold) {
+		localBlocks++;
+		blocks++;
+		return hashBlock(block, threshold);
+	}
+
+	blocks++;
+	block.nonce = solved.nonce;
+	block.threshold = solved.threshold;
+	return hash;
+}
+
+void JobBoard::WriteReport(std::ostream& os) const {
+	os << "board: " << blocks << " blocks, " << localBlocks << " mined locally, " << Hashes() << " hashes\n";
+	for (std::size_t i = 0; i < JobBoardHeader::maxWorkers; i++) {
+		JobBoardWorkerSlot const& slot = header->workers[i];
+		if (slot.hashes.load() > 0) {
+			os << "worker " << i + 1 << ": " << slot.hashes.load() << " hashes, " << slot.solutions.load() << " solutions\n";
+		}
+	}
+	pickupLatency.WriteText(os);
+	handoffLatency.WriteText(os);
+}
+
+int boardMain(int argc, char* argv[]) {
+	JobBoardOptions options;
+	options.path = "/dev/shm/sixpence-board-" + std::to_string(getpid());
+	unsigned workerCount = 2;
+	std::uint64_t transfers = 200;
+	unsigned boardThreshold = 1 << 12;
+	unsigned accounts = 50;
+	std::uint64_t seed = 1;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		std::size_t equals = arg.find('=');
+		std::string key = arg.substr(0, equals);
+		std::string value = equals == std::string::npos ? "" : arg.substr(equals + 1);
+
+		bool ok = true;
+		if (equals == std::string::npos) ok = false;
+		else if (key == "workers") ok = parseOptionNumber(value, workerCount) && workerCount <= JobBoardHeader::maxWorkers;
+		else if (key == "transfers") ok = parseOptionNumber(value, transfers);
+		else if (key == "threshold") ok = parseOptionNumber(value, boardThreshold);
+		else if (key == "range_bits") ok = parseOptionNumber(value, options.rangeBits);
+		else if (key == "spin") ok = parseOptionNumber(value, options.spin);
+		else if (key == "path") options.path = value;
+		else if (key == "accounts") ok = parseOptionNumber(value, accounts) && accounts > 0;
+		else if (key == "seed") ok = parseOptionNumber(value, seed);
+		else ok = false;
+
+		if (!ok) {
+			std::cerr << "usage: sixpence board [workers=N] [transfers=N] [threshold=N] [range_bits=N] [spin=N] [path=file] [accounts=N] [seed=N]" << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<pid_t> pids;
+	bool valid;
+	{
+		JobBoard board(options);
+		std::string error;
+		if (!board.Create(error)) {
+			std::cerr << error << std::endl;
+			return 1;
+		}
+
+		for (unsigned i = 0; i < workerCount; i++) {
+			pids.push_back(spawnSelf({ "sixpence", "board-worker", "--board", options.path }));
+		}
+		if (!board.WaitForWorkers(workerCount, 5)) {
+			std::cerr << "only " << board.WorkerCount() << " of " << workerCount << " workers started, carrying on" << std::endl;
+		}
+		std::cout << "board " << options.path << ", " << board.WorkerCount() << " workers, threshold 0x" << std::hex << boardThreshold << std::dec << std::endl;
+
+		MiningRun run = mineTransfers(board, transfers, boardThreshold, accounts, seed, "sixpence board!!");
+		valid = run.valid;
+
+		//rejected transfers mine blocks too, they just never reach the chain
+		std::cout << board.Blocks() << " blocks mined in " << run.seconds << "s (" << board.Blocks() / run.seconds << " blocks/s, "
+			<< board.Hashes() / run.seconds / 1e6 << " Mhash/s across the workers), chain of " << blockVector.size() << " blocks "
+			<< (valid ? "verified" : "FAILED verification") << "\n";
+		board.WriteReport(std::cout);
+		std::cout.flush();
+	}
+
+	//closing the board tells the workers to exit
+	for (pid_t pid : pids) {
+		waitpid(pid, nullptr, 0);
+	}
+	return valid ? 0 : 1;
+}
+
+int boardWorkerMain(int argc, char* argv[]) {
+	std::string path;
+	std::uint32_t chunk = 1 << 15; //nonces between checks for a cancelled job
+	unsigned spin = 1 << 10; //polls before sleeping on the next job
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--board") && i + 1 < argc) {
+			path = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--chunk") && i + 1 < argc) {
+			chunk = std::max(1, atoi(argv[++i]));
+		}
+		else if (!strcmp(argv[i], "--spin") && i + 1 < argc) {
+			spin = std::max(0, atoi(argv[++i]));
+		}
+		else {
+			path.clear();
+			break;
+		}
+	}
+	if (path.empty()) {
+		std::cerr << "usage: sixpence board-worker --board file [--chunk nonces] [--spin N]" << std::endl;
+		return 1;
+	}
+
+	int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+	struct stat info;
+	if (fd < 0 || fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(JobBoardHeader))) {
+		std::cerr << path << ": not a job board" << std::endl;
+		return 1;
+	}
+	void* base = mmap(nullptr, sizeof(JobBoardHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		std::cerr << "mmap: " << strerror(errno) << std::endl;
+		return 1;
+	}
+	JobBoardHeader* header = static_cast<JobBoardHeader*>(base);
+	if (std::thread::hardware_concurrency() < 2) {
+		spin = 0;
+	}
+	if (memcmp(header->magic, magic, sizeof(magic)) != 0 || header->blockSize != sizeof(Block)) {
+		std::cerr << path << ": not a job board" << std::endl;
+		return 1;
+	}
+
+	//a free slot for this worker's counters
+	JobBoardWorkerSlot* slot = nullptr;
+	for (JobBoardWorkerSlot& candidate : header->workers) {
+		std::int32_t free = 0;
+		if (candidate.pid.compare_exchange_strong(free, getpid())) {
+			slot = &candidate;
+			break;
+		}
+	}
+	if (!slot) {
+		std::cerr << path << ": the board is full" << std::endl;
+		return 1;
+	}
+
+	std::uint32_t rangeBits = header->rangeBits;
+	std::uint32_t seen = 0;
+	while (!header->closed.load()) {
+		//wait for a job other than the last one, copying the template out under the seqlock
+		std::uint32_t sequence = 0;
+		Block job;
+		for (unsigned attempt = 0; !header->closed.load(std::memory_order_relaxed); attempt++) {
+			sequence = header->sequence.load(std::memory_order_acquire);
+			if (sequence % 2 == 0 && sequence != seen) {
+				job = header->block;
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (header->sequence.load(std::memory_order_relaxed) == sequence) {
+					break;
+				}
+				continue;
+			}
+			if (attempt < spin) {
+				cpuRelax();
+				continue;
+			}
+
+			header->jobWaiters.fetch_add(1);
+			futexWait(&header->sequence, sequence, std::chrono::milliseconds(100));
+			header->jobWaiters.fetch_sub(1);
+		}
+		if (header->closed.load()) {
+			break;
+		}
+		seen = sequence;
+
+		//take ranges until the job is solved or replaced
+		std::uint32_t open = sequence - 1;
+		for (bool searching = true; searching && header->claimed.load(std::memory_order_relaxed) == open;) {
+			std::uint64_t next = header->nextRange.load(std::memory_order_relaxed);
+			if (next >> 32 != sequence) {
+				break;
+			}
+			if (!header->nextRange.compare_exchange_weak(next, next + 1)) {
+				continue;
+			}
+
+			std::uint64_t range = next & 0xffffffff;
+			if (range == 0) {
+				header->pickedUpAt.store(nanosecondsNow(), std::memory_order_relaxed);
+			}
+
+			Block block = job;
+			block.threshold = job.threshold + static_cast<unsigned>(range >> (32 - rangeBits));
+			block.nonce = static_cast<unsigned>((range << rangeBits) & 0xffffffff);
+			unsigned last = block.nonce + static_cast<unsigned>((std::uint64_t(1) << rangeBits) - 1);
+
+			for (;;) {
+				unsigned first = block.nonce;
+				unsigned hash = searchNonces(block, last - first < chunk ? last : first + chunk - 1, block.threshold);
+				slot->hashes.fetch_add(std::uint64_t(block.nonce - first) + 1, std::memory_order_relaxed);
+
+				if (hash <= block.threshold) {
+					std::uint32_t expected = open;
+					if (header->claimed.compare_exchange_strong(expected, sequence)) {
+						slot->solutions.fetch_add(1, std::memory_order_relaxed);
+						header->nonce = block.nonce;
+						header->threshold = block.threshold;
+						header->hash = hash;
+						header->foundAt = nanosecondsNow();
+						header->found.store(sequence);
+						if (header->foundWaiters.load() > 0) {
+							futexWake(&header->found);
+						}
+					}
+					searching = false;
+					break;
+				}
+				if (block.nonce == last) {
+					break;
+				}
+				block.nonce++;
+
+				//solved by another worker, or replaced
+				if (header->claimed.load(std::memory_order_relaxed) != open) {
+					searching = false;
+					break;
+				}
+			}
+		}
+	}
+
+	slot->pid.store(0);
+	munmap(header, sizeof(JobBoardHeader));
+	return 0;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+#include "histogram.hpp"
+#include "ledger.hpp"
+
+//mining in separate processes over shared memory, with no sockets between them and the ledger
+//the board is a small file in /dev/shm that the ledger and every worker map: the ledger posts a block
+//template under a sequence number (a seqlock, and the futex word idle workers sleep on), workers claim
+//ranges of it from a counter tagged with that sequence, and the first to find a solution claims the
+//solution slot, fills it in and wakes the ledger through a second futex word
+//both sides spin for a while before sleeping, so while there are cores to spare a posted job is picked
+//up, and a solution handed back, without a system call on the waiting side
+//the ranges are the mining pool's, (extra nonce, first nonce, last nonce), see mining_pool.hpp
+
+struct JobBoardWorkerSlot {
+	alignas(64) std::atomic<std::int32_t> pid; //0 while the slot is free
+	std::atomic<std::uint64_t> hashes;
+	std::atomic<std::uint64_t> solutions;
+};
+
+struct JobBoardHeader {
+	static constexpr std::uint32_t maxWorkers = 64;
+
+	char magic[8];
+	std::uint32_t blockSize;
+	std::uint32_t rangeBits; //each range is 2^rangeBits nonces
+	std::atomic<std::uint32_t> closed; //the ledger has gone, workers exit
+
+	//the job, odd while the ledger is writing it
+	alignas(64) std::atomic<std::uint32_t> sequence;
+	std::atomic<std::uint32_t> jobWaiters;
+	Block block; //the template, its threshold the job's base threshold
+	std::int64_t postedAt; //Clock nanoseconds
+
+	//sequence << 32 | ranges handed out, so a worker still on an older job can't take a range of this one
+	alignas(64) std::atomic<std::uint64_t> nextRange;
+	std::atomic<std::int64_t> pickedUpAt; //when the first range was taken
+
+	//the solution: claimed is sequence - 1 while the job is open and sequence once a worker has won it,
+	//found becomes sequence once the winner has written the fields below
+	alignas(64) std::atomic<std::uint32_t> claimed;
+	std::atomic<std::uint32_t> found;
+	std::atomic<std::uint32_t> foundWaiters;
+	std::uint32_t nonce;
+	std::uint32_t threshold;
+	std::uint32_t hash;
+	std::int64_t foundAt;
+
+	JobBoardWorkerSlot workers[maxWorkers];
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "the job board needs address-free atomics");
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free, "the job board needs address-free atomics");
+
+struct JobBoardOptions {
+	std::string path; //under /dev/shm, so it never touches a disk
+	unsigned rangeBits = 22;
+	unsigned spin = 1 << 14; //polls before the ledger sleeps on a solution
+};
+
+class JobBoard : public BlockMiner {
+public:
+	JobBoard(JobBoardOptions const& options);
+	~JobBoard();
+
+	JobBoard(JobBoard const&) = delete;
+	JobBoard& operator=(JobBoard const&) = delete;
+
+	//create the board, replacing any left by a previous run
+	bool Create(std::string& error);
+
+	bool WaitForWorkers(std::size_t count, double seconds);
+
+	//posts the block and waits for its solution, or mines it here with hashBlock when every worker has gone
+	unsigned Mine(Block& block, unsigned threshold) override;
+
+	std::size_t WorkerCount() const; //slots taken
+	std::uint64_t Blocks() const { return blocks; }
+	std::uint64_t Hashes() const;
+	void WriteReport(std::ostream& os) const;
+
+private:
+	void Post(Block const& block, unsigned threshold);
+
+	//free the slots of workers that died without freeing them, returns WorkerCount()
+	std::size_t ReapWorkers();
+
+	JobBoardOptions options;
+	int fd = -1;
+	JobBoardHeader* header = nullptr;
+
+	std::uint64_t blocks = 0;
+	std::uint64_t localBlocks = 0;
+	LatencyHistogram pickupLatency{"job pickup"}; //posted until the first range was taken
+	LatencyHistogram handoffLatency{"solution handoff"}; //solution written until the ledger had it
+};
+
+//"sixpence board [workers=N] [transfers=N] [threshold=N] [range_bits=N] [spin=N] [path=file]"
+//the mining pool harness over a job board instead of sockets
+int boardMain(int argc, char* argv[]);
+
+//"sixpence board-worker --board file [--chunk nonces] [--spin N]", runs until the board closes
+int boardWorkerMain(int argc, char* argv[]);
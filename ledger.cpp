@@ -0,0 +1,491 @@
+#include "ledger.hpp"
+
+#include "alloc_tracker.hpp"
+#include "block_log.hpp"
+#include "change_feed.hpp"
+#include "export.hpp"
+#include "fast_clock.hpp"
+#include "histogram.hpp"
+#include "metrics.hpp"
+#include "perf_counters.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+//variables for the blockchain proper
+std::vector<Block> blockVector;
+
+//per-call latencies of the hot paths
+LatencyHistogram sendAmountLatency("sendAmount");
+LatencyHistogram hashBlockLatency("hashBlock");
+LatencyHistogram generateTransferLatency("generateTransfer");
+LatencyHistogram generateReceiptLatency("generateReceipt");
+LatencyHistogram generateReturnLatency("generateReturn");
+
+//ledger and miner health, see metrics.hpp
+MetricCounter hashesMetric("sixpence_hashes_total", "Hash attempts made while mining");
+MetricCounter blocksAppendedMetric("sixpence_blocks_appended_total", "Blocks pushed onto the chain");
+MetricGauge chainLengthMetric("sixpence_chain_length", "Blocks currently in the chain");
+
+//one series per sendAmount result code
+MetricCounter transfersAcceptedMetric("sixpence_transfers_total", "sendAmount calls by result code", "code=\"0\"");
+MetricCounter transfersRejectedSameMetric("sixpence_transfers_total", "sendAmount calls by result code", "code=\"-1\"");
+MetricCounter transfersRejectedFundsMetric("sixpence_transfers_total", "sendAmount calls by result code", "code=\"-2\"");
+MetricCounter transfersRejectedReceiptMetric("sixpence_transfers_total", "sendAmount calls by result code", "code=\"-3\"");
+
+//hardware counters, per hash attempt for mining and per block visited for the chain scans
+PerfStat hashBlockPerf("hashBlock", "hash");
+PerfStat generateTransferPerf("generateTransfer", "block");
+PerfStat generateReceiptPerf("generateReceipt", "block");
+PerfStat generateReturnPerf("generateReturn", "block");
+
+PerfStat* const perfStats[4] = {
+	&hashBlockPerf,
+	&generateTransferPerf,
+	&generateReceiptPerf,
+	&generateReturnPerf,
+};
+
+LatencyHistogram* const latencyHistograms[5] = {
+	&sendAmountLatency,
+	&hashBlockLatency,
+	&generateTransferLatency,
+	&generateReceiptLatency,
+	&generateReturnLatency,
+};
+
+//heap allocations per call, which should all be zero once the chain has been reserved
+AllocationStat sendAmountAllocations("sendAmount");
+AllocationStat hashBlockAllocations("hashBlock");
+AllocationStat pushBlockAllocations("pushBlock");
+AllocationStat verifyChainAllocations("verifyChain");
+
+AllocationStat* const allocationStats[4] = {
+	&sendAmountAllocations,
+	&hashBlockAllocations,
+	&pushBlockAllocations,
+	&verifyChainAllocations,
+};
+
+bool verboseMining = true;
+bool coarseTimestamps = false;
+
+Clock::duration blockTimestamp() {
+	if (coarseTimestamps) {
+		return std::chrono::duration_cast<Clock::duration>(CoarseClock::now().time_since_epoch());
+	}
+	return Clock::now().time_since_epoch();
+}
+
+//hash a byte array into an unsigned 32-bit integer
+unsigned fnv_hash_1a_32(const void *key, int len) {
+	const unsigned char *p = static_cast<const unsigned char*>(key);
+	unsigned h = 0x811c9dc5;
+	for (int i = 0; i < len; i++) {
+		h = ( h ^ p[i] ) * 0x01000193;
+	}
+	return h;
+}
+
+Transaction generateBlank(const char data[blankSize]) {
+	Transaction transaction;
+	transaction.type = TransactionType::INVALID;
+	memcpy(&transaction.blank.unused, data, blankSize);
+	return transaction;
+}
+
+Transaction generateTransfer(unsigned sender, unsigned receiver, unsigned amount) {
+	PROFILE_SCOPE("generateTransfer");
+	LatencyTimer latencyTimer(generateTransferLatency);
+	PerfScope perfScope(generateTransferPerf);
+
+	if (sender == receiver || receiver == 0) {
+		return { TransactionType::INVALID };
+	}
+
+	//info about the sender
+	unsigned balance = 0;
+	unsigned prevSenderReceipt = -1;
+
+	//validate that this sender has money to send (sender = 0 is a special case)
+	if (sender != 0) {
+		auto iter = blockVector.rbegin();
+		for (; iter != blockVector.rend(); iter++) {
+			if (iter->transaction.type == TransactionType::RECEIPT && iter->transaction.receipt.account == sender) {
+				balance = iter->transaction.receipt.balance;
+				prevSenderReceipt = iter->index;
+				break;
+			}
+		}
+		perfScope.AddUnits(iter - blockVector.rbegin() + (iter != blockVector.rend())); //blocks visited, including the match
+	}
+
+	if (sender != 0 && balance < amount) {
+		return Transaction { TransactionType::INVALID };
+	}
+
+	//return the valid transaction for hashing
+	Transaction transaction;
+	transaction.transfer = {
+		sender == 0 ? TransactionType::GENERATE : TransactionType::TRANSFER,
+		sender,
+		receiver,
+		prevSenderReceipt,
+		amount
+	};
+	return transaction;
+}
+
+Transaction generateReceipt(Block transferBlock) {
+	PROFILE_SCOPE("generateReceipt");
+	LatencyTimer latencyTimer(generateReceiptLatency);
+	PerfScope perfScope(generateReceiptPerf);
+
+	//accepts generate & transfers
+	if (transferBlock.transaction.type != TransactionType::GENERATE && transferBlock.transaction.type != TransactionType::TRANSFER) {
+		return { TransactionType:: INVALID };
+	}
+
+	//info about the receiver
+	unsigned balance = 0;
+	unsigned prevReceiverReceipt = -1;
+
+	//find the receiver's previous balance
+	auto iter = blockVector.rbegin();
+	for (; iter != blockVector.rend(); iter++) {
+		if (iter->transaction.type == TransactionType::RECEIPT && iter->transaction.receipt.account == transferBlock.transaction.transfer.receiverAccount) {
+			balance = iter->transaction.receipt.balance;
+			prevReceiverReceipt = iter->index;
+			break;
+		}
+	}
+	perfScope.AddUnits(iter - blockVector.rbegin() + (iter != blockVector.rend())); //blocks visited, including the match
+
+	//return the valid transaction for hashing
+	Transaction transaction;
+	transaction.receipt = {
+		TransactionType::RECEIPT,
+		transferBlock.transaction.transfer.receiverAccount, //account ID
+		prevReceiverReceipt, //prior balance stored here
+		transferBlock.index, //receiving money from here
+		balance + transferBlock.transaction.transfer.amount //new balance
+	};
+	return transaction;
+}
+
+Transaction generateReturn(Block transferBlock, Block receiptBlock) {
+	PROFILE_SCOPE("generateReturn");
+	LatencyTimer latencyTimer(generateReturnLatency);
+	PerfScope perfScope(generateReturnPerf);
+
+	//accepts generate & transfers
+	if (transferBlock.transaction.type != TransactionType::GENERATE && transferBlock.transaction.type != TransactionType::TRANSFER) {
+		return { TransactionType:: INVALID };
+	}
+
+	//accepts receipts
+	if (receiptBlock.transaction.type != TransactionType::RECEIPT) {
+		return { TransactionType::INVALID };
+	}
+
+	//make sure the return can go somewhere correct (GENERATE blocks don't have a correct return address)
+	if (transferBlock.transaction.transfer.prevReceipt == -1) {
+		return { TransactionType::INVALID };
+	}
+
+	//get the prior balance
+	unsigned balance = -1;
+
+	auto iter = blockVector.rbegin();
+	for (; iter != blockVector.rend(); iter++) {
+		if (iter->index == transferBlock.transaction.transfer.prevReceipt) {
+			balance = iter->transaction.receipt.balance;
+			break;
+		}
+	}
+	perfScope.AddUnits(iter - blockVector.rbegin() + (iter != blockVector.rend())); //blocks visited, including the match
+
+	//return the remaining balance to the sender's account
+	Transaction transaction;
+	transaction.receipt = {
+		TransactionType::RECEIPT,
+		transferBlock.transaction.transfer.senderAccount,
+		transferBlock.transaction.transfer.senderAccount,
+		receiptBlock.index,
+		balance - transferBlock.transaction.transfer.amount,
+	};
+	return transaction;
+}
+
+static unsigned blockCounter = 0;
+
+Block generateBlock(Transaction transaction, unsigned prevHash) {
+	Block block;
+	block.nonce = 0; //unmined until hashBlock gets to it
+	block.threshold = 0;
+	block.index = blockCounter++;
+	block.prevHash = prevHash;
+	block.timestamp = blockTimestamp();
+	block.transaction = transaction;
+	block.reserved = 0;
+	return block;
+}
+
+bool sameBlockTemplate(Block const& a, Block const& b) {
+	static_assert(offsetof(Block, nonce) == 0 && offsetof(Block, index) == 2 * sizeof(unsigned), "mining sets only the first two members");
+	return !memcmp(&a.index, &b.index, sizeof(Block) - offsetof(Block, index));
+}
+
+//hashBlock's search, chunk nonces at a time; between chunks, next(nonce) can call it off
+template<typename Next>
+static bool searchInOrder(Block& block, unsigned threshold, unsigned chunk, std::uint64_t& hashes, unsigned& hash, Next next) {
+	block.nonce = 1;
+	block.threshold = threshold;
+
+	for (;;) {
+		unsigned first = block.nonce;
+		unsigned last = std::min<std::uint64_t>((first / chunk + 1) * std::uint64_t(chunk) - 1, UINT_MAX);
+		hash = searchNonces(block, last, block.threshold);
+		hashes += block.nonce - first + 1;
+		if (hash <= block.threshold) {
+			return true;
+		}
+
+		if (++block.nonce == 0) {
+			block.threshold++; //BUGFIX: increase the threshold if it's done a full loop
+			if (verboseMining) {
+				std::cout << "threshold adjusted" << std::endl;
+			}
+		}
+		if (!next(block.nonce)) {
+			return false;
+		}
+	}
+}
+
+unsigned hashBlock(Block& block, unsigned const threshold) {
+	AllocationScope allocationScope(hashBlockAllocations);
+	PROFILE_SCOPE("hashBlock");
+	LatencyTimer latencyTimer(hashBlockLatency);
+	PerfScope perfScope(hashBlockPerf);
+
+	//a million nonces at a time, for the progress output
+	unsigned hash;
+	std::uint64_t hashes = 0;
+	searchInOrder(block, threshold, 1000000, hashes, hash, [](unsigned nonce) {
+		if (verboseMining && nonce != 0 && nonce % 1000000 == 0) {
+			std::cout << nonce / 1000000 << std::endl;
+		}
+		return true;
+	});
+
+	if (verboseMining) {
+		std::cout << "hash found" << std::endl;
+	}
+	perfScope.AddUnits(hashes);
+	hashesMetric.Increment(hashes);
+	return hash;
+}
+
+bool hashBlockUnlessCancelled(Block& block, unsigned threshold, std::atomic<std::uint32_t> const& generation, std::uint32_t job, unsigned& hash) {
+	//small chunks, so a cancelled search stops within a few hundred microseconds
+	std::uint64_t hashes = 0;
+	bool mined = searchInOrder(block, threshold, 1 << 14, hashes, hash, [&](unsigned) {
+		return generation.load(std::memory_order_relaxed) == job;
+	});
+	hashesMetric.Increment(hashes);
+	return mined;
+}
+
+unsigned searchNonces(Block& block, unsigned lastNonce, unsigned target) {
+	for (;;) {
+		unsigned hash = fnv_hash_1a_32(&block, sizeof(Block));
+		if (hash <= target || block.nonce == lastNonce) {
+			return hash;
+		}
+		block.nonce++;
+	}
+}
+
+static BlockMiner* blockMiner = nullptr;
+
+void setBlockMiner(BlockMiner* miner) {
+	blockMiner = miner;
+}
+
+static unsigned mineBlock(Block& block, unsigned threshold) {
+	return blockMiner ? blockMiner->Mine(block, threshold) : hashBlock(block, threshold);
+}
+
+static void speculate(Block const* next, unsigned threshold) {
+	if (blockMiner) {
+		blockMiner->Speculate(next, threshold);
+	}
+}
+
+static BlockFeed* blockFeed = nullptr;
+
+void setBlockFeed(BlockFeed* feed) {
+	blockFeed = feed;
+}
+
+static BlockLogWriter* blockLog = nullptr;
+
+void setBlockLog(BlockLogWriter* log) {
+	blockLog = log;
+}
+
+//difficulty retargeting
+RetargetPolicy retargetPolicy;
+
+//the furthest one block's threshold can move from the window's, either way, so a stalled clock or a
+//burst of blocks can't swing the difficulty all at once
+static constexpr double maxRetargetStep = 4;
+
+//never retarget this low: hashBlock raises the threshold of a block once every nonce has failed, which
+//verifyChain would reject, and at this threshold the chance of that is about e^-64
+static constexpr double minRetargetThreshold = 64;
+
+template<typename At>
+static unsigned retargetAt(std::size_t position, At at, RetargetPolicy const& policy) {
+	if (position == 0 || policy.window < 2) {
+		return threshold;
+	}
+	if (position < policy.window) {
+		return at(0).threshold;
+	}
+
+	//the window's mean threshold gave its mean interval, and the time a block takes goes as 1 / threshold
+	std::size_t first = position - policy.window;
+	double meanThreshold = 0;
+	for (std::size_t i = first; i < position; i++) {
+		meanThreshold += at(i).threshold;
+	}
+	meanThreshold /= policy.window;
+
+	double interval = static_cast<double>((at(position - 1).timestamp - at(first).timestamp).count()) / (policy.window - 1);
+	double factor = std::min(std::max(interval / policy.interval.count(), 1 / maxRetargetStep), maxRetargetStep);
+	return static_cast<unsigned>(std::min(std::max(meanThreshold * factor, minRetargetThreshold), static_cast<double>(UINT_MAX)));
+}
+
+unsigned retargetThreshold(std::vector<Block> const& chain, std::size_t position, RetargetPolicy const& policy) {
+	return retargetAt(position, [&chain](std::size_t i) -> Block const& { return chain[i]; }, policy);
+}
+
+//the threshold for the block at position, which can be one past the end of the chain, after pending
+//(sendAmount's transfer block, which isn't on the chain yet)
+static unsigned miningThreshold(std::size_t position, Block const* pending = nullptr) {
+	if (retargetPolicy.window < 2) {
+		return threshold;
+	}
+	return retargetAt(position, [=](std::size_t i) -> Block const& {
+		return i < blockVector.size() ? blockVector[i] : *pending;
+	}, retargetPolicy);
+}
+
+void pushBlock(Block const& block) {
+	AllocationScope allocationScope(pushBlockAllocations);
+	blockVector.push_back(block);
+	blocksAppendedMetric.Increment();
+	chainLengthMetric.Set(blockVector.size());
+
+	if (blockVector.size() > 1) {
+		Block const& final = blockVector[blockVector.size() - 2];
+		if (blockFeed) {
+			blockFeed->Publish(final);
+		}
+		if (blockLog) {
+			blockLog->Append(final);
+		}
+	}
+	speculate(&blockVector.back(), miningThreshold(blockVector.size() - 1));
+}
+
+//high-level actions
+unsigned threshold = 1 << 8;
+
+int sendAmount(unsigned sender, unsigned receiver, unsigned amount) {
+	AllocationScope allocationScope(sendAmountAllocations);
+	PROFILE_SCOPE("sendAmount");
+	LatencyTimer latencyTimer(sendAmountLatency);
+
+	if (sender == receiver || receiver == 0) {
+		transfersRejectedSameMetric.Increment();
+		return -1;
+	}
+
+	//each transaction is validated before the block before it is mined, so a speculative miner has the
+	//time validation takes to get ahead on that block
+	std::size_t tip = blockVector.size() - 1;
+	Transaction transferTransaction = generateTransfer(sender, receiver, amount);
+	Block transfer = generateBlock(transferTransaction, mineBlock(blockVector.back(), miningThreshold(tip)));
+	if (transfer.transaction.type == TransactionType::INVALID) {
+		transfersRejectedFundsMetric.Increment();
+		return -2;
+	}
+	speculate(&transfer, miningThreshold(tip + 1));
+
+	Transaction receiptTransaction = generateReceipt(transfer);
+	Block receipt = generateBlock(receiptTransaction, mineBlock(transfer, miningThreshold(tip + 1)));
+	if (receipt.transaction.type == TransactionType::INVALID) {
+		transfersRejectedReceiptMetric.Increment();
+		return -3;
+	}
+	speculate(&receipt, miningThreshold(tip + 2, &transfer));
+
+	Transaction returnTransaction = generateReturn(transfer, receipt);
+	Block ret = generateBlock(returnTransaction, mineBlock(receipt, miningThreshold(tip + 2, &transfer)));
+
+	//once these are finallized, push to the blockchain
+	pushBlock(transfer);
+	pushBlock(receipt);
+
+	//handle returns differently, since invalid returns can be generated by GENERATE blocks
+	if (ret.transaction.type != TransactionType::INVALID) {
+		pushBlock(ret);
+	}
+
+	transfersAcceptedMetric.Increment();
+
+	return 0;
+}
+
+std::size_t verifyChain(std::vector<Block> const& chain) {
+	AllocationScope allocationScope(verifyChainAllocations);
+	PROFILE_SCOPE("verifyChain");
+
+	for (std::size_t i = 1; i < chain.size(); i++) {
+		unsigned hash = fnv_hash_1a_32(&chain[i - 1], sizeof(Block));
+		if (hash != chain[i].prevHash || hash > chain[i - 1].threshold) {
+			return i;
+		}
+		if (retargetPolicy.window >= 2 && i > 1 && chain[i - 1].threshold != retargetThreshold(chain, i - 1, retargetPolicy)) {
+			return i - 1;
+		}
+	}
+	return chain.size();
+}
+
+void resetLedger() {
+	blockVector.clear();
+	blockCounter = 0;
+	chainLengthMetric.Set(0);
+	speculate(nullptr, threshold);
+}
+
+void reserveLedger(std::size_t blocks) {
+	blockVector.reserve(blocks);
+}
+
+void setNextBlockIndex(unsigned index) {
+	blockCounter = index;
+}
+
+void printBlock(Block const& block) {
+	char line[maxFormattedBlock];
+	std::cout.write(line, formatBlock(line, block, ExportFormat::TEXT));
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+//types to be used
+typedef std::chrono::high_resolution_clock Clock;
+
+//the type of transaction
+enum class TransactionType {
+	INVALID = -1,
+	GENERATE = 0,
+	TRANSFER = 1,
+	RECEIPT = 2,
+};
+
+//the amount to transfer to a new account
+constexpr int blankSize = 4 * sizeof(unsigned);
+struct Blank {
+	TransactionType type;
+	unsigned char unused[blankSize];
+};
+
+struct Transfer {
+	TransactionType type;
+	unsigned senderAccount;
+	unsigned receiverAccount;
+	unsigned prevReceipt; //prove this sender received coins previously (block index)
+	unsigned amount; //amount to be transferred
+};
+
+struct Receipt {
+	TransactionType type;
+	unsigned account; //account to receive
+	unsigned prevReceipt; //prior balance (block index)
+	unsigned prevTransfer; //receiving money (block index)
+	unsigned balance; //new balance
+};
+
+union Transaction {
+	TransactionType type; //union signal
+	Blank blank;
+	Transfer transfer;
+	Receipt receipt;
+};
+
+//the building block of the chain
+struct Block {
+	unsigned nonce; //must be first member
+	unsigned threshold; //store my own hash threshold
+	unsigned index;
+	unsigned prevHash;
+	Clock::duration timestamp;
+	Transaction transaction;
+	unsigned reserved; //would be padding otherwise, and every byte is hashed, so it's kept at zero
+};
+
+//checks
+static_assert(std::is_pod<Transfer>::value, "Transfer is not a POD");
+static_assert(std::is_pod<Receipt>::value, "Receipt is not a POD");
+static_assert(std::is_pod<Transaction>::value, "Transaction is not a POD");
+static_assert(std::is_pod<Block>::value, "Block is not a POD");
+static_assert(sizeof(Block) == offsetof(Block, reserved) + sizeof(unsigned), "Block has padding, which copies needn't preserve");
+
+//variables for the blockchain proper
+extern std::vector<Block> blockVector;
+
+//the mining threshold used by sendAmount, lower is harder
+extern unsigned threshold;
+
+//difficulty retargeting, off while window is under 2: the first block is mined at threshold, and every
+//block after it at the threshold that would have brought the window of blocks before it to one block per
+//interval, going by their timestamps and thresholds; until there's a full window, the first block's
+//threshold is kept; verifyChain checks every mined block's threshold against it
+struct RetargetPolicy {
+	unsigned window = 0; //blocks
+	Clock::duration interval = std::chrono::milliseconds(100);
+};
+extern RetargetPolicy retargetPolicy;
+
+//the threshold chain[position] is mined at under policy, from the blocks before it
+unsigned retargetThreshold(std::vector<Block> const& chain, std::size_t position, RetargetPolicy const& policy);
+
+//print mining progress to std::cout
+extern bool verboseMining;
+
+//block timestamps only need millisecond resolution, the coarse clock skips the hardware read
+extern bool coarseTimestamps;
+
+//instrumentation for the hot paths, reported by main
+class LatencyHistogram;
+class PerfStat;
+class AllocationStat;
+extern LatencyHistogram* const latencyHistograms[5];
+extern PerfStat* const perfStats[4];
+extern AllocationStat* const allocationStats[4];
+
+unsigned fnv_hash_1a_32(const void *key, int len);
+
+Transaction generateBlank(const char data[blankSize]);
+Transaction generateTransfer(unsigned sender, unsigned receiver, unsigned amount);
+Transaction generateReceipt(Block transferBlock);
+Transaction generateReturn(Block transferBlock, Block receiptBlock);
+Block generateBlock(Transaction transaction, unsigned prevHash);
+
+//the same block to mine: equal in everything but the nonce and threshold, which mining sets
+bool sameBlockTemplate(Block const& a, Block const& b);
+unsigned hashBlock(Block& block, unsigned const threshold);
+
+//the mining kernel under hashBlock and every other miner: try nonces from block.nonce up to and
+//including lastNonce, stopping at the first whose hash is at or under target
+//returns the hash of the last nonce tried, which block.nonce is left at
+unsigned searchNonces(Block& block, unsigned lastNonce, unsigned target);
+
+//hashBlock that another thread can call off: between chunks of nonces it gives up, returning false,
+//once generation has moved on from job; it tries nonces in hashBlock's order, so a block it finishes
+//is the block hashBlock would have mined
+bool hashBlockUnlessCancelled(Block& block, unsigned threshold, std::atomic<std::uint32_t> const& generation, std::uint32_t job, unsigned& hash);
+
+//mines blocks for sendAmount in place of hashBlock, when one is set (see mining_pool.hpp)
+//Mine() has hashBlock's contract: it sets the nonce and threshold, raising the threshold if the nonces run out
+class BlockMiner {
+public:
+	virtual ~BlockMiner() = default;
+	virtual unsigned Mine(Block& block, unsigned threshold) = 0;
+
+	//a hint that next will be asked for soon, so mining can start early (see speculative_miner.hpp);
+	//given for every new chain tip and for each of sendAmount's blocks once it is valid, nullptr withdraws it
+	virtual void Speculate(Block const*, unsigned) {}
+};
+void setBlockMiner(BlockMiner* miner);
+
+//every pushed block is also published to this feed, when one is set (see change_feed.hpp)
+//a block is only published once it's final: the tip is mined in place when the next block is made,
+//so the feed, and the log below, get each block when the one after it is pushed, never the tip
+class BlockFeed;
+void setBlockFeed(BlockFeed* feed);
+
+//and appended to this log, when one is set (see block_log.hpp)
+class BlockLogWriter;
+void setBlockLog(BlockLogWriter* log);
+
+//push onto the chain, update the metrics and publish the block before it to the feed and the log
+//only allocates when the chain outgrows what reserveLedger() set aside
+void pushBlock(Block const& block);
+
+//high-level actions
+int sendAmount(unsigned sender, unsigned receiver, unsigned amount);
+
+//check every link and every proof of work, and every threshold while retargeting is on (see RetargetPolicy)
+//the newest block is not mined yet so only its link is checked
+//returns the position of the first bad block, or chain.size() when the chain is valid
+std::size_t verifyChain(std::vector<Block> const& chain);
+
+//empty the chain and restart block numbering, for benchmarks and tests
+void resetLedger();
+
+//set aside room for this many blocks, so appending never reallocates
+void reserveLedger(std::size_t blocks);
+
+//continue block numbering after a chain that was built or loaded elsewhere
+void setNextBlockIndex(unsigned index);
+
+void printBlock(Block const& block);
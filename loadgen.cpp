@@ -0,0 +1,567 @@
+#include "loadgen.hpp"
+
+#include "fast_clock.hpp"
+#include "histogram.hpp"
+#include "protocol.hpp"
+#include "random.hpp"
+#include "spec_options.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+//spec parsing
+bool setLoadOption(LoadSpec& spec, std::string const& key, std::string const& value, std::string& error) {
+	bool ok;
+	if (key == "address") ok = !(spec.address = value).empty();
+	else if (key == "connections") ok = parseOptionNumber(value, spec.connections) && spec.connections > 0;
+	else if (key == "threads") ok = parseOptionNumber(value, spec.threads) && spec.threads > 0;
+	else if (key == "pipeline") ok = parseOptionNumber(value, spec.pipeline) && spec.pipeline > 0;
+	else if (key == "batch") ok = parseOptionNumber(value, spec.batch) && spec.batch > 0;
+	else if (key == "rate") ok = parseOptionNumber(value, spec.rate);
+	else if (key == "duration") ok = parseOptionNumber(value, spec.duration);
+	else if (key == "submit_fraction") ok = parseOptionNumber(value, spec.submitFraction) && spec.submitFraction <= 1;
+	else if (key == "block_fraction") ok = parseOptionNumber(value, spec.blockFraction) && spec.blockFraction <= 1;
+	else if (key == "generate_fraction") ok = parseOptionNumber(value, spec.generateFraction) && spec.generateFraction <= 1;
+	else if (key == "accounts") ok = parseOptionNumber(value, spec.accounts) && spec.accounts > 0;
+	else if (key == "zipf") ok = parseOptionNumber(value, spec.zipfExponent);
+	else if (key == "mean_amount") ok = parseOptionNumber(value, spec.meanAmount) && spec.meanAmount >= 1;
+	else if (key == "preload") ok = parseOptionNumber(value, spec.preload);
+	else if (key == "seed") ok = parseOptionNumber(value, spec.seed);
+	else {
+		error = "unknown key " + key;
+		return false;
+	}
+
+	if (!ok) {
+		error = "bad value for " + key + ": " + value;
+	}
+	return ok;
+}
+
+bool parseLoadSpec(std::istream& is, LoadSpec& spec, std::string& error) {
+	return parseOptionLines(is, [&spec](std::string const& key, std::string const& value, std::string& error) {
+		return setLoadOption(spec, key, value, error);
+	}, error);
+}
+
+void writeLoadSpec(std::ostream& os, LoadSpec const& spec) {
+	os << "address = " << spec.address << "\n"
+		<< "connections = " << spec.connections << "\n"
+		<< "threads = " << spec.threads << "\n"
+		<< "pipeline = " << spec.pipeline << "\n"
+		<< "batch = " << spec.batch << "\n"
+		<< "rate = " << spec.rate << (spec.rate > 0 ? " (open-loop)" : " (closed-loop)") << "\n"
+		<< "duration = " << spec.duration << "\n"
+		<< "submit_fraction = " << spec.submitFraction << "\n"
+		<< "block_fraction = " << spec.blockFraction << "\n"
+		<< "generate_fraction = " << spec.generateFraction << "\n"
+		<< "accounts = " << spec.accounts << "\n"
+		<< "zipf = " << spec.zipfExponent << "\n"
+		<< "mean_amount = " << spec.meanAmount << "\n"
+		<< "preload = " << spec.preload << "\n"
+		<< "seed = " << spec.seed << "\n";
+}
+
+//running the load
+enum LoadOp {
+	LOAD_SUBMIT,
+	LOAD_BALANCE,
+	LOAD_BLOCK,
+	loadOpCount
+};
+
+static const char* const loadOpNames[loadOpCount] = { "submit", "balance", "block" };
+
+struct LoadRun {
+	LoadSpec const& spec;
+	ZipfSampler zipf;
+	bool openLoop;
+	std::uint64_t startTicks = 0;
+	std::uint64_t endTicks = 0;
+	std::uint64_t drainTicks = 0; //answers still outstanding by now are given up on
+
+	std::unique_ptr<LatencyHistogram> latency[loadOpCount] = {};
+	std::atomic<std::uint64_t> sent[loadOpCount] = {};
+	std::atomic<std::uint64_t> completed[loadOpCount] = {};
+	std::atomic<std::uint64_t> notFound[loadOpCount] = {};
+	std::atomic<std::uint64_t> failed[loadOpCount] = {}; //BAD_REQUEST or FULL
+	std::atomic<std::uint64_t> submitResults[4] = {}; //sendAmount results 0, -1, -2 and -3
+	std::atomic<std::uint64_t> unanswered{0};
+
+	//transfers accepted so far; each appended at least two blocks, so block fetches aim below that
+	std::atomic<std::uint64_t> accepted{0};
+};
+
+struct LoadRequest {
+	LoadOp op;
+	std::uint64_t dueTicks; //latency is measured from here
+};
+
+struct LoadConnection {
+	int fd = -1;
+	bool failed = false;
+
+	std::vector<char> output;
+	std::size_t outputSent = 0;
+	std::vector<char> input = std::vector<char>(sizeof(FrameHeader) + maxFramePayload); //room for any frame the server sends
+	std::size_t inputEnd = 0;
+
+	std::deque<LoadRequest> outstanding; //sent as plain frames, answered in this order
+	std::deque<LoadRequest> backlog; //open-loop requests that came due while the pipeline was full
+
+	//batched requests, by id; answers come back in any order
+	std::vector<LoadRequest> slots;
+	std::vector<std::uint32_t> freeSlots;
+	std::size_t batchFrame = noBatchFrame;
+	unsigned batchEntries = 0; //in the open frame
+
+	std::size_t Outstanding() const { return outstanding.size() + slots.size() - freeSlots.size(); }
+};
+
+static LoadOp sampleOp(LoadRun const& run, std::uint64_t& state) {
+	double u = uniform(state);
+	if (u < run.spec.submitFraction) {
+		return LOAD_SUBMIT;
+	}
+	return u < run.spec.submitFraction + run.spec.blockFraction ? LOAD_BLOCK : LOAD_BALANCE;
+}
+
+static void sendRequest(LoadRun& run, LoadConnection& connection, LoadRequest request, std::uint64_t& state) {
+	LoadSpec const& spec = run.spec;
+
+	Op op;
+	union {
+		SubmitRequest submit;
+		BalanceRequest balance;
+		BlockRequest block;
+	} payload;
+	std::size_t length;
+
+	switch (request.op) {
+		case LOAD_SUBMIT:
+			op = Op::SUBMIT;
+			payload.submit.sender = uniform(state) < spec.generateFraction ? 0 : run.zipf.Sample(state);
+			do {
+				payload.submit.receiver = run.zipf.Sample(state);
+			} while (payload.submit.receiver == payload.submit.sender && spec.accounts > 1);
+			payload.submit.amount = exponentialAmount(state, spec.meanAmount);
+			length = sizeof(SubmitRequest);
+			break;
+		case LOAD_BALANCE:
+			op = Op::BALANCE;
+			payload.balance.account = run.zipf.Sample(state);
+			length = sizeof(BalanceRequest);
+			break;
+		default:
+			op = Op::BLOCK;
+			payload.block.position = static_cast<std::uint64_t>(uniform(state) * (1 + 2 * run.accepted.load(std::memory_order_relaxed)));
+			length = sizeof(BlockRequest);
+			break;
+	}
+
+	if (spec.batch > 1) {
+		std::uint32_t id = connection.freeSlots.back();
+		connection.freeSlots.pop_back();
+		connection.slots[id] = request;
+
+		appendBatchEntry(connection.output, connection.batchFrame, op, Status::OK, id, &payload, length);
+		if (++connection.batchEntries >= spec.batch) {
+			finishBatchFrame(connection.output, connection.batchFrame);
+			connection.batchEntries = 0;
+		}
+	}
+	else {
+		appendFrame(connection.output, op, Status::OK, &payload, length);
+		connection.outstanding.push_back(request);
+	}
+	run.sent[request.op].fetch_add(1, std::memory_order_relaxed);
+}
+
+static void flush(LoadConnection& connection) {
+	finishBatchFrame(connection.output, connection.batchFrame);
+	connection.batchEntries = 0;
+
+	while (connection.outputSent < connection.output.size()) {
+		ssize_t sent = send(connection.fd, connection.output.data() + connection.outputSent, connection.output.size() - connection.outputSent, MSG_NOSIGNAL);
+		if (sent < 0) {
+			if (errno != EAGAIN && errno != EINTR) {
+				connection.failed = true;
+			}
+			if (errno != EINTR) {
+				break;
+			}
+			continue;
+		}
+		connection.outputSent += sent;
+	}
+
+	if (connection.outputSent == connection.output.size()) {
+		connection.output.clear();
+		connection.outputSent = 0;
+	}
+}
+
+static void recordAnswer(LoadRun& run, LoadRequest request, Status status, char const* payload, std::size_t length, std::uint64_t now) {
+	run.latency[request.op]->Record(now > request.dueTicks ? TscClock::ElapsedNanoseconds(now - request.dueTicks) : 0);
+
+	if (status == Status::OK) {
+		run.completed[request.op].fetch_add(1, std::memory_order_relaxed);
+		if (request.op == LOAD_SUBMIT && length == sizeof(SubmitResponse)) {
+			SubmitResponse response;
+			memcpy(&response, payload, sizeof(response));
+			run.submitResults[std::min(-response.result, 3)].fetch_add(1, std::memory_order_relaxed);
+			if (response.result == 0) {
+				run.accepted.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+	}
+	else if (status == Status::NOT_FOUND) {
+		run.notFound[request.op].fetch_add(1, std::memory_order_relaxed);
+	}
+	else {
+		run.failed[request.op].fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+static void receiveFrame(LoadRun& run, LoadConnection& connection, FrameHeader const& header, char const* payload, std::uint64_t now) {
+	if (header.op == Op::BATCH) {
+		for (std::size_t offset = 0; offset + sizeof(BatchEntry) <= header.length;) {
+			BatchEntry entry;
+			memcpy(&entry, payload + offset, sizeof(entry));
+			std::size_t length = batchResponseSize(entry.op, entry.status);
+			offset += sizeof(BatchEntry) + length;
+
+			if (entry.id < connection.slots.size()) {
+				recordAnswer(run, connection.slots[entry.id], entry.status, payload + offset - length, length, now);
+				connection.freeSlots.push_back(entry.id);
+			}
+		}
+		return;
+	}
+
+	if (header.op == Op::BLOCK_EVENT || connection.outstanding.empty()) {
+		return;
+	}
+
+	LoadRequest request = connection.outstanding.front();
+	connection.outstanding.pop_front();
+	recordAnswer(run, request, header.status, payload, header.length, now);
+}
+
+static void runLoadThread(LoadRun& run, std::vector<LoadConnection*> connections, unsigned threadIndex) {
+	LoadSpec const& spec = run.spec;
+	std::uint64_t state = spec.seed * 0x2545f4914f6cdd1dULL + threadIndex;
+
+	if (spec.batch > 1) {
+		for (LoadConnection* connection : connections) {
+			connection->slots.resize(spec.pipeline);
+			for (std::uint32_t id = spec.pipeline; id > 0; id--) {
+				connection->freeSlots.push_back(id - 1);
+			}
+		}
+	}
+
+	int epollFd = epoll_create1(EPOLL_CLOEXEC);
+	for (LoadConnection* connection : connections) {
+		epoll_event event = {};
+		event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+		event.data.ptr = connection;
+		epoll_ctl(epollFd, EPOLL_CTL_ADD, connection->fd, &event);
+	}
+
+	//this thread's share of the arrivals, one Poisson process spread round-robin over its connections
+	double threadRate = spec.rate * connections.size() / spec.connections;
+	double meanGapTicks = threadRate > 0 ? 1e9 * TscClock::TicksPerNanosecond() / threadRate : 0;
+	double due = static_cast<double>(run.startTicks);
+	std::size_t nextConnection = 0;
+
+	if (!run.openLoop) {
+		std::uint64_t now = TscClock::Ticks();
+		for (LoadConnection* connection : connections) {
+			for (unsigned i = 0; i < spec.pipeline; i++) {
+				sendRequest(run, *connection, { sampleOp(run, state), now }, state);
+			}
+			flush(*connection);
+		}
+	}
+
+	std::vector<epoll_event> events(256);
+	for (;;) {
+		std::uint64_t now = TscClock::Ticks();
+		bool running = now < run.endTicks;
+
+		if (run.openLoop) {
+			while (due <= now && due < run.endTicks) {
+				LoadConnection& connection = *connections[nextConnection];
+				nextConnection = (nextConnection + 1) % connections.size();
+
+				LoadRequest request = { sampleOp(run, state), static_cast<std::uint64_t>(due) };
+				if (connection.Outstanding() < spec.pipeline) {
+					sendRequest(run, connection, request, state);
+				}
+				else {
+					connection.backlog.push_back(request);
+				}
+				due += -meanGapTicks * std::log(1.0 - uniform(state));
+			}
+		}
+
+		//send what this round gathered, whole batches where there were enough
+		bool idle = true;
+		for (LoadConnection* connection : connections) {
+			if (!connection->output.empty()) {
+				flush(*connection);
+			}
+			idle = idle && (connection->failed || (connection->Outstanding() == 0 && connection->backlog.empty()));
+		}
+		if ((!running && idle) || now >= run.drainTicks) {
+			break;
+		}
+
+		//wait for answers, or until the next open-loop request is due
+		int timeout = 10;
+		if (run.openLoop && running) {
+			double wait = std::max(0.0, due - static_cast<double>(now));
+			timeout = static_cast<int>(std::min(10.0, TscClock::ElapsedNanoseconds(static_cast<std::uint64_t>(wait)) / 1e6));
+		}
+
+		int count = epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), timeout);
+		for (int i = 0; i < count; i++) {
+			LoadConnection& connection = *static_cast<LoadConnection*>(events[i].data.ptr);
+			if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+				connection.failed = true;
+			}
+
+			if (events[i].events & EPOLLIN) {
+				for (;;) {
+					ssize_t received = recv(connection.fd, connection.input.data() + connection.inputEnd, connection.input.size() - connection.inputEnd, 0);
+					if (received <= 0) {
+						if (received == 0 || (errno != EAGAIN && errno != EINTR)) {
+							connection.failed = true;
+						}
+						if (received == 0 || errno != EINTR) {
+							break;
+						}
+						continue;
+					}
+					connection.inputEnd += received;
+
+					std::uint64_t answered = TscClock::Ticks();
+					std::size_t offset = 0;
+					FrameHeader header;
+					while (std::size_t size = frameSize(connection.input.data() + offset, connection.inputEnd - offset, header)) {
+						receiveFrame(run, connection, header, connection.input.data() + offset + sizeof(FrameHeader), answered);
+						offset += size;
+					}
+					memmove(connection.input.data(), connection.input.data() + offset, connection.inputEnd - offset);
+					connection.inputEnd -= offset;
+
+					//a frame that can't fit would leave no room to receive into, and recv would read as a hang-up
+					if (connection.inputEnd >= sizeof(FrameHeader) && header.length > maxFramePayload) {
+						connection.failed = true;
+						break;
+					}
+				}
+
+				//refill the pipeline: the backlog first, then (closed-loop) fresh requests
+				std::uint64_t refill = TscClock::Ticks();
+				while (connection.Outstanding() < spec.pipeline && !connection.backlog.empty()) {
+					sendRequest(run, connection, connection.backlog.front(), state);
+					connection.backlog.pop_front();
+				}
+				while (!run.openLoop && refill < run.endTicks && connection.Outstanding() < spec.pipeline) {
+					sendRequest(run, connection, { sampleOp(run, state), refill }, state);
+				}
+			}
+
+			flush(connection);
+		}
+	}
+
+	for (LoadConnection* connection : connections) {
+		run.unanswered.fetch_add(connection->Outstanding() + connection->backlog.size(), std::memory_order_relaxed);
+	}
+	close(epollFd);
+}
+
+//fund some accounts before the clock starts, so early transfers have something to move
+static bool preloadAccounts(LoadSpec const& spec, std::string& error) {
+	int fd = connectToServer(spec.address, error);
+	if (fd < 0) {
+		return false;
+	}
+
+	std::vector<char> output;
+	unsigned count = std::min(spec.preload, spec.accounts);
+	for (unsigned account = 1; account <= count; account++) {
+		SubmitRequest submit = { 0, account, static_cast<std::uint32_t>(spec.meanAmount * 20) };
+		appendFrame(output, Op::SUBMIT, Status::OK, submit);
+	}
+
+	bool ok = output.empty() || send(fd, output.data(), output.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(output.size());
+	std::size_t expected = count * (sizeof(FrameHeader) + sizeof(SubmitResponse));
+	std::vector<char> input(expected);
+	for (std::size_t received = 0; ok && received < expected;) {
+		ssize_t n = recv(fd, input.data() + received, expected - received, 0);
+		ok = n > 0;
+		received += ok ? n : 0;
+	}
+
+	close(fd);
+	if (!ok) {
+		error = "the server hung up during the preload";
+	}
+	return ok;
+}
+
+int loadgenMain(int argc, char* argv[]) {
+	LoadSpec spec;
+	std::string error;
+	const char* latencyFile = nullptr;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		std::size_t equals = arg.find('=');
+
+		if (arg == "--latency-json" && i + 1 < argc) {
+			latencyFile = argv[++i];
+		}
+		else if (equals != std::string::npos && arg[0] != '-') {
+			if (!setLoadOption(spec, arg.substr(0, equals), arg.substr(equals + 1), error)) {
+				std::cerr << error << std::endl;
+				return 1;
+			}
+		}
+		else if (arg[0] != '-') {
+			std::ifstream is(arg);
+			if (!is) {
+				std::cerr << "failed to open " << arg << std::endl;
+				return 1;
+			}
+			if (!parseLoadSpec(is, spec, error)) {
+				std::cerr << arg << ": " << error << std::endl;
+				return 1;
+			}
+		}
+		else {
+			std::cerr << "usage: sixpence loadgen [spec-file] [key=value ...] [--latency-json file]" << std::endl;
+			std::cerr << "keys: address connections threads pipeline batch rate duration submit_fraction block_fraction generate_fraction accounts zipf mean_amount preload seed" << std::endl;
+			return 1;
+		}
+	}
+	spec.threads = std::min(spec.threads, spec.connections);
+
+	writeLoadSpec(std::cout, spec);
+
+	//many connections need as many descriptors as we are allowed
+	rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+
+	if (!preloadAccounts(spec, error)) {
+		std::cerr << error << std::endl;
+		return 1;
+	}
+
+	std::vector<std::unique_ptr<LoadConnection>> connections;
+	for (unsigned i = 0; i < spec.connections; i++) {
+		int fd = connectToServer(spec.address, error);
+		if (fd < 0) {
+			std::cerr << "connection " << i << ": " << error << std::endl;
+			return 1;
+		}
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		connections.emplace_back(new LoadConnection());
+		connections.back()->fd = fd;
+	}
+
+	LoadRun run{spec, ZipfSampler(spec.accounts, spec.zipfExponent), spec.rate > 0};
+	LatencyHistogram all("all");
+	for (int op = 0; op < loadOpCount; op++) {
+		run.latency[op].reset(new LatencyHistogram(loadOpNames[op]));
+	}
+
+	double ticksPerSecond = 1e9 * TscClock::TicksPerNanosecond();
+	run.startTicks = TscClock::Ticks();
+	run.endTicks = run.startTicks + static_cast<std::uint64_t>(spec.duration * ticksPerSecond);
+	run.drainTicks = run.endTicks + static_cast<std::uint64_t>(2 * ticksPerSecond);
+
+	std::vector<std::thread> threads;
+	for (unsigned t = 0; t < spec.threads; t++) {
+		std::vector<LoadConnection*> share;
+		for (unsigned i = t; i < spec.connections; i += spec.threads) {
+			share.push_back(connections[i].get());
+		}
+		threads.emplace_back(runLoadThread, std::ref(run), share, t);
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	double seconds = TscClock::ElapsedNanoseconds(TscClock::Ticks() - run.startTicks) / 1e9;
+
+	std::size_t failedConnections = 0;
+	for (std::unique_ptr<LoadConnection>& connection : connections) {
+		failedConnections += connection->failed;
+		close(connection->fd);
+	}
+
+	//report
+	std::uint64_t total = 0;
+	for (int op = 0; op < loadOpCount; op++) {
+		total += run.completed[op] + run.notFound[op] + run.failed[op];
+		all.Merge(*run.latency[op]);
+	}
+
+	std::cout << "\n" << total << " answers in " << seconds << "s (" << total / seconds << " requests/s";
+	if (spec.rate > 0) {
+		std::cout << ", target " << spec.rate;
+	}
+	std::cout << ")\n";
+
+	for (int op = 0; op < loadOpCount; op++) {
+		std::uint64_t answered = run.completed[op] + run.notFound[op] + run.failed[op];
+		std::cout << loadOpNames[op] << ": sent " << run.sent[op] << ", answered " << answered << " (" << answered / seconds << "/s)"
+			<< ", not found " << run.notFound[op] << ", failed " << run.failed[op] << "\n";
+	}
+	std::cout << "transfers accepted " << run.submitResults[0] << ", same account " << run.submitResults[1]
+		<< ", insufficient funds " << run.submitResults[2] << ", bad receipt " << run.submitResults[3] << "\n"
+		<< "unanswered " << run.unanswered << ", connections lost " << failedConnections << std::endl;
+
+	for (int op = 0; op < loadOpCount; op++) {
+		run.latency[op]->WriteText(std::cout);
+	}
+	all.WriteText(std::cout);
+
+	if (latencyFile) {
+		//one histogram per line
+		std::ofstream os(latencyFile);
+		for (int op = 0; op < loadOpCount; op++) {
+			run.latency[op]->WriteJson(os);
+			os << "\n";
+		}
+		all.WriteJson(os);
+		os << "\n";
+		if (!os.good()) {
+			std::cerr << "failed to write latencies to " << latencyFile << std::endl;
+		}
+	}
+
+	return failedConnections == 0 ? 0 : 1;
+}
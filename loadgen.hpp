@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+//load generator for "sixpence serve"
+//opens many connections, keeps up to pipeline requests outstanding on each, and sends a mix of
+//transfers, balance queries and block fetches, either open-loop at a target rate or closed-loop
+//open-loop latency runs from when each request was due, including any time it spent waiting for a
+//pipeline slot, so a stalled server shows up in the percentiles (no coordinated omission)
+//with batch above 1, requests are gathered into BATCH frames of up to that many, and a frame is sent
+//at the latest when the thread next waits for answers
+
+struct LoadSpec {
+	std::string address = "unix:/tmp/sixpence.sock"; //see resolveAddress()
+	unsigned connections = 64;
+	unsigned threads = 1; //client threads, each with its own epoll over a share of the connections
+	unsigned pipeline = 16; //requests outstanding per connection
+	unsigned batch = 1; //requests per frame; above 1 they go in BATCH frames and are answered out of order
+	double rate = 0; //requests per second across all connections, 0 runs closed-loop
+	double duration = 5; //seconds
+	double submitFraction = 0.1; //share of requests that are transfers
+	double blockFraction = 0.1; //share that fetch a block, the rest are balance queries
+	double generateFraction = 0.1; //share of transfers that mint new coins
+	unsigned accounts = 1000;
+	double zipfExponent = 1.1; //activity skew, 0 is uniform
+	double meanAmount = 50;
+	unsigned preload = 100; //accounts funded before the clock starts
+	std::uint64_t seed = 1;
+};
+
+bool parseLoadSpec(std::istream& is, LoadSpec& spec, std::string& error);
+bool setLoadOption(LoadSpec& spec, std::string const& key, std::string const& value, std::string& error);
+void writeLoadSpec(std::ostream& os, LoadSpec const& spec);
+
+//"sixpence loadgen [spec-file] [key=value ...] [--latency-json file]"
+int loadgenMain(int argc, char* argv[]);
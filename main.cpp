@@ -1,292 +1,175 @@
-#include <chrono>
+#include <cstdlib>
 #include <cstring>
+#include <fstream>
 #include <iostream>
-#include <type_traits>
-#include <vector>
-
+#include <string>
+
+#include <unistd.h>
+
+#include "alloc_tracker.hpp"
+#include "block_log.hpp"
+#include "columnar.hpp"
+#include "export.hpp"
+#include "generator.hpp"
+#include "histogram.hpp"
+#include "job_board.hpp"
+#include "loadgen.hpp"
+#include "ledger.hpp"
+#include "metrics.hpp"
+#include "mining_checkpoint.hpp"
+#include "mining_pool.hpp"
+#include "perf_counters.hpp"
 #include "profile_timer.hpp"
+#include "profiler.hpp"
+#include "replication.hpp"
+#include "server.hpp"
+#include "trace.hpp"
+#include "workload.hpp"
 
-//types to be used
-typedef std::chrono::high_resolution_clock Clock;
-
-//the type of transaction
-enum class TransactionType {
-	INVALID = -1,
-	GENERATE = 0,
-	TRANSFER = 1,
-	RECEIPT = 2,
-};
-
-//the amount to transfer to a new account
-constexpr int blankSize = 4 * sizeof(unsigned);
-struct Blank {
-	TransactionType type;
-	unsigned char unused[blankSize];
-};
-
-struct Transfer {
-	TransactionType type;
-	unsigned senderAccount;
-	unsigned receiverAccount;
-	unsigned prevReceipt; //prove this sender received coins previously (block index)
-	unsigned amount; //amount to be transferred
-};
-
-struct Receipt {
-	TransactionType type;
-	unsigned account; //account to receive
-	unsigned prevReceipt; //prior balance (block index)
-	unsigned prevTransfer; //receiving money (block index)
-	unsigned balance; //new balance
-};
-
-union Transaction {
-	TransactionType type; //union signal
-	Blank blank;
-	Transfer transfer;
-	Receipt receipt;
-};
-
-//the building block of the chain
-struct Block {
-	unsigned nonce; //must be first member
-	unsigned threshold; //store my own hash threshold
-	unsigned index;
-	unsigned prevHash;
-	Clock::duration timestamp;
-	Transaction transaction;
-};
-
-//checks
-static_assert(std::is_pod<Transfer>::value, "Transfer is not a POD");
-static_assert(std::is_pod<Receipt>::value, "Receipt is not a POD");
-static_assert(std::is_pod<Transaction>::value, "Transaction is not a POD");
-static_assert(std::is_pod<Block>::value, "Block is not a POD");
-
-//variables for the blockchain proper
-std::vector<Block> blockVector;
-
-//hash a byte array into an unsigned 32-bit integer
-unsigned fnv_hash_1a_32(void *key, int len) {
-	unsigned char *p = static_cast<unsigned char*>(key);
-	unsigned h = 0x811c9dc5;
-	for (int i = 0; i < len; i++) {
-		h = ( h ^ p[i] ) * 0x01000193;
+int main(int argc, char* argv[]) {
+	//subcommands
+	if (argc > 1 && !strcmp(argv[1], "generate")) {
+		return generatorMain(argc - 1, argv + 1);
 	}
-	return h;
-}
-
-Transaction generateBlank(const char data[blankSize]) {
-	Transaction transaction;
-	transaction.type = TransactionType::INVALID;
-	memcpy(&transaction.blank.unused, data, blankSize);
-	return transaction;
-}
-
-Transaction generateTransfer(unsigned sender, unsigned receiver, unsigned amount) {
-	if (sender == receiver || receiver == 0) {
-		return { TransactionType::INVALID };
+	if (argc > 1 && !strcmp(argv[1], "columnar")) {
+		return columnarMain(argc - 1, argv + 1);
 	}
-
-	//info about the sender
-	unsigned balance = 0;
-	unsigned prevSenderReceipt = -1;
-
-	//validate that this sender has money to send (sender = 0 is a special case)
-	if (sender != 0) {
-		for (auto iter = blockVector.rbegin(); iter != blockVector.rend(); iter++) {
-			if (iter->transaction.type == TransactionType::RECEIPT && iter->transaction.receipt.account == sender) {
-				balance = iter->transaction.receipt.balance;
-				prevSenderReceipt = iter->index;
-				break;
-			}
-		}
+	if (argc > 1 && !strcmp(argv[1], "export")) {
+		return exportMain(argc - 1, argv + 1);
 	}
-
-	if (sender != 0 && balance < amount) {
-		return Transaction { TransactionType::INVALID };
+	if (argc > 1 && !strcmp(argv[1], "workload")) {
+		return workloadMain(argc - 1, argv + 1);
 	}
-
-	//return the valid transaction for hashing
-	Transaction transaction;
-	transaction.transfer = {
-		sender == 0 ? TransactionType::GENERATE : TransactionType::TRANSFER,
-		sender,
-		receiver,
-		prevSenderReceipt,
-		amount
-	};
-	return transaction;
-}
-
-Transaction generateReceipt(Block transferBlock) {
-	//accepts generate & transfers
-	if (transferBlock.transaction.type != TransactionType::GENERATE && transferBlock.transaction.type != TransactionType::TRANSFER) {
-		return { TransactionType:: INVALID };
+	if (argc > 1 && !strcmp(argv[1], "tail")) {
+		return tailMain(argc - 1, argv + 1);
 	}
-
-	//info about the receiver
-	unsigned balance = 0;
-	unsigned prevReceiverReceipt = -1;
-
-	//find the receiver's previous balance
-	for (auto iter = blockVector.rbegin(); iter != blockVector.rend(); iter++) {
-		if (iter->transaction.type == TransactionType::RECEIPT && iter->transaction.receipt.account == transferBlock.transaction.transfer.receiverAccount) {
-			balance = iter->transaction.receipt.balance;
-			prevReceiverReceipt = iter->index;
-			break;
-		}
+	if (argc > 1 && !strcmp(argv[1], "serve")) {
+		return serveMain(argc - 1, argv + 1);
 	}
-
-	//return the valid transaction for hashing
-	Transaction transaction;
-	transaction.receipt = {
-		TransactionType::RECEIPT,
-		transferBlock.transaction.transfer.receiverAccount, //account ID
-		prevReceiverReceipt, //prior balance stored here
-		transferBlock.index, //receiving money from here
-		balance + transferBlock.transaction.transfer.amount //new balance
-	};
-	return transaction;
-}
-
-Transaction generateReturn(Block transferBlock, Block receiptBlock) {
-	//accepts generate & transfers
-	if (transferBlock.transaction.type != TransactionType::GENERATE && transferBlock.transaction.type != TransactionType::TRANSFER) {
-		return { TransactionType:: INVALID };
+	if (argc > 1 && !strcmp(argv[1], "loadgen")) {
+		return loadgenMain(argc - 1, argv + 1);
 	}
-
-	//accepts receipts
-	if (receiptBlock.transaction.type != TransactionType::RECEIPT) {
-		return { TransactionType::INVALID };
+	if (argc > 1 && !strcmp(argv[1], "pool")) {
+		return poolMain(argc - 1, argv + 1);
 	}
-
-	//make sure the return can go somewhere correct (GENERATE blocks don't have a correct return address)
-	if (transferBlock.transaction.transfer.prevReceipt == -1) {
-		return { TransactionType::INVALID };
+	if (argc > 1 && !strcmp(argv[1], "miner")) {
+		return minerMain(argc - 1, argv + 1);
 	}
-
-	//get the prior balance
-	unsigned balance = -1;
-
-	for (auto iter = blockVector.rbegin(); iter != blockVector.rend(); iter++) {
-		if (iter->index == transferBlock.transaction.transfer.prevReceipt) {
-			balance = iter->transaction.receipt.balance;
-			break;
-		}
+	if (argc > 1 && !strcmp(argv[1], "board")) {
+		return boardMain(argc - 1, argv + 1);
 	}
-
-	//return the remaining balance to the sender's account
-	Transaction transaction;
-	transaction.receipt = {
-		TransactionType::RECEIPT,
-		transferBlock.transaction.transfer.senderAccount,
-		transferBlock.transaction.transfer.senderAccount,
-		receiptBlock.index,
-		balance - transferBlock.transaction.transfer.amount,
-	};
-	return transaction;
-}
-
-Block generateBlock(Transaction transaction, unsigned prevHash) {
-	static unsigned blockCounter = 0;
-	Block block;
-	block.index = blockCounter++;
-	block.prevHash = prevHash;
-	block.timestamp = Clock::now().time_since_epoch();
-	block.transaction = transaction;
-	return block;
-}
-
-unsigned hashBlock(Block& block, unsigned const threshold) {
-	unsigned hash = -1;
-	block.nonce = 0;
-	block.threshold = threshold;
-
-	while (hash > block.threshold) {
-		block.nonce++;
-		hash = fnv_hash_1a_32(&block, sizeof(Block));
-		if (block.nonce == 0) {
-			block.threshold++; //BUGFIX: increase the threshold if it's done a full loop
-			std::cout << "threshold adjusted" << std::endl;
-		}
-
-		if (block.nonce % 1000000 == 0) {
-			std::cout << block.nonce / 1000000 << std::endl;
-		}
+	if (argc > 1 && !strcmp(argv[1], "board-worker")) {
+		return boardWorkerMain(argc - 1, argv + 1);
 	}
-	std::cout << "hash found" << std::endl;
-	return hash;
-}
-
-//high-level actions
-constexpr unsigned threshold = 1 << 8;
-
-int sendAmount(unsigned sender, unsigned receiver, unsigned amount) {
-	if (sender == receiver || receiver == 0) {
-		return -1;
+	if (argc > 1 && !strcmp(argv[1], "mine")) {
+		return mineMain(argc - 1, argv + 1);
 	}
-
-	Block transfer = generateBlock(generateTransfer(sender, receiver, amount), hashBlock(blockVector.back(), threshold));
-	if (transfer.transaction.type == TransactionType::INVALID) {
-		return -2;
+	if (argc > 1 && !strcmp(argv[1], "replica")) {
+		return replicaMain(argc - 1, argv + 1);
 	}
-
-	Block receipt = generateBlock(generateReceipt(transfer), hashBlock(transfer, threshold));
-	if (receipt.transaction.type == TransactionType::INVALID) {
-		return -3;
+	if (argc > 1 && !strcmp(argv[1], "cluster")) {
+		return clusterMain(argc - 1, argv + 1);
 	}
 
-	Block ret = generateBlock(generateReturn(transfer, receipt), hashBlock(receipt, threshold));
-
-	//once these are finallized, push to the blockchain
-	blockVector.push_back(transfer);
-	blockVector.push_back(receipt);
-
-	//handle returns differently, since invalid returns can be generated by GENERATE blocks
-	if (ret.transaction.type != TransactionType::INVALID) {
-		blockVector.push_back(ret);
+	bool profile = false;
+	const char* traceFile = nullptr;
+	bool latency = false;
+	bool perf = false;
+	std::string metricsFile;
+	int metricsPort = 0;
+	int metricsInterval = 1000;
+	const char* latencyFile = nullptr;
+	bool allocations = false;
+	bool allocationAsserts = false;
+	const char* logFile = nullptr;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--profile")) {
+			profile = true;
+		}
+		else if (!strcmp(argv[i], "--threshold") && i + 1 < argc) {
+			threshold = strtoul(argv[++i], nullptr, 0);
+		}
+		else if (!strcmp(argv[i], "--retarget") && i + 1 < argc) {
+			retargetPolicy.window = strtoul(argv[++i], nullptr, 0);
+		}
+		else if (!strcmp(argv[i], "--block-interval") && i + 1 < argc) {
+			retargetPolicy.interval = std::chrono::milliseconds(strtoul(argv[++i], nullptr, 0));
+		}
+		else if (!strcmp(argv[i], "--quiet")) {
+			verboseMining = false;
+		}
+		else if (!strcmp(argv[i], "--coarse-timestamps")) {
+			coarseTimestamps = true;
+		}
+		else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+			traceFile = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--perf")) {
+			perf = true;
+		}
+		else if (!strcmp(argv[i], "--metrics-file") && i + 1 < argc) {
+			metricsFile = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--metrics-port") && i + 1 < argc) {
+			metricsPort = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "--metrics-interval") && i + 1 < argc) {
+			metricsInterval = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "--latency")) {
+			latency = true;
+		}
+		else if (!strcmp(argv[i], "--latency-json") && i + 1 < argc) {
+			latencyFile = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--alloc")) {
+			allocations = true;
+		}
+		else if (!strcmp(argv[i], "--alloc-assert")) {
+			allocationAsserts = true;
+		}
+		else if (!strcmp(argv[i], "--log") && i + 1 < argc) {
+			logFile = argv[++i];
+		}
 	}
+	LatencyTimer::latencyEnabled.store(latency || latencyFile != nullptr);
+	enablePerfCounters(perf);
+	enableAllocationTracking(allocations);
 
-	return 0;
-}
-
-void printBlock(Block const& block) {
-	std::cout << block.index << " (#" << block.prevHash << "): ";
-
-	//print based on transaction type
-	switch (block.transaction.type) {
-		case TransactionType::INVALID:
-			std::cout << "INVALID" << std::endl;
-		break;
-
-		case TransactionType::GENERATE:
-			std::cout << "GENERATE " << block.transaction.transfer.receiverAccount << " received " << block.transaction.transfer.amount << std::endl;
-		break;
-
-		case TransactionType::TRANSFER:
-			std::cout << "TRANSFER " << block.transaction.transfer.senderAccount << " sent " << block.transaction.transfer.amount << " to " << block.transaction.transfer.receiverAccount << std::endl;
-		break;
-
-		case TransactionType::RECEIPT:
-			std::cout << "RECEIPT " << block.transaction.receipt.account << " now has " << block.transaction.receipt.balance << std::endl;
-		break;
-
-		default:
-			std::cout << "error" << std::endl;
-		break;
+	if (perf && !perfCountersError().empty()) {
+		std::cerr << "hardware counters unavailable (" << perfCountersError() << "), continuing without them" << std::endl;
 	}
-}
+	enableProfiler(profile);
+	enableTrace(traceFile != nullptr);
+	setTraceThreadName("main");
 
-int main(int argc, char* argv[]) {
 	std::cout << "Blank size: " << blankSize << std::endl;
 	std::cout << "Trans size: " << sizeof(Transaction) << std::endl;
 	std::cout << "Block size: " << sizeof(Block) << std::endl;
 
+	MetricsExporter metricsExporter;
+	if ((!metricsFile.empty() || metricsPort > 0) && !metricsExporter.Start(metricsFile, metricsPort, metricsInterval)) {
+		std::cerr << "failed to start the metrics exporter on port " << metricsPort << std::endl;
+	}
+
+	//the demo starts a new chain, so it starts a new log too
+	BlockLogWriter blockLog;
+	if (logFile) {
+		unlink(logFile);
+		if (blockLog.Open(logFile)) {
+			setBlockLog(&blockLog);
+		}
+		else {
+			std::cerr << blockLog.GetError() << ", continuing without a log" << std::endl;
+		}
+	}
+
 	//genesis block
 	{
 		ProfileTimer timer("time taken");
-		blockVector.push_back(generateBlock(generateBlank("Kayne Ruse 2021!"), 42));
+		reserveLedger(1024);
+		pushBlock(generateBlock(generateBlank("Kayne Ruse 2021!"), 42));
+		enableAllocationAsserts(allocationAsserts); //warmed up, nothing past here may allocate
 		sendAmount(0, 1, 50);
 		sendAmount(0, 1, 50);
 		sendAmount(0, 1, 50);
@@ -301,9 +184,50 @@ int main(int argc, char* argv[]) {
 		sendAmount(1, 2, 75);
 	}
 
+	enableAllocationAsserts(false);
+	setBlockLog(nullptr);
+
 	//debug
-	for (Block block : blockVector) {
-		printBlock(block);
+	std::cout.flush();
+	exportChain(blockVector, ExportFormat::TEXT, STDOUT_FILENO, 1);
+
+	if (profile) {
+		printProfileReport(std::cerr);
+	}
+
+	if (perf && perfCountersError().empty()) {
+		for (PerfStat* stat : perfStats) {
+			stat->WriteText(std::cerr);
+		}
+	}
+
+	if (allocations) {
+		for (AllocationStat* stat : allocationStats) {
+			stat->WriteText(std::cerr);
+		}
+	}
+
+	if (latency) {
+		for (LatencyHistogram* histogram : latencyHistograms) {
+			histogram->WriteText(std::cerr);
+		}
+	}
+
+	if (latencyFile) {
+		std::ofstream os(latencyFile);
+		os << "[\n";
+		for (LatencyHistogram* histogram : latencyHistograms) {
+			histogram->WriteJson(os);
+			os << (histogram != latencyHistograms[std::size(latencyHistograms) - 1] ? ",\n" : "\n");
+		}
+		os << "]\n";
+		if (!os.good()) {
+			std::cerr << "failed to write latencies to " << latencyFile << std::endl;
+		}
+	}
+
+	if (traceFile && !writeChromeTrace(traceFile)) {
+		std::cerr << "failed to write trace to " << traceFile << std::endl;
 	}
 
 	return 0;
@@ -0,0 +1,215 @@
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+struct MetricEntry {
+	std::string name;
+	std::string help;
+	std::string labels;
+	const char* type;
+	std::atomic<std::uint64_t> const* counter;
+	std::atomic<std::int64_t> const* gauge;
+};
+
+//function-local so metrics defined in other translation units can register during static init
+static std::mutex& registryMutex() {
+	static std::mutex mutex;
+	return mutex;
+}
+
+//a deque, so entries handed to a concurrent writer stay put when more register
+static std::deque<MetricEntry>& registry() {
+	static std::deque<MetricEntry> entries;
+	return entries;
+}
+
+static void registerMetric(MetricEntry const& entry) {
+	std::lock_guard<std::mutex> lock(registryMutex());
+	registry().push_back(entry);
+}
+
+MetricCounter::MetricCounter(std::string const& name, std::string const& help, std::string const& labels) {
+	registerMetric({ name, help, labels, "counter", &value, nullptr });
+}
+
+MetricGauge::MetricGauge(std::string const& name, std::string const& help, std::string const& labels) {
+	registerMetric({ name, help, labels, "gauge", nullptr, &value });
+}
+
+void writePrometheusText(std::ostream& os) {
+	std::vector<MetricEntry const*> entries;
+	{
+		std::lock_guard<std::mutex> lock(registryMutex());
+		for (MetricEntry const& entry : registry()) {
+			entries.push_back(&entry);
+		}
+	}
+
+	//every sample of a metric family has to follow its HELP and TYPE lines
+	std::stable_sort(entries.begin(), entries.end(), [](MetricEntry const* a, MetricEntry const* b) { return a->name < b->name; });
+
+	std::string previous;
+	for (MetricEntry const* entry : entries) {
+		if (entry->name != previous) {
+			os << "# HELP " << entry->name << ' ' << entry->help << '\n';
+			os << "# TYPE " << entry->name << ' ' << entry->type << '\n';
+			previous = entry->name;
+		}
+
+		os << entry->name;
+		if (!entry->labels.empty()) {
+			os << '{' << entry->labels << '}';
+		}
+		os << ' ';
+		if (entry->counter) {
+			os << entry->counter->load(std::memory_order_relaxed);
+		}
+		else {
+			os << entry->gauge->load(std::memory_order_relaxed);
+		}
+		os << '\n';
+	}
+}
+
+MetricsExporter::~MetricsExporter() {
+	Stop();
+}
+
+bool MetricsExporter::Start(std::string const& fname, int port, int intervalMilliseconds) {
+	this->fname = fname;
+	this->intervalMilliseconds = std::max(intervalMilliseconds, 1);
+
+	if (port > 0) {
+		listenFd = socket(AF_INET, SOCK_STREAM, 0);
+		if (listenFd < 0) {
+			return false;
+		}
+
+		int yes = 1;
+		setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+		sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		if (bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listenFd, 16) < 0) {
+			close(listenFd);
+			listenFd = -1;
+			return false;
+		}
+	}
+
+	running = true;
+	thread = std::thread(&MetricsExporter::Run, this);
+	return true;
+}
+
+void MetricsExporter::Stop() {
+	if (!running.exchange(false)) {
+		return;
+	}
+
+	thread.join();
+
+	//one last snapshot so the file reflects the final state
+	if (!fname.empty()) {
+		WriteFile();
+	}
+
+	if (listenFd >= 0) {
+		close(listenFd);
+		listenFd = -1;
+	}
+}
+
+void MetricsExporter::Run() {
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point nextWrite = Clock::now();
+
+	while (running) {
+		if (!fname.empty() && Clock::now() >= nextWrite) {
+			WriteFile();
+			nextWrite += std::chrono::milliseconds(intervalMilliseconds);
+		}
+
+		int timeout = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(nextWrite - Clock::now()).count());
+		timeout = std::min(std::max(timeout, 0), 100); //wake regularly to notice Stop()
+
+		if (listenFd < 0) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
+			continue;
+		}
+
+		pollfd pfd = { listenFd, POLLIN, 0 };
+		if (poll(&pfd, 1, timeout) > 0 && (pfd.revents & POLLIN)) {
+			int client = accept(listenFd, nullptr, nullptr);
+			if (client >= 0) {
+				ServeClient(client);
+				close(client);
+			}
+		}
+	}
+}
+
+void MetricsExporter::WriteFile() {
+	//write beside the target and rename, so scrapers never see a partial file
+	std::string tmp = fname + ".tmp";
+	{
+		std::ofstream os(tmp);
+		if (!os.is_open()) {
+			return;
+		}
+		writePrometheusText(os);
+	}
+	std::rename(tmp.c_str(), fname.c_str());
+}
+
+void MetricsExporter::ServeClient(int fd) {
+	//any request gets the metrics; read what has arrived so the client isn't reset
+	char request[1024];
+	pollfd pfd = { fd, POLLIN, 0 };
+	if (poll(&pfd, 1, 100) > 0) {
+		if (read(fd, request, sizeof(request)) < 0) {
+			return;
+		}
+	}
+
+	std::ostringstream body;
+	writePrometheusText(body);
+	std::string text = body.str();
+
+	std::ostringstream response;
+	response << "HTTP/1.1 200 OK\r\n"
+		<< "Content-Type: text/plain; version=0.0.4\r\n"
+		<< "Content-Length: " << text.size() << "\r\n"
+		<< "Connection: close\r\n\r\n"
+		<< text;
+
+	std::string out = response.str();
+	const char* p = out.data();
+	std::size_t remaining = out.size();
+	while (remaining > 0) {
+		//a scraper that hangs up early must not raise SIGPIPE, nothing in the process ignores it
+		ssize_t written = send(fd, p, remaining, MSG_NOSIGNAL);
+		if (written <= 0) {
+			return;
+		}
+		p += written;
+		remaining -= written;
+	}
+}
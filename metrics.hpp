@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <thread>
+
+//process-wide counters and gauges, exported in the Prometheus text format
+//metrics register themselves on construction and must live until exit (globals or statics)
+//updating one is a single relaxed atomic operation
+
+class MetricCounter {
+public:
+	//labels are preformatted, e.g. code="-2"
+	MetricCounter(std::string const& name, std::string const& help, std::string const& labels = "");
+
+	MetricCounter(MetricCounter const&) = delete;
+	MetricCounter& operator=(MetricCounter const&) = delete;
+
+	void Increment(std::uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+	std::uint64_t Value() const { return value.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<std::uint64_t> value{0};
+};
+
+class MetricGauge {
+public:
+	MetricGauge(std::string const& name, std::string const& help, std::string const& labels = "");
+
+	MetricGauge(MetricGauge const&) = delete;
+	MetricGauge& operator=(MetricGauge const&) = delete;
+
+	void Set(std::int64_t n) { value.store(n, std::memory_order_relaxed); }
+	void Add(std::int64_t n) { value.fetch_add(n, std::memory_order_relaxed); }
+	std::int64_t Value() const { return value.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<std::int64_t> value{0};
+};
+
+void writePrometheusText(std::ostream& os);
+
+//writes every registered metric at an interval, to a file (replaced atomically, suitable for the
+//node_exporter textfile collector) and/or over HTTP on 127.0.0.1
+class MetricsExporter {
+public:
+	MetricsExporter() = default;
+	~MetricsExporter();
+
+	MetricsExporter(MetricsExporter const&) = delete;
+	MetricsExporter& operator=(MetricsExporter const&) = delete;
+
+	//an empty fname or a port of 0 disables that output; returns false if the port can't be bound
+	bool Start(std::string const& fname, int port, int intervalMilliseconds);
+	void Stop();
+
+private:
+	void Run();
+	void WriteFile();
+	void ServeClient(int fd);
+
+	std::string fname;
+	int listenFd = -1;
+	int intervalMilliseconds = 1000;
+	std::atomic<bool> running{false};
+	std::thread thread;
+};
@@ -0,0 +1,266 @@
+#include "mining_checkpoint.hpp"
+
+#include "mining_pool.hpp"
+#include "process.hpp"
+#include "spec_options.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+//coverage
+void NonceCoverage::Add(std::uint64_t first, std::uint64_t last) {
+	//the first range that ends at or after first - 1, the ranges from there that touch [first, last] merge into it
+	auto it = std::lower_bound(ranges.begin(), ranges.end(), first, [](std::pair<std::uint64_t, std::uint64_t> const& range, std::uint64_t position) {
+		return range.second + 1 < position;
+	});
+	auto end = it;
+	while (end != ranges.end() && (last == UINT64_MAX || end->first <= last + 1)) {
+		first = std::min(first, end->first);
+		last = std::max(last, end->second);
+		++end;
+	}
+	it = ranges.erase(it, end);
+	ranges.insert(it, { first, last });
+}
+
+std::uint64_t NonceCoverage::NextUncovered(std::uint64_t from) const {
+	auto it = std::upper_bound(ranges.begin(), ranges.end(), from, [](std::uint64_t position, std::pair<std::uint64_t, std::uint64_t> const& range) {
+		return position < range.first;
+	});
+	if (it != ranges.begin() && std::prev(it)->second >= from) {
+		return std::prev(it)->second + 1;
+	}
+	return from;
+}
+
+std::uint64_t NonceCoverage::NextCovered(std::uint64_t from) const {
+	auto it = std::upper_bound(ranges.begin(), ranges.end(), from, [](std::uint64_t position, std::pair<std::uint64_t, std::uint64_t> const& range) {
+		return position < range.first;
+	});
+	return it == ranges.end() ? UINT64_MAX : it->first;
+}
+
+std::uint64_t NonceCoverage::Count() const {
+	std::uint64_t count = 0;
+	for (auto const& range : ranges) {
+		count += range.second - range.first + 1;
+	}
+	return count;
+}
+
+//checkpoint files: magic, the template, the threshold, the range count, then the ranges
+static const char checkpointMagic[8] = { 'S', 'P', 'X', 'C', 'K', 'P', 'T', '1' };
+
+bool saveMiningCheckpoint(std::string const& path, MiningCheckpoint const& checkpoint, std::string& error) {
+	std::string tmp = path + ".tmp";
+	{
+		std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+		std::uint32_t threshold = checkpoint.threshold;
+		std::uint64_t count = checkpoint.covered.Ranges().size();
+		os.write(checkpointMagic, sizeof(checkpointMagic));
+		os.write(reinterpret_cast<char const*>(&checkpoint.block), sizeof(Block));
+		os.write(reinterpret_cast<char const*>(&threshold), sizeof(threshold));
+		os.write(reinterpret_cast<char const*>(&count), sizeof(count));
+		for (auto const& range : checkpoint.covered.Ranges()) {
+			std::uint64_t bounds[2] = { range.first, range.second };
+			os.write(reinterpret_cast<char const*>(bounds), sizeof(bounds));
+		}
+		if (!os.good()) {
+			error = "failed to write " + tmp;
+			return false;
+		}
+	}
+	if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+		error = "failed to replace " + path + ": " + strerror(errno);
+		return false;
+	}
+	return true;
+}
+
+bool loadMiningCheckpoint(std::string const& path, MiningCheckpoint& checkpoint, std::string& error) {
+	std::ifstream is(path, std::ios::binary);
+	if (!is.is_open()) {
+		error = "no checkpoint at " + path;
+		return false;
+	}
+
+	char magic[sizeof(checkpointMagic)];
+	std::uint32_t threshold;
+	std::uint64_t count;
+	is.read(magic, sizeof(magic));
+	is.read(reinterpret_cast<char*>(&checkpoint.block), sizeof(Block));
+	is.read(reinterpret_cast<char*>(&threshold), sizeof(threshold));
+	is.read(reinterpret_cast<char*>(&count), sizeof(count));
+	if (!is.good() || memcmp(magic, checkpointMagic, sizeof(magic))) {
+		error = path + " is not a mining checkpoint";
+		return false;
+	}
+	checkpoint.threshold = threshold;
+
+	checkpoint.covered.Clear();
+	for (std::uint64_t i = 0; i < count; i++) {
+		std::uint64_t bounds[2];
+		if (!is.read(reinterpret_cast<char*>(bounds), sizeof(bounds)) || bounds[0] > bounds[1]) {
+			error = path + " is truncated or corrupt";
+			return false;
+		}
+		checkpoint.covered.Add(bounds[0], bounds[1]);
+	}
+	return true;
+}
+
+//mining with checkpoints
+CheckpointedMiner::CheckpointedMiner(std::string const& path, double interval) :
+	path(path),
+	interval(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(interval)))
+{
+	//EMPTY
+}
+
+unsigned CheckpointedMiner::Mine(Block& block, unsigned threshold) {
+	MiningCheckpoint checkpoint;
+	std::string error;
+	if (loadMiningCheckpoint(path, checkpoint, error) && checkpoint.Matches(block, threshold)) {
+		resumed += checkpoint.covered.Count();
+	}
+	else {
+		checkpoint.block = block;
+		checkpoint.threshold = threshold;
+		checkpoint.covered.Clear();
+	}
+
+	//hashBlock's order, from nonce 1 up, a million at a time between checks of the clock
+	auto savedAt = std::chrono::steady_clock::now();
+	std::uint64_t position = 1;
+	for (;;) {
+		position = checkpoint.covered.NextUncovered(position);
+		std::uint64_t last = std::min({ position + 999999, position | UINT_MAX, checkpoint.covered.NextCovered(position) - 1 });
+
+		block.nonce = static_cast<unsigned>(position);
+		block.threshold = threshold + static_cast<unsigned>(position >> 32);
+		unsigned hash = searchNonces(block, static_cast<unsigned>(last), block.threshold);
+		hashes += block.nonce - static_cast<unsigned>(position) + 1;
+		if (hash <= block.threshold) {
+			unlink(path.c_str());
+			return hash;
+		}
+
+		checkpoint.covered.Add(position, last);
+		position = last + 1;
+
+		if (std::chrono::steady_clock::now() - savedAt >= interval) {
+			if (!saveMiningCheckpoint(path, checkpoint, error)) {
+				std::cerr << error << std::endl;
+			}
+			saves++;
+			savedAt = std::chrono::steady_clock::now();
+		}
+	}
+}
+
+int mineMain(int argc, char* argv[]) {
+	std::string path;
+	unsigned mineThreshold = 1 << 4;
+	unsigned workerCount = 0;
+	MiningPoolOptions options;
+	options.listen = "unix:/tmp/sixpence-mine-" + std::to_string(getpid()) + ".sock";
+	unsigned seconds = 0;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		std::size_t equals = arg.find('=');
+		std::string key = arg.substr(0, equals);
+		std::string value = equals == std::string::npos ? "" : arg.substr(equals + 1);
+
+		bool ok = true;
+		if (equals == std::string::npos) ok = false;
+		else if (key == "checkpoint") ok = !(path = value).empty();
+		else if (key == "threshold") ok = parseOptionNumber(value, mineThreshold);
+		else if (key == "workers") ok = parseOptionNumber(value, workerCount);
+		else if (key == "range") ok = parseOptionNumber(value, options.rangeNonces) && options.rangeNonces > 0;
+		else if (key == "interval") ok = parseOptionNumber(value, options.checkpointInterval);
+		else if (key == "seconds") ok = parseOptionNumber(value, seconds);
+		else ok = false;
+
+		if (!ok) {
+			path.clear();
+			break;
+		}
+	}
+	if (path.empty()) {
+		std::cerr << "usage: sixpence mine checkpoint=file [threshold=N] [workers=N] [range=N] [interval=seconds] [seconds=N]" << std::endl;
+		return 1;
+	}
+
+	//a new block, unless there's a checkpoint to carry on from, saved straight away so its template is kept
+	MiningCheckpoint checkpoint;
+	std::string error;
+	if (loadMiningCheckpoint(path, checkpoint, error)) {
+		std::cout << "resuming block " << checkpoint.block.index << " at threshold 0x" << std::hex << checkpoint.threshold << std::dec
+			<< ", " << checkpoint.covered.Count() << " nonces covered" << std::endl;
+	}
+	else {
+		checkpoint.block = generateBlock(generateBlank("sixpence mine!!!"), 42);
+		checkpoint.threshold = mineThreshold;
+		checkpoint.covered.Clear();
+		if (!saveMiningCheckpoint(path, checkpoint, error)) {
+			std::cerr << error << std::endl;
+			return 1;
+		}
+		std::cout << "new block at threshold 0x" << std::hex << checkpoint.threshold << std::dec << std::endl;
+	}
+
+	//the default action, so the run ends as abruptly as a crash would
+	if (seconds > 0) {
+		alarm(seconds);
+	}
+
+	Block block = checkpoint.block;
+	unsigned hash;
+	std::uint64_t hashes;
+	auto start = std::chrono::steady_clock::now();
+	std::vector<pid_t> pids;
+	if (workerCount > 0) {
+		options.checkpoint = path;
+		MiningPool pool(options);
+		if (!pool.Start(error)) {
+			std::cerr << error << std::endl;
+			return 1;
+		}
+		for (unsigned i = 0; i < workerCount; i++) {
+			pids.push_back(spawnSelf({ "sixpence", "miner", "--pool", options.listen }));
+		}
+		if (!pool.WaitForWorkers(workerCount, 5)) {
+			std::cerr << "only " << pool.WorkerCount() << " of " << workerCount << " workers connected, carrying on" << std::endl;
+		}
+		hash = pool.Mine(block, checkpoint.threshold);
+		pool.Finish();
+		hashes = pool.Hashes();
+		pool.WriteReport(std::cout);
+	}
+	else {
+		CheckpointedMiner miner(path, options.checkpointInterval);
+		hash = miner.Mine(block, checkpoint.threshold);
+		hashes = miner.Hashes();
+	}
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	alarm(0);
+
+	//the pool hanging up tells the workers to exit
+	for (pid_t pid : pids) {
+		waitpid(pid, nullptr, 0);
+	}
+
+	bool valid = fnv_hash_1a_32(&block, sizeof(Block)) == hash && hash <= block.threshold;
+	std::cout << "mined nonce " << block.nonce << " at threshold 0x" << std::hex << block.threshold << ", hash 0x" << hash << std::dec
+		<< ", " << hashes << " hashes in " << elapsed << "s, " << (valid ? "verified" : "FAILED verification") << std::endl;
+	return valid ? 0 : 1;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ledger.hpp"
+
+//mining that survives a restart
+//a long search is saved every so often as its block template and the nonces it has covered, and a
+//search for the same template at the same threshold picks up from there instead of starting over
+//nonces are numbered across hashBlock's threshold raises as positions, extra nonce << 32 | nonce, the
+//block being mined at threshold + extra nonce (see mining_pool.hpp); a pool tracks the range each of its
+//workers is searching and only counts a range once it's finished, so no range is searched twice
+
+//positions searched, as sorted, disjoint, inclusive ranges
+class NonceCoverage {
+public:
+	void Add(std::uint64_t first, std::uint64_t last);
+	void Clear() { ranges.clear(); }
+
+	//the first position at or after from that isn't covered
+	std::uint64_t NextUncovered(std::uint64_t from) const;
+
+	//the first covered position after from, UINT64_MAX when there's none
+	std::uint64_t NextCovered(std::uint64_t from) const;
+
+	std::uint64_t Count() const; //positions covered
+	std::vector<std::pair<std::uint64_t, std::uint64_t>> const& Ranges() const { return ranges; }
+
+private:
+	std::vector<std::pair<std::uint64_t, std::uint64_t>> ranges;
+};
+
+struct MiningCheckpoint {
+	Block block; //the template
+	unsigned threshold; //the base threshold it's being mined at
+	NonceCoverage covered;
+
+	bool Matches(Block const& other, unsigned otherThreshold) const {
+		return threshold == otherThreshold && sameBlockTemplate(block, other);
+	}
+};
+
+//written beside path and renamed over it, so a crash leaves either the old checkpoint or the new one
+bool saveMiningCheckpoint(std::string const& path, MiningCheckpoint const& checkpoint, std::string& error);
+
+//false when there's no checkpoint at path or it can't be read
+bool loadMiningCheckpoint(std::string const& path, MiningCheckpoint& checkpoint, std::string& error);
+
+//hashBlock, saving its progress to a checkpoint every interval and resuming from one that matches
+//it tries nonces in hashBlock's order, so from a checkpoint of its own it mines the block hashBlock would
+class CheckpointedMiner : public BlockMiner {
+public:
+	CheckpointedMiner(std::string const& path, double interval);
+
+	unsigned Mine(Block& block, unsigned threshold) override;
+
+	std::uint64_t Hashes() const { return hashes; }
+	std::uint64_t Resumed() const { return resumed; } //nonces skipped because a checkpoint covered them
+	std::uint64_t Saves() const { return saves; }
+
+private:
+	std::string path;
+	std::chrono::steady_clock::duration interval;
+	std::uint64_t hashes = 0;
+	std::uint64_t resumed = 0;
+	std::uint64_t saves = 0;
+};
+
+//"sixpence mine checkpoint=file [threshold=N] [workers=N] [range=N] [interval=seconds] [seconds=N]"
+//mines one block, resuming the checkpoint's when there is one; seconds=N kills the process with SIGALRM
+//after that long, to be run again to resume, and workers=N mines through a pool of that many workers
+int mineMain(int argc, char* argv[]);
@@ -0,0 +1,524 @@
+#include "mining_pool.hpp"
+
+#include "process.hpp"
+#include "random.hpp"
+#include "spec_options.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <iostream>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static std::int64_t nanosecondsNow() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+MiningPool::MiningPool(MiningPoolOptions const& options) : options(options) {
+	//EMPTY
+}
+
+MiningPool::~MiningPool() {
+	for (std::unique_ptr<Worker>& worker : workers) {
+		close(worker->fd);
+	}
+	if (listenFd >= 0) {
+		close(listenFd);
+	}
+	if (!unixPath.empty()) {
+		unlink(unixPath.c_str());
+	}
+}
+
+bool MiningPool::Start(std::string& error) {
+	options.rangeNonces = std::max<std::uint32_t>(options.rangeNonces, 1);
+	listenFd = listenOn(options.listen, false, unixPath, error);
+	return listenFd >= 0;
+}
+
+bool MiningPool::WaitForWorkers(std::size_t count, double seconds) {
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+	while (workers.size() < count && std::chrono::steady_clock::now() < deadline) {
+		Poll(50);
+	}
+	return workers.size() >= count;
+}
+
+unsigned MiningPool::Mine(Block& block, unsigned threshold) {
+	if (workers.empty()) {
+		localBlocks++;
+		blocks++;
+		return hashBlock(block, threshold);
+	}
+
+	job++;
+	current = block;
+	baseThreshold = threshold;
+	extraNonce = 0;
+	nextPosition = 1; //hashBlock's first nonce, nonce 0 only comes round again once the threshold's raised
+	solved = false;
+
+	covered.Clear();
+	coveredChanged = false;
+	savedAt = std::chrono::steady_clock::now();
+	if (!options.checkpoint.empty()) {
+		MiningCheckpoint checkpoint;
+		std::string error;
+		if (loadMiningCheckpoint(options.checkpoint, checkpoint, error) && checkpoint.Matches(block, threshold)) {
+			covered = checkpoint.covered;
+			resumed += covered.Count();
+		}
+	}
+
+	//workers still finishing the last job get the stop first, so they can start on this one straight away
+	for (std::unique_ptr<Worker>& worker : workers) {
+		Assign(*worker);
+	}
+
+	while (!solved) {
+		if (workers.empty()) {
+			localBlocks++;
+			blocks++;
+			return hashBlock(block, threshold);
+		}
+		Poll(1000);
+		if (!options.checkpoint.empty() && coveredChanged && std::chrono::steady_clock::now() - savedAt >= std::chrono::duration<double>(options.checkpointInterval)) {
+			SaveCheckpoint();
+		}
+	}
+	if (!options.checkpoint.empty()) {
+		unlink(options.checkpoint.c_str());
+	}
+
+	//the solver is holding on to it until this arrives too
+	MiningStop stop = { job, nanosecondsNow() };
+	for (std::unique_ptr<Worker>& worker : workers) {
+		sendFrame(worker->fd, Op::STOP, stop);
+	}
+
+	blocks++;
+	block.nonce = current.nonce;
+	block.threshold = current.threshold;
+	return solution;
+}
+
+void MiningPool::Finish() {
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+	auto busy = [this] {
+		return std::any_of(workers.begin(), workers.end(), [](std::unique_ptr<Worker> const& worker) { return worker->busy; });
+	};
+	while (busy() && std::chrono::steady_clock::now() < deadline) {
+		Poll(50);
+	}
+}
+
+void MiningPool::WriteReport(std::ostream& os) const {
+	os << "pool: " << blocks << " blocks, " << localBlocks << " mined locally, " << hashes << " hashes reported by "
+		<< workers.size() << " workers, " << staleShares << " stale shares, " << badShares << " bad shares\n";
+	if (resumed > 0 || returnedRanges > 0) {
+		os << resumed << " nonces resumed from checkpoints, " << returnedRanges << " ranges given back by workers that went\n";
+	}
+	for (std::size_t i = 0; i < workers.size(); i++) {
+		Worker const& worker = *workers[i];
+		os << "worker " << i + 1 << ": " << worker.hashes << " hashes, " << worker.ranges << " ranges, "
+			<< worker.shares << " shares, " << worker.solutions << " solutions\n";
+	}
+	stopLatency.WriteText(os);
+}
+
+void MiningPool::Accept() {
+	int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+	if (fd < 0) {
+		return;
+	}
+
+	//fails harmlessly on Unix sockets
+	int yes = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+	workers.emplace_back(new Worker());
+	workers.back()->fd = fd;
+	if (!solved) {
+		Assign(*workers.back());
+	}
+}
+
+bool MiningPool::Receive(Worker& worker) {
+	char buffer[4096];
+	for (;;) {
+		ssize_t received = recv(worker.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+		if (received > 0) {
+			worker.input.insert(worker.input.end(), buffer, buffer + received);
+			continue;
+		}
+		if (received < 0 && errno == EINTR) {
+			continue;
+		}
+		if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			break;
+		}
+		return false;
+	}
+
+	std::size_t at = 0;
+	FrameHeader header;
+	while (std::size_t size = frameSize(worker.input.data() + at, worker.input.size() - at, header)) {
+		if (!Handle(worker, header, worker.input.data() + at + sizeof(FrameHeader))) {
+			return false;
+		}
+		at += size;
+	}
+	if (worker.input.size() - at >= sizeof(FrameHeader) && header.length > maxFramePayload) {
+		return false;
+	}
+	worker.input.erase(worker.input.begin(), worker.input.begin() + at);
+	return true;
+}
+
+bool MiningPool::Handle(Worker& worker, FrameHeader const& header, char const* payload) {
+	if (header.op == Op::SHARE && header.length == sizeof(MiningShare)) {
+		MiningShare share;
+		memcpy(&share, payload, sizeof(share));
+		if (share.job != job || solved) {
+			staleShares++;
+			return true;
+		}
+
+		//check it, the threshold has to be one this job's ranges were handed out with
+		Block block = current;
+		block.nonce = share.nonce;
+		block.threshold = share.threshold;
+		unsigned hash = fnv_hash_1a_32(&block, sizeof(Block));
+		if (share.threshold < baseThreshold || share.threshold - baseThreshold > extraNonce || hash != share.hash || hash > ShareThreshold(share.threshold)) {
+			badShares++;
+			return true;
+		}
+
+		worker.shares++;
+		if (hash <= block.threshold) {
+			worker.solutions++;
+			current = block;
+			solution = hash;
+			solved = true;
+		}
+		return true;
+	}
+
+	if (header.op == Op::JOB_DONE && header.length == sizeof(MiningReport)) {
+		MiningReport report;
+		memcpy(&report, payload, sizeof(report));
+		worker.hashes += report.hashes;
+		hashes += report.hashes;
+		if (report.stopNanoseconds > 0) {
+			stopLatency.Record(report.stopNanoseconds);
+		}
+
+		//a report for an older job is just its hashes, the worker has been given this one since
+		//for the job being mined, a report means the range is finished, a stop only comes once it's solved
+		if (report.job == worker.job) {
+			worker.busy = false;
+			if (report.job == job && !solved) {
+				covered.Add(worker.first, worker.last);
+				coveredChanged = true;
+				Assign(worker);
+			}
+		}
+		return true;
+	}
+
+	return false;
+}
+
+void MiningPool::Assign(Worker& worker) {
+	//up to the next range that's covered or taken, and within one extra nonce
+	std::uint64_t first = NextFree();
+	std::uint64_t last = std::min({ first + options.rangeNonces - 1, first | UINT_MAX, covered.NextCovered(first) - 1 });
+	for (std::unique_ptr<Worker> const& other : workers) {
+		if (other->busy && other->job == job && other->first > first) {
+			last = std::min(last, other->first - 1);
+		}
+	}
+	nextPosition = last + 1;
+	extraNonce = std::max(extraNonce, static_cast<unsigned>(first >> 32));
+
+	MiningJob message = {};
+	message.job = job;
+	message.block = current;
+	message.block.threshold = baseThreshold + static_cast<unsigned>(first >> 32);
+	message.firstNonce = static_cast<std::uint32_t>(first);
+	message.lastNonce = static_cast<std::uint32_t>(last);
+	message.shareThreshold = ShareThreshold(message.block.threshold);
+
+	worker.job = job;
+	worker.first = first;
+	worker.last = last;
+	worker.busy = true;
+	worker.ranges++;
+	sendFrame(worker.fd, Op::JOB, message);
+}
+
+void MiningPool::Poll(int timeout) {
+	std::vector<pollfd> fds;
+	fds.push_back({ listenFd, POLLIN, 0 });
+	for (std::unique_ptr<Worker>& worker : workers) {
+		fds.push_back({ worker->fd, POLLIN, 0 });
+	}
+
+	if (poll(fds.data(), fds.size(), timeout) <= 0) {
+		return;
+	}
+
+	//backwards, so a worker that has gone can be dropped without upsetting the ones still to check
+	for (std::size_t i = fds.size() - 1; i > 0; i--) {
+		if (fds[i].revents && !Receive(*workers[i - 1])) {
+			Worker const& gone = *workers[i - 1];
+			if (gone.busy && gone.job == job && !solved) {
+				nextPosition = std::min(nextPosition, gone.first);
+				returnedRanges++;
+			}
+			close(gone.fd);
+			workers.erase(workers.begin() + (i - 1));
+		}
+	}
+	if (fds[0].revents & POLLIN) {
+		Accept();
+	}
+}
+
+unsigned MiningPool::ShareThreshold(unsigned threshold) const {
+	return static_cast<unsigned>(std::min<std::uint64_t>(((std::uint64_t(threshold) + 1) << options.shareBits) - 1, UINT_MAX));
+}
+
+std::uint64_t MiningPool::NextFree() const {
+	std::uint64_t position = nextPosition;
+	for (bool moved = true; moved; ) {
+		moved = false;
+		position = covered.NextUncovered(position);
+		for (std::unique_ptr<Worker> const& worker : workers) {
+			if (worker->busy && worker->job == job && worker->first <= position && position <= worker->last) {
+				position = worker->last + 1;
+				moved = true;
+			}
+		}
+	}
+	return position;
+}
+
+void MiningPool::SaveCheckpoint() {
+	MiningCheckpoint checkpoint = { current, baseThreshold, covered };
+	std::string error;
+	if (!saveMiningCheckpoint(options.checkpoint, checkpoint, error)) {
+		std::cerr << error << std::endl;
+	}
+	coveredChanged = false;
+	savedAt = std::chrono::steady_clock::now();
+}
+
+MiningRun mineTransfers(BlockMiner& miner, std::uint64_t transfers, unsigned miningThreshold, unsigned accounts, std::uint64_t seed, char const genesis[blankSize]) {
+	unsigned previousThreshold = threshold;
+	bool previousVerbose = verboseMining;
+	threshold = miningThreshold;
+	verboseMining = false;
+
+	resetLedger();
+	reserveLedger(transfers * 3 + 1);
+	pushBlock(generateBlock(generateBlank(genesis), 42));
+
+	setBlockMiner(&miner);
+	auto start = std::chrono::steady_clock::now();
+	for (std::uint64_t i = 0; i < transfers; i++) {
+		unsigned sender = splitmix64(seed) % 4 == 0 ? 0 : 1 + splitmix64(seed) % accounts;
+		sendAmount(sender, 1 + splitmix64(seed) % accounts, exponentialAmount(seed, 50));
+	}
+	MiningRun run;
+	run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	setBlockMiner(nullptr);
+
+	threshold = previousThreshold;
+	verboseMining = previousVerbose;
+
+	run.valid = verifyChain(blockVector) == blockVector.size();
+	return run;
+}
+
+int poolMain(int argc, char* argv[]) {
+	MiningPoolOptions options;
+	options.listen = "unix:/tmp/sixpence-pool-" + std::to_string(getpid()) + ".sock";
+	unsigned workerCount = 2;
+	unsigned expect = 0;
+	std::uint64_t transfers = 200;
+	unsigned poolThreshold = 1 << 12;
+	unsigned accounts = 50;
+	std::uint64_t seed = 1;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		std::size_t equals = arg.find('=');
+		std::string key = arg.substr(0, equals);
+		std::string value = equals == std::string::npos ? "" : arg.substr(equals + 1);
+
+		bool ok = true;
+		if (equals == std::string::npos) ok = false;
+		else if (key == "workers") ok = parseOptionNumber(value, workerCount);
+		else if (key == "expect") ok = parseOptionNumber(value, expect);
+		else if (key == "transfers") ok = parseOptionNumber(value, transfers);
+		else if (key == "threshold") ok = parseOptionNumber(value, poolThreshold);
+		else if (key == "share_bits") ok = parseOptionNumber(value, options.shareBits) && options.shareBits < 32;
+		else if (key == "range") ok = parseOptionNumber(value, options.rangeNonces);
+		else if (key == "listen") options.listen = value;
+		else if (key == "accounts") ok = parseOptionNumber(value, accounts) && accounts > 0;
+		else if (key == "seed") ok = parseOptionNumber(value, seed);
+		else ok = false;
+
+		if (!ok) {
+			std::cerr << "usage: sixpence pool [workers=N] [expect=N] [transfers=N] [threshold=N] [share_bits=N] [range=N] [listen=address] [accounts=N] [seed=N]" << std::endl;
+			return 1;
+		}
+	}
+	if (expect == 0) {
+		expect = workerCount;
+	}
+
+	std::vector<pid_t> pids;
+	double seconds;
+	bool valid;
+	{
+		MiningPool pool(options);
+		std::string error;
+		if (!pool.Start(error)) {
+			std::cerr << error << std::endl;
+			return 1;
+		}
+
+		for (unsigned i = 0; i < workerCount; i++) {
+			pids.push_back(spawnSelf({ "sixpence", "miner", "--pool", options.listen }));
+		}
+		if (!pool.WaitForWorkers(expect, workerCount > 0 ? 5 : 60)) {
+			std::cerr << "only " << pool.WorkerCount() << " of " << expect << " workers connected, carrying on" << std::endl;
+		}
+		std::cout << "listening on " << options.listen << ", " << pool.WorkerCount() << " workers, threshold 0x" << std::hex << poolThreshold << std::dec << std::endl;
+
+		MiningRun run = mineTransfers(pool, transfers, poolThreshold, accounts, seed, "sixpence pool!!!");
+		seconds = run.seconds;
+		valid = run.valid;
+
+		pool.Finish();
+		//rejected transfers mine blocks too, they just never reach the chain
+		std::cout << pool.Blocks() << " blocks mined in " << seconds << "s (" << pool.Blocks() / seconds << " blocks/s, "
+			<< pool.Hashes() / seconds / 1e6 << " Mhash/s across the workers), chain of " << blockVector.size() << " blocks "
+			<< (valid ? "verified" : "FAILED verification") << "\n";
+		pool.WriteReport(std::cout);
+		std::cout.flush();
+	}
+
+	//the pool hanging up tells the workers to exit
+	for (pid_t pid : pids) {
+		waitpid(pid, nullptr, 0);
+	}
+	return valid ? 0 : 1;
+}
+
+int minerMain(int argc, char* argv[]) {
+	std::string address;
+	std::uint32_t chunk = 1 << 15; //nonces between checks for a stop
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--pool") && i + 1 < argc) {
+			address = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--chunk") && i + 1 < argc) {
+			chunk = std::max(1, atoi(argv[++i]));
+		}
+		else {
+			address.clear();
+			break;
+		}
+	}
+	if (address.empty()) {
+		std::cerr << "usage: sixpence miner --pool address [--chunk nonces]" << std::endl;
+		return 1;
+	}
+
+	std::string error;
+	int fd = connectToServer(address, error);
+	if (fd < 0) {
+		std::cerr << "miner: " << error << std::endl;
+		return 1;
+	}
+
+	enum class State { IDLE, SEARCHING, HOLDING };
+	State state = State::IDLE;
+	MiningJob job = {};
+	Block block = {};
+	std::uint64_t unreported = 0;
+
+	auto report = [&](std::uint64_t stopNanoseconds) {
+		MiningReport message = { job.job, unreported, stopNanoseconds };
+		sendFrame(fd, Op::JOB_DONE, message);
+		unreported = 0;
+		state = State::IDLE;
+	};
+
+	for (;;) {
+		if (state == State::SEARCHING) {
+			unsigned first = block.nonce;
+			unsigned last = job.lastNonce - first < chunk ? job.lastNonce : first + chunk - 1;
+			unsigned hash = searchNonces(block, last, job.shareThreshold);
+			unreported += std::uint64_t(block.nonce - first) + 1;
+
+			if (hash <= job.shareThreshold) {
+				MiningShare share = { job.job, block.nonce, block.threshold, hash, 0 };
+				sendFrame(fd, Op::SHARE, share);
+				if (hash <= block.threshold) {
+					state = State::HOLDING;
+				}
+			}
+			if (state == State::SEARCHING) {
+				if (block.nonce == job.lastNonce) {
+					report(0);
+				}
+				else {
+					block.nonce++;
+				}
+			}
+
+			pollfd pfd = { fd, POLLIN, 0 };
+			if (state == State::SEARCHING && poll(&pfd, 1, 0) <= 0) {
+				continue;
+			}
+		}
+
+		FrameHeader header;
+		char payload[256];
+		if (!readExact(fd, &header, sizeof(header)) || header.length > sizeof(payload) || !readExact(fd, payload, header.length)) {
+			break;
+		}
+
+		if (header.op == Op::JOB && header.length == sizeof(MiningJob)) {
+			memcpy(&job, payload, sizeof(job));
+			block = job.block;
+			block.nonce = job.firstNonce;
+			state = State::SEARCHING;
+		}
+		else if (header.op == Op::STOP && header.length == sizeof(MiningStop)) {
+			MiningStop stop;
+			memcpy(&stop, payload, sizeof(stop));
+			if (state != State::IDLE && stop.job == job.job) {
+				report(std::max<std::int64_t>(nanosecondsNow() - stop.sentAt, 1));
+			}
+		}
+		else {
+			break;
+		}
+	}
+
+	close(fd);
+	return 0;
+}
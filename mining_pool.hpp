@@ -0,0 +1,124 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "histogram.hpp"
+#include "ledger.hpp"
+#include "mining_checkpoint.hpp"
+#include "protocol.hpp"
+
+//mining spread over worker processes, on this host or on "hosts" reached over loopback
+//the coordinator is the ledger's BlockMiner: each block becomes a job, and each worker gets a disjoint
+//range of it at a time, (extra nonce, first nonce, last nonce), asking for the next range when done
+//the extra nonce is hashBlock's own fallback once every 32-bit nonce has failed, raising the threshold
+//by one, so a pooled chain is exactly a chain hashBlock could have mined
+//workers send a share for every hash under a threshold 2^shareBits times easier than the block's, so
+//the coordinator sees every worker's progress; a share under the block's threshold solves the job, and
+//the coordinator tells every worker to stop straight away
+//workers search with the same kernel as hashBlock, searchNonces(), checking for a stop between chunks
+//a range only counts as covered once its worker reports it finished; a worker that goes before then
+//gives its range back, and ranges are handed out lowest first, skipping any a checkpoint has covered
+
+struct MiningPoolOptions {
+	std::string listen; //see resolveAddress()
+	unsigned shareBits = 4;
+	std::uint32_t rangeNonces = 1 << 22; //nonces per range handed out
+	std::string checkpoint; //where each job's finished ranges are saved, see mining_checkpoint.hpp
+	double checkpointInterval = 1; //seconds
+};
+
+class MiningPool : public BlockMiner {
+public:
+	MiningPool(MiningPoolOptions const& options);
+	~MiningPool();
+
+	MiningPool(MiningPool const&) = delete;
+	MiningPool& operator=(MiningPool const&) = delete;
+
+	bool Start(std::string& error);
+
+	//accept workers until there are count of them, false if they don't all arrive in time
+	bool WaitForWorkers(std::size_t count, double seconds);
+
+	//hands the block out, or mines it here with hashBlock when there are no workers
+	unsigned Mine(Block& block, unsigned threshold) override;
+
+	//wait for the reports still owed for the last job; the workers exit when the pool is destroyed
+	void Finish();
+
+	std::size_t WorkerCount() const { return workers.size(); }
+	std::uint64_t Blocks() const { return blocks; }
+	std::uint64_t Hashes() const { return hashes; }
+	void WriteReport(std::ostream& os) const;
+
+private:
+	struct Worker {
+		int fd;
+		std::vector<char> input;
+		std::uint64_t job = 0; //of the last range handed out
+		std::uint64_t first = 0; //that range, as positions, see mining_checkpoint.hpp
+		std::uint64_t last = 0;
+		bool busy = false; //searching it, or holding a solution until the stop
+		std::uint64_t hashes = 0;
+		std::uint64_t shares = 0;
+		std::uint64_t solutions = 0;
+		std::uint64_t ranges = 0;
+	};
+
+	void Accept();
+	bool Receive(Worker& worker); //false once the worker has gone
+	bool Handle(Worker& worker, FrameHeader const& header, char const* payload);
+	void Assign(Worker& worker);
+	void Poll(int timeout);
+	unsigned ShareThreshold(unsigned threshold) const;
+	std::uint64_t NextFree() const; //the lowest position not covered or being searched
+	void SaveCheckpoint();
+
+	MiningPoolOptions options;
+	int listenFd = -1;
+	std::string unixPath;
+	std::vector<std::unique_ptr<Worker>> workers;
+
+	//the job being mined
+	std::uint64_t job = 0;
+	Block current;
+	unsigned baseThreshold = 0;
+	unsigned extraNonce = 0; //the highest handed out
+	std::uint64_t nextPosition = 0; //nothing under it is free
+	NonceCoverage covered;
+	bool coveredChanged = false;
+	std::chrono::steady_clock::time_point savedAt;
+	bool solved = true;
+	unsigned solution = 0;
+
+	std::uint64_t blocks = 0;
+	std::uint64_t hashes = 0;
+	std::uint64_t staleShares = 0; //for a job already solved
+	std::uint64_t badShares = 0; //didn't hash to what the worker said
+	std::uint64_t localBlocks = 0; //mined here, for want of workers
+	std::uint64_t resumed = 0; //nonces skipped because a checkpoint covered them
+	std::uint64_t returnedRanges = 0; //given back by workers that went part way through
+	LatencyHistogram stopLatency{"stop latency"};
+};
+
+//the harnesses' load: a new chain of transfers between accounts, a quarter of them minting new coins,
+//mined by miner at the given threshold; the chain is left in blockVector
+struct MiningRun {
+	double seconds;
+	bool valid; //verifyChain passed
+};
+MiningRun mineTransfers(BlockMiner& miner, std::uint64_t transfers, unsigned threshold, unsigned accounts, std::uint64_t seed, char const genesis[blankSize]);
+
+//"sixpence pool [workers=N] [transfers=N] [threshold=N] [share_bits=N] [range=N] [listen=address] [accounts=N] [seed=N]"
+//a coordinator mining a chain of random transfers with workers it spawns; workers=0 waits for
+//expect=N workers started by hand, e.g. "sixpence miner --pool 127.0.0.1:7000" from other shells
+int poolMain(int argc, char* argv[]);
+
+//"sixpence miner --pool address [--chunk nonces]", runs until the coordinator hangs up
+int minerMain(int argc, char* argv[]);
@@ -0,0 +1,189 @@
+#include "perf_counters.hpp"
+
+#include "alloc_tracker.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+std::atomic<bool> perfCountersEnabled(false);
+
+void enablePerfCounters(bool enabled) {
+	perfCountersEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+//one group per thread; members that fail to open (some VMs lack cache events) simply read as zero
+struct PerfGroup {
+	enum { CYCLES, INSTRUCTIONS, CACHE_MISSES, BRANCH_MISSES, COUNTER_COUNT };
+
+	int fds[COUNTER_COUNT] = { -1, -1, -1, -1 };
+	int slots[COUNTER_COUNT] = { -1, -1, -1, -1 }; //position of each counter in a group read
+	int opened = 0;
+	std::string error;
+
+	PerfGroup() {
+#ifdef __linux__
+		static const std::uint64_t configs[COUNTER_COUNT] = {
+			PERF_COUNT_HW_CPU_CYCLES,
+			PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_CACHE_MISSES,
+			PERF_COUNT_HW_BRANCH_MISSES,
+		};
+
+		for (int i = 0; i < COUNTER_COUNT; i++) {
+			perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = configs[i];
+			attr.disabled = fds[CYCLES] < 0 ? 1 : 0; //the leader starts the whole group
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_GROUP;
+
+			int fd = syscall(__NR_perf_event_open, &attr, 0, -1, fds[CYCLES], 0);
+			if (fd < 0) {
+				if (i == CYCLES) {
+					error = std::string("perf_event_open: ") + strerror(errno);
+					return;
+				}
+				continue;
+			}
+
+			fds[i] = fd;
+			slots[i] = opened++;
+		}
+
+		ioctl(fds[CYCLES], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+		ioctl(fds[CYCLES], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#else
+		error = "perf counters are only supported on linux";
+#endif
+	}
+
+	~PerfGroup() {
+#ifdef __linux__
+		for (int fd : fds) {
+			if (fd >= 0) {
+				close(fd);
+			}
+		}
+#endif
+	}
+
+	PerfReading Read() const {
+		PerfReading reading;
+#ifdef __linux__
+		if (fds[CYCLES] < 0) {
+			return reading;
+		}
+
+		std::uint64_t buffer[1 + COUNTER_COUNT] = {};
+		if (read(fds[CYCLES], buffer, sizeof(buffer)) < static_cast<ssize_t>(sizeof(std::uint64_t) * (1 + opened))) {
+			return reading;
+		}
+
+		auto value = [&](int counter) -> std::uint64_t {
+			return slots[counter] >= 0 ? buffer[1 + slots[counter]] : 0;
+		};
+
+		reading.cycles = value(CYCLES);
+		reading.instructions = value(INSTRUCTIONS);
+		reading.cacheMisses = value(CACHE_MISSES);
+		reading.branchMisses = value(BRANCH_MISSES);
+		reading.valid = true;
+#endif
+		return reading;
+	}
+};
+
+static PerfGroup& localGroup() {
+	AllocationExemptScope exempt;
+	thread_local PerfGroup group;
+	return group;
+}
+
+std::string perfCountersError() {
+	return localGroup().error;
+}
+
+PerfReading readPerfCounters() {
+	return localGroup().Read();
+}
+
+PerfStat::PerfStat(std::string const& name, std::string const& unitName) :
+	name(name),
+	unitName(unitName)
+{
+	//EMPTY
+}
+
+void PerfStat::Add(PerfReading const& start, PerfReading const& stop, std::uint64_t n) {
+	if (!start.valid || !stop.valid) {
+		return;
+	}
+
+	calls.fetch_add(1, std::memory_order_relaxed);
+	units.fetch_add(n, std::memory_order_relaxed);
+	cycles.fetch_add(stop.cycles - start.cycles, std::memory_order_relaxed);
+	instructions.fetch_add(stop.instructions - start.instructions, std::memory_order_relaxed);
+	cacheMisses.fetch_add(stop.cacheMisses - start.cacheMisses, std::memory_order_relaxed);
+	branchMisses.fetch_add(stop.branchMisses - start.branchMisses, std::memory_order_relaxed);
+}
+
+void PerfStat::Reset() {
+	calls.store(0, std::memory_order_relaxed);
+	units.store(0, std::memory_order_relaxed);
+	cycles.store(0, std::memory_order_relaxed);
+	instructions.store(0, std::memory_order_relaxed);
+	cacheMisses.store(0, std::memory_order_relaxed);
+	branchMisses.store(0, std::memory_order_relaxed);
+}
+
+void PerfStat::WriteText(std::ostream& os) const {
+	std::uint64_t n = calls.load(std::memory_order_relaxed);
+	if (n == 0) {
+		os << std::left << std::setw(24) << name << std::right << " no samples\n";
+		return;
+	}
+
+	double c = static_cast<double>(cycles.load(std::memory_order_relaxed));
+	double i = static_cast<double>(instructions.load(std::memory_order_relaxed));
+	double u = static_cast<double>(units.load(std::memory_order_relaxed));
+	if (u == 0) {
+		u = 1;
+	}
+
+	std::streamsize precision = os.precision();
+	os << std::left << std::setw(24) << name << std::right << std::fixed << std::setprecision(2)
+		<< " calls " << std::setw(10) << n
+		<< " " << unitName << " " << std::setw(12) << units.load(std::memory_order_relaxed)
+		<< " IPC " << std::setw(6) << (c > 0 ? i / c : 0.0)
+		<< " cycles/" << unitName << " " << std::setw(10) << c / u
+		<< " cache-misses/" << unitName << " " << std::setw(8) << cacheMisses.load(std::memory_order_relaxed) / u
+		<< " branch-misses/" << unitName << " " << std::setw(8) << branchMisses.load(std::memory_order_relaxed) / u
+		<< std::defaultfloat << '\n';
+	os.precision(precision);
+}
+
+PerfScope::PerfScope(PerfStat& stat) :
+	stat(stat)
+{
+	if (perfCountersEnabled.load(std::memory_order_relaxed)) {
+		start = readPerfCounters();
+	}
+}
+
+PerfScope::~PerfScope() {
+	if (start.valid) {
+		stat.Add(start, readPerfCounters(), units);
+	}
+}
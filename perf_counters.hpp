@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+//hardware counters (cycles, instructions, cache misses, branch misses) via Linux perf_event_open
+//each thread opens its own counter group on first use; if the kernel refuses (perf_event_paranoid,
+//containers, missing PMU) readings come back invalid and every scope quietly becomes a no-op
+
+struct PerfReading {
+	std::uint64_t cycles = 0;
+	std::uint64_t instructions = 0;
+	std::uint64_t cacheMisses = 0;
+	std::uint64_t branchMisses = 0;
+	bool valid = false;
+};
+
+extern std::atomic<bool> perfCountersEnabled;
+
+void enablePerfCounters(bool enabled);
+
+//the reason counters could not be opened on this thread, empty when they work
+std::string perfCountersError();
+
+//current counter values for the calling thread
+PerfReading readPerfCounters();
+
+//counter totals for one kind of work; units are whatever the work is measured in (blocks hashed, blocks scanned)
+class PerfStat {
+public:
+	PerfStat(std::string const& name, std::string const& unitName);
+
+	PerfStat(PerfStat const&) = delete;
+	PerfStat& operator=(PerfStat const&) = delete;
+
+	void Add(PerfReading const& start, PerfReading const& stop, std::uint64_t units);
+	void Reset();
+
+	//IPC and per-unit misses
+	void WriteText(std::ostream& os) const;
+
+private:
+	std::string name;
+	std::string unitName;
+	std::atomic<std::uint64_t> calls{0};
+	std::atomic<std::uint64_t> units{0};
+	std::atomic<std::uint64_t> cycles{0};
+	std::atomic<std::uint64_t> instructions{0};
+	std::atomic<std::uint64_t> cacheMisses{0};
+	std::atomic<std::uint64_t> branchMisses{0};
+};
+
+//counts the lifetime of a scope into a PerfStat, when counters are enabled and available
+class PerfScope {
+public:
+	PerfScope(PerfStat& stat);
+	~PerfScope();
+
+	PerfScope(PerfScope const&) = delete;
+	PerfScope& operator=(PerfScope const&) = delete;
+
+	void AddUnits(std::uint64_t n) { units += n; }
+
+private:
+	PerfStat& stat;
+	PerfReading start;
+	std::uint64_t units = 0;
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+
+//fixed-size object pool for short-lived objects that are made on one thread and retired on another,
+//like submissions travelling from a client to the ledger thread
+//only the owning thread (the one that constructed the pool, or last called Adopt()) may call New();
+//any thread may call Delete()
+//deletes on the owner go straight back on its free list, others push onto a lock-free list the owner
+//takes back whole, in one exchange, when its own free list runs dry
+//memory is carved from slabs that are only returned when the pool is destroyed, so a steady workload
+//stops touching the heap once the pool has grown to its working set
+template<typename T>
+class ObjectPool {
+public:
+	ObjectPool(std::size_t slabObjects = 1024) : slabObjects(slabObjects ? slabObjects : 1), owner(std::this_thread::get_id()) {}
+
+	~ObjectPool() = default; //objects still live are leaked into the slabs, not destroyed
+
+	ObjectPool(ObjectPool const&) = delete;
+	ObjectPool& operator=(ObjectPool const&) = delete;
+
+	//make the calling thread the owner, before it first calls New()
+	void Adopt() {
+		owner = std::this_thread::get_id();
+	}
+
+	template<typename... Args>
+	T* New(Args&&... args) {
+		if (!local) {
+			local = remote.exchange(nullptr, std::memory_order_acquire);
+		}
+		if (!local) {
+			Grow();
+		}
+
+		Slot* slot = local;
+		local = slot->next;
+		live.fetch_add(1, std::memory_order_relaxed);
+		return new (slot->storage) T(std::forward<Args>(args)...);
+	}
+
+	void Delete(T* object) {
+		if (!object) {
+			return;
+		}
+		object->~T();
+
+		Slot* slot = reinterpret_cast<Slot*>(object);
+		live.fetch_sub(1, std::memory_order_relaxed);
+
+		if (std::this_thread::get_id() == owner) {
+			slot->next = local;
+			local = slot;
+			return;
+		}
+
+		slot->next = remote.load(std::memory_order_relaxed);
+		while (!remote.compare_exchange_weak(slot->next, slot, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	//objects handed out and not yet deleted
+	std::size_t Live() const { return live.load(std::memory_order_relaxed); }
+
+	//objects the slabs can hold
+	std::size_t Capacity() const { return slabs.size() * slabObjects; }
+
+	std::size_t SlabBytes() const { return Capacity() * sizeof(Slot); }
+
+private:
+	union Slot {
+		Slot* next;
+		alignas(T) unsigned char storage[sizeof(T)];
+	};
+
+	void Grow() {
+		slabs.emplace_back(new Slot[slabObjects]);
+		Slot* slab = slabs.back().get();
+		for (std::size_t i = 0; i + 1 < slabObjects; i++) {
+			slab[i].next = &slab[i + 1];
+		}
+		slab[slabObjects - 1].next = nullptr;
+		local = slab;
+	}
+
+	const std::size_t slabObjects;
+	std::thread::id owner;
+	std::vector<std::unique_ptr<Slot[]>> slabs;
+	Slot* local = nullptr; //owner only
+	std::atomic<Slot*> remote{nullptr};
+	std::atomic<std::size_t> live{0};
+};
@@ -0,0 +1,41 @@
+#include "process.hpp"
+
+#include "protocol.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include <unistd.h>
+
+pid_t spawnSelf(std::vector<std::string> const& args) {
+	//or the child would print whatever is still buffered too
+	std::cout.flush();
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		std::vector<char*> argv;
+		for (std::string const& arg : args) {
+			argv.push_back(const_cast<char*>(arg.c_str()));
+		}
+		argv.push_back(nullptr);
+		execv("/proc/self/exe", argv.data());
+		_exit(127);
+	}
+	return pid;
+}
+
+bool waitForListener(std::string const& address, double seconds, std::string& error) {
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+	for (;;) {
+		int fd = connectToServer(address, error);
+		if (fd >= 0) {
+			close(fd);
+			return true;
+		}
+		if (std::chrono::steady_clock::now() >= deadline) {
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}
+}
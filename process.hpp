@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+//running other sixpence commands as child processes, for the harnesses that simulate several hosts
+
+//fork and exec this same binary with args, args[0] included; returns the child's pid, or -1
+pid_t spawnSelf(std::vector<std::string> const& args);
+
+//retry connecting until something listens at address, false with the last reason in error if nothing does in time
+bool waitForListener(std::string const& address, double seconds, std::string& error);
@@ -1,10 +1,19 @@
 #include "profile_timer.hpp"
 
+#include "trace.hpp"
+
 #include <iostream>
 
-ProfileTimer::ProfileTimer(std::string const& name) :
+ProfileTimer::ProfileTimer(const char* name) :
 	name(name)
 {
+	if (traceEnabled.load(std::memory_order_relaxed)) {
+		traceName = internTraceName(name);
+		traceBegin(traceName);
+	}
+	if (perfCountersEnabled.load(std::memory_order_relaxed)) {
+		perfStart = readPerfCounters();
+	}
 	startTime = Clock::now();
 }
 
@@ -14,6 +23,7 @@ ProfileTimer::~ProfileTimer() {
 
 void ProfileTimer::Stop() {
 	Clock::time_point stopTime = Clock::now();
+	PerfReading perfStop = perfStart.valid ? readPerfCounters() : PerfReading();
 
 	if (stopped) {
 		return;
@@ -21,7 +31,18 @@ void ProfileTimer::Stop() {
 
 	stopped = true;
 
+	if (traceName) {
+		traceEnd(traceName);
+	}
+
 	Clock::duration duration = stopTime - startTime;
 
 	std::cout << name << ": " << std::chrono::duration_cast<std::chrono::milliseconds>(duration).count() << "ms (" << std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count() << "ns)" << std::endl;
+
+	if (perfStop.valid) {
+		std::uint64_t cycles = perfStop.cycles - perfStart.cycles;
+		std::uint64_t instructions = perfStop.instructions - perfStart.instructions;
+		std::cout << name << ": " << cycles << " cycles, " << instructions << " instructions (IPC " << (cycles ? double(instructions) / cycles : 0.0) << "), "
+			<< perfStop.cacheMisses - perfStart.cacheMisses << " cache misses, " << perfStop.branchMisses - perfStart.branchMisses << " branch misses" << std::endl;
+	}
 }
\ No newline at end of file
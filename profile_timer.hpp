@@ -1,19 +1,24 @@
 #pragma once
 
 #include <chrono>
-#include <string>
+
+#include "fast_clock.hpp"
+#include "perf_counters.hpp"
 
 class ProfileTimer {
 public:
-	typedef std::chrono::high_resolution_clock Clock;
+	typedef TscClock Clock;
 
-	ProfileTimer(std::string const& name);
+	//name must outlive the timer, a string literal is typical
+	ProfileTimer(const char* name);
 	~ProfileTimer();
 
 	void Stop();
 
 private:
-	std::string name;
+	const char* name;
+	const char* traceName = nullptr;
 	Clock::time_point startTime;
+	PerfReading perfStart;
 	bool stopped = false;
 };
\ No newline at end of file
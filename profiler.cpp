@@ -0,0 +1,216 @@
+#include "profiler.hpp"
+
+#include "alloc_tracker.hpp"
+#include "fast_clock.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+std::atomic<bool> profilerEnabled(false);
+
+//only the owning thread writes these, so plain relaxed loads and stores are enough
+//times are in raw TscClock ticks, converted when reported
+struct ProfileNode {
+	const char* name;
+	ProfileNode* parent;
+	std::vector<ProfileNode*> children;
+	ProfileNode* lastChild = nullptr;
+
+	std::atomic<std::uint64_t> calls{0};
+	std::atomic<std::uint64_t> total{0};
+	std::atomic<std::uint64_t> min{UINT64_MAX};
+	std::atomic<std::uint64_t> max{0};
+
+	ProfileNode(const char* name, ProfileNode* parent) : name(name), parent(parent) {}
+};
+
+struct ThreadProfile {
+	std::mutex mutex; //guards the shape of the tree, taken only when a new child appears
+	std::vector<std::unique_ptr<ProfileNode>> nodes;
+	ProfileNode* root;
+	ProfileNode* current;
+	unsigned threadNumber;
+
+	ThreadProfile(unsigned threadNumber) : threadNumber(threadNumber) {
+		nodes.emplace_back(new ProfileNode("<root>", nullptr));
+		root = current = nodes.back().get();
+	}
+};
+
+//thread profiles outlive their threads, so their numbers are still reported
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<ThreadProfile>> registry;
+
+static ThreadProfile* localProfile() {
+	thread_local ThreadProfile* profile = nullptr;
+	if (!profile) {
+		AllocationExemptScope exempt;
+		std::lock_guard<std::mutex> lock(registryMutex);
+		registry.emplace_back(new ThreadProfile(registry.size()));
+		profile = registry.back().get();
+	}
+	return profile;
+}
+
+static ProfileNode* findChild(ThreadProfile* profile, ProfileNode* parent, const char* name) {
+	//loops and repeated calls usually hit the same child again
+	if (parent->lastChild && parent->lastChild->name == name) {
+		return parent->lastChild;
+	}
+
+	for (ProfileNode* child : parent->children) {
+		if (child->name == name) {
+			return parent->lastChild = child;
+		}
+	}
+
+	AllocationExemptScope exempt;
+	std::lock_guard<std::mutex> lock(profile->mutex);
+	profile->nodes.emplace_back(new ProfileNode(name, parent));
+	parent->children.push_back(profile->nodes.back().get());
+	return parent->lastChild = parent->children.back();
+}
+
+ProfileScope::ProfileScope(const char* name) : name(name) {
+	if (traceEnabled.load(std::memory_order_relaxed)) {
+		traceBegin(name);
+		traced = true;
+	}
+
+	if (!profilerEnabled.load(std::memory_order_relaxed)) {
+		return;
+	}
+
+	ThreadProfile* profile = localProfile();
+	node = findChild(profile, profile->current, name);
+	profile->current = node;
+	startTime = TscClock::Ticks();
+}
+
+ProfileScope::~ProfileScope() {
+	if (traced) {
+		traceEnd(name);
+	}
+
+	if (!node) {
+		return;
+	}
+
+	std::uint64_t elapsed = TscClock::Ticks() - startTime;
+
+	node->calls.store(node->calls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	node->total.store(node->total.load(std::memory_order_relaxed) + elapsed, std::memory_order_relaxed);
+	if (elapsed < node->min.load(std::memory_order_relaxed)) {
+		node->min.store(elapsed, std::memory_order_relaxed);
+	}
+	if (elapsed > node->max.load(std::memory_order_relaxed)) {
+		node->max.store(elapsed, std::memory_order_relaxed);
+	}
+
+	localProfile()->current = node->parent;
+}
+
+void enableProfiler(bool enabled) {
+	profilerEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+//the merged view, keyed by scope name rather than pointer, in nanoseconds
+struct ReportNode {
+	std::string name;
+	std::uint64_t calls = 0;
+	std::uint64_t total = 0;
+	std::uint64_t min = UINT64_MAX;
+	std::uint64_t max = 0;
+	std::vector<ReportNode> children;
+};
+
+static void mergeInto(ReportNode& dest, ProfileNode const* src) {
+	for (ProfileNode const* child : src->children) {
+		auto iter = std::find_if(dest.children.begin(), dest.children.end(), [child](ReportNode const& r) { return r.name == child->name; });
+		if (iter == dest.children.end()) {
+			dest.children.emplace_back();
+			iter = dest.children.end() - 1;
+			iter->name = child->name;
+		}
+
+		std::uint64_t calls = child->calls.load(std::memory_order_relaxed);
+		iter->calls += calls;
+		iter->total += TscClock::ElapsedNanoseconds(child->total.load(std::memory_order_relaxed));
+		if (calls > 0) {
+			iter->min = std::min(iter->min, TscClock::ElapsedNanoseconds(child->min.load(std::memory_order_relaxed)));
+			iter->max = std::max(iter->max, TscClock::ElapsedNanoseconds(child->max.load(std::memory_order_relaxed)));
+		}
+
+		mergeInto(*iter, child);
+	}
+}
+
+static void printReportNode(std::ostream& os, ReportNode const& node, int depth) {
+	if (node.calls > 0) {
+		std::uint64_t childTotal = 0;
+		for (ReportNode const& child : node.children) {
+			childTotal += child.total;
+		}
+		std::uint64_t self = node.total > childTotal ? node.total - childTotal : 0;
+
+		os << std::left << std::setw(40) << (std::string(depth * 2, ' ') + node.name) << std::right
+			<< std::setw(12) << node.calls
+			<< std::setw(16) << node.total
+			<< std::setw(16) << self
+			<< std::setw(12) << node.min
+			<< std::setw(12) << node.max
+			<< std::setw(12) << node.total / node.calls
+			<< '\n';
+	}
+
+	for (ReportNode const& child : node.children) {
+		printReportNode(os, child, depth + 1);
+	}
+}
+
+void printProfileReport(std::ostream& os) {
+	ReportNode root;
+
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		for (auto& profile : registry) {
+			std::lock_guard<std::mutex> treeLock(profile->mutex);
+			mergeInto(root, profile->root);
+		}
+	}
+
+	os << std::left << std::setw(40) << "scope" << std::right
+		<< std::setw(12) << "calls"
+		<< std::setw(16) << "total ns"
+		<< std::setw(16) << "self ns"
+		<< std::setw(12) << "min ns"
+		<< std::setw(12) << "max ns"
+		<< std::setw(12) << "mean ns"
+		<< '\n';
+
+	for (ReportNode const& child : root.children) {
+		printReportNode(os, child, 0);
+	}
+
+	os << std::flush;
+}
+
+void resetProfiler() {
+	std::lock_guard<std::mutex> lock(registryMutex);
+	for (auto& profile : registry) {
+		std::lock_guard<std::mutex> treeLock(profile->mutex);
+		for (auto& node : profile->nodes) {
+			node->calls.store(0, std::memory_order_relaxed);
+			node->total.store(0, std::memory_order_relaxed);
+			node->min.store(UINT64_MAX, std::memory_order_relaxed);
+			node->max.store(0, std::memory_order_relaxed);
+		}
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+
+//aggregates call count, total, min, max and self time per named scope
+//each thread records into its own call tree; trees are merged by name when reported
+//scopes also emit begin/end events when tracing is enabled (see trace.hpp)
+
+struct ProfileNode;
+
+class ProfileScope {
+public:
+	//name must outlive the program (a string literal), it is stored by pointer
+	ProfileScope(const char* name);
+	~ProfileScope();
+
+	ProfileScope(ProfileScope const&) = delete;
+	ProfileScope& operator=(ProfileScope const&) = delete;
+
+private:
+	const char* name;
+	bool traced = false;
+	ProfileNode* node = nullptr;
+	std::uint64_t startTime = 0;
+};
+
+//runtime switch, scopes cost a single relaxed load when disabled
+extern std::atomic<bool> profilerEnabled;
+
+void enableProfiler(bool enabled);
+
+//merge every thread's tree and print a summary table
+void printProfileReport(std::ostream& os);
+
+//zero every counter, keeping the trees in place
+void resetProfiler();
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
@@ -0,0 +1,132 @@
+#include "protocol.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <string>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+bool resolveAddress(char const* address, sockaddr_storage& addr, socklen_t& length) {
+	memset(&addr, 0, sizeof(addr));
+
+	if (!strncmp(address, "unix:", 5)) {
+		sockaddr_un* un = reinterpret_cast<sockaddr_un*>(&addr);
+		std::size_t pathLength = strlen(address + 5);
+		if (pathLength == 0 || pathLength >= sizeof(un->sun_path)) {
+			return false;
+		}
+		un->sun_family = AF_UNIX;
+		memcpy(un->sun_path, address + 5, pathLength + 1);
+		length = sizeof(sockaddr_un);
+		return true;
+	}
+
+	std::string host = "127.0.0.1";
+	char const* port = address;
+	if (char const* colon = strrchr(address, ':')) {
+		host.assign(address, colon);
+		port = colon + 1;
+	}
+
+	char* end;
+	unsigned long number = strtoul(port, &end, 10);
+	if (end == port || *end || number == 0 || number > 65535) {
+		return false;
+	}
+
+	sockaddr_in* in = reinterpret_cast<sockaddr_in*>(&addr);
+	in->sin_family = AF_INET;
+	in->sin_port = htons(static_cast<unsigned short>(number));
+	length = sizeof(sockaddr_in);
+	return inet_pton(AF_INET, host.c_str(), &in->sin_addr) == 1;
+}
+
+int listenOn(std::string const& address, bool nonBlocking, std::string& unixPath, std::string& error) {
+	sockaddr_storage addr;
+	socklen_t length;
+	if (!resolveAddress(address.c_str(), addr, length)) {
+		error = "bad address " + address;
+		return -1;
+	}
+
+	int fd = socket(addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC | (nonBlocking ? SOCK_NONBLOCK : 0), 0);
+	if (fd < 0) {
+		error = address + ": " + strerror(errno);
+		return -1;
+	}
+
+	unixPath.clear();
+	if (addr.ss_family == AF_UNIX) {
+		unixPath = reinterpret_cast<sockaddr_un*>(&addr)->sun_path;
+		unlink(unixPath.c_str());
+	}
+	else {
+		int yes = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+	}
+
+	if (bind(fd, reinterpret_cast<sockaddr*>(&addr), length) < 0 || listen(fd, SOMAXCONN) < 0) {
+		error = address + ": " + strerror(errno);
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int connectToServer(std::string const& address, std::string& error) {
+	sockaddr_storage addr;
+	socklen_t length;
+	if (!resolveAddress(address.c_str(), addr, length)) {
+		error = "bad address " + address;
+		return -1;
+	}
+
+	int fd = socket(addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), length) < 0) {
+		error = address + ": " + strerror(errno);
+		if (fd >= 0) {
+			close(fd);
+		}
+		return -1;
+	}
+
+	//fails harmlessly on Unix sockets
+	int yes = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+	return fd;
+}
+
+bool readExact(int fd, void* buffer, std::size_t length) {
+	char* p = static_cast<char*>(buffer);
+	while (length > 0) {
+		ssize_t received = recv(fd, p, length, 0);
+		if (received <= 0) {
+			if (received < 0 && errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		p += received;
+		length -= received;
+	}
+	return true;
+}
+
+bool sendFrame(int fd, Op op, Status status, void const* payload, std::size_t length) {
+	char frame[sizeof(FrameHeader) + 256];
+	if (length > sizeof(frame) - sizeof(FrameHeader)) {
+		std::vector<char> large;
+		appendFrame(large, op, status, payload, length);
+		return send(fd, large.data(), large.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(large.size());
+	}
+
+	FrameHeader header = { static_cast<std::uint32_t>(length), op, status, 0 };
+	memcpy(frame, &header, sizeof(header));
+	memcpy(frame + sizeof(header), payload, length);
+	std::size_t size = sizeof(header) + length;
+	return send(fd, frame, size, MSG_NOSIGNAL) == static_cast<ssize_t>(size);
+}
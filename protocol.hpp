@@ -0,0 +1,246 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+
+#include "ledger.hpp"
+
+//the binary protocol spoken by "sixpence serve"
+//every message is a FrameHeader followed by length bytes of payload; fields are fixed width in host
+//byte order, since the server only listens on a Unix socket and on loopback
+//plain requests are answered in the order they were sent, so a client may pipeline as many as it
+//likes; a connection that subscribes also receives BLOCK_EVENT frames, interleaved with its responses
+//a BATCH frame carries many operations, each tagged with an id; their answers come back in BATCH
+//frames in any order, queries straight away and transfers once they have been mined
+//the server only ever sends final blocks, the ones another block has followed: the newest block is
+//mined in place when the next transfer arrives, so until then it can still change; BLOCK answers
+//NOT_FOUND for it, and SUBSCRIBE and FOLLOW send it once it's final
+//the mining pool (mining_pool.hpp) frames its own messages the same way, with ops of its own
+
+enum class Op : std::uint8_t {
+	SUBMIT = 1, //SubmitRequest -> SubmitResponse, once the transfer has been mined
+	BALANCE = 2, //BalanceRequest -> BalanceResponse, from the account index
+	BLOCK = 3, //BlockRequest -> Block, final blocks only
+	SUBSCRIBE = 4, //SubscribeRequest -> SubscribeRequest echoed, then a BlockEvent per final block
+	BLOCK_EVENT = 5, //server to client only
+	BATCH = 6, //BatchEntry records each way
+	HEADERS = 7, //RangeRequest -> RangeResponse followed by the hash of each final block in the range
+	SEGMENT = 8, //RangeRequest -> RangeResponse followed by the final blocks in the range
+	FOLLOW = 9, //SubscribeRequest -> SubscribeRequest echoed, then SEGMENT frames as blocks become final
+
+	//mining pool, coordinator and workers
+	JOB = 10, //MiningJob, to a worker: search a nonce range of a block template
+	SHARE = 11, //MiningShare, from a worker: a nonce whose hash meets the job's share threshold
+	JOB_DONE = 12, //MiningReport, from a worker: range searched or job stopped, ready for more
+	STOP = 13, //MiningStop, to every worker: the tip changed, drop the job
+};
+
+enum class Status : std::uint8_t {
+	OK = 0,
+	NOT_FOUND = 1, //no such block, or the account has never received anything
+	BAD_REQUEST = 2, //unknown op or wrong payload size
+	FULL = 3, //the server's chain has used up its reservation and takes no more transfers
+	BUSY = 4, //a batch held more transfers than the server can have in flight
+};
+
+struct FrameHeader {
+	std::uint32_t length; //payload bytes after the header
+	Op op;
+	Status status; //always OK in requests
+	std::uint16_t reserved;
+};
+
+struct SubmitRequest {
+	std::uint32_t sender;
+	std::uint32_t receiver;
+	std::uint32_t amount;
+};
+
+struct SubmitResponse {
+	std::int32_t result; //sendAmount's result
+};
+
+struct BalanceRequest {
+	std::uint32_t account;
+};
+
+struct BalanceResponse {
+	std::uint32_t balance;
+};
+
+struct BlockRequest {
+	std::uint64_t position; //place in the chain, not the block index
+};
+
+struct SubscribeRequest {
+	std::uint64_t start; //position of the first block wanted
+};
+
+struct RangeRequest {
+	std::uint64_t start;
+	std::uint32_t count;
+	std::uint32_t reserved;
+};
+
+struct RangeResponse {
+	std::uint64_t start;
+	std::uint64_t final; //how many blocks are final on the server
+};
+
+struct BlockEvent {
+	std::uint64_t position;
+	Block block;
+};
+
+//a job is one block template, handed out as many disjoint ranges; the template's threshold is already
+//raised by the range's extra nonce, the number of times the 32-bit nonce space has been used up
+struct MiningJob {
+	std::uint64_t job;
+	Block block;
+	std::uint32_t firstNonce;
+	std::uint32_t lastNonce; //inclusive
+	std::uint32_t shareThreshold; //easier than block.threshold, shares show the work being done
+	std::uint32_t reserved;
+};
+
+struct MiningShare {
+	std::uint64_t job;
+	std::uint32_t nonce;
+	std::uint32_t threshold; //tells the range's extra nonce apart
+	std::uint32_t hash; //a solution when it meets the threshold
+	std::uint32_t reserved;
+};
+
+struct MiningReport {
+	std::uint64_t job;
+	std::uint64_t hashes; //tried since the last report
+	std::uint64_t stopNanoseconds; //answering a STOP: from when it was sent until the search ended
+};
+
+struct MiningStop {
+	std::uint64_t job;
+	std::int64_t sentAt; //Clock nanoseconds, comparable between processes on one host
+};
+
+//inside a BATCH frame every operation is a BatchEntry followed by that op's usual payload
+//SUBMIT, BALANCE and BLOCK can be batched
+struct BatchEntry {
+	Op op;
+	Status status; //always OK in requests
+	std::uint16_t reserved;
+	std::uint32_t id; //chosen by the client, echoed in the answer
+};
+
+static_assert(sizeof(FrameHeader) == 8, "FrameHeader has padding");
+static_assert(sizeof(BatchEntry) == 8, "BatchEntry has padding");
+static_assert(sizeof(SubmitRequest) == 12, "SubmitRequest has padding");
+static_assert(sizeof(BlockEvent) == 8 + sizeof(Block), "BlockEvent has padding");
+static_assert(sizeof(MiningJob) == 24 + sizeof(Block), "MiningJob has padding");
+
+//frames larger than this are a protocol error and close the connection
+constexpr std::size_t maxFramePayload = 1 << 16;
+
+//the most one HEADERS or SEGMENT answer carries
+constexpr std::size_t maxHeaderHashes = (maxFramePayload - sizeof(RangeResponse)) / sizeof(std::uint32_t);
+constexpr std::size_t maxSegmentBlocks = (maxFramePayload - sizeof(RangeResponse)) / sizeof(Block);
+
+//a null payload leaves length bytes to be filled in
+inline void appendFrame(std::vector<char>& out, Op op, Status status, void const* payload, std::size_t length) {
+	FrameHeader header = { static_cast<std::uint32_t>(length), op, status, 0 };
+	std::size_t at = out.size();
+	out.resize(at + sizeof(header) + length);
+	memcpy(out.data() + at, &header, sizeof(header));
+	if (payload && length > 0) {
+		memcpy(out.data() + at + sizeof(header), payload, length);
+	}
+}
+
+template<typename T>
+inline void appendFrame(std::vector<char>& out, Op op, Status status, T const& payload) {
+	appendFrame(out, op, status, &payload, sizeof(T));
+}
+
+//payload bytes after a BatchEntry, or 0 for an op that can't be batched
+inline std::size_t batchRequestSize(Op op) {
+	switch (op) {
+		case Op::SUBMIT: return sizeof(SubmitRequest);
+		case Op::BALANCE: return sizeof(BalanceRequest);
+		case Op::BLOCK: return sizeof(BlockRequest);
+		default: return 0;
+	}
+}
+
+inline std::size_t batchResponseSize(Op op, Status status) {
+	if (op == Op::BALANCE && status == Status::NOT_FOUND) {
+		return sizeof(BalanceResponse); //0 when not found
+	}
+	if (status != Status::OK) {
+		return 0;
+	}
+	return op == Op::SUBMIT ? sizeof(SubmitResponse) : op == Op::BALANCE ? sizeof(BalanceResponse) : op == Op::BLOCK ? sizeof(Block) : 0;
+}
+
+//BATCH frames are built in place at the end of out; frameStart is where the open one begins, or
+//noBatchFrame, and a new frame is started whenever the open one is full
+constexpr std::size_t noBatchFrame = ~std::size_t(0);
+
+inline void finishBatchFrame(std::vector<char>& out, std::size_t& frameStart) {
+	if (frameStart == noBatchFrame) {
+		return;
+	}
+	std::uint32_t length = static_cast<std::uint32_t>(out.size() - frameStart - sizeof(FrameHeader));
+	memcpy(out.data() + frameStart + offsetof(FrameHeader, length), &length, sizeof(length));
+	frameStart = noBatchFrame;
+}
+
+inline void appendBatchEntry(std::vector<char>& out, std::size_t& frameStart, Op op, Status status, std::uint32_t id, void const* payload, std::size_t length) {
+	if (frameStart != noBatchFrame && out.size() - frameStart - sizeof(FrameHeader) + sizeof(BatchEntry) + length > maxFramePayload) {
+		finishBatchFrame(out, frameStart);
+	}
+	if (frameStart == noBatchFrame) {
+		frameStart = out.size();
+		appendFrame(out, Op::BATCH, Status::OK, nullptr, 0);
+	}
+
+	BatchEntry entry = { op, status, 0, id };
+	std::size_t at = out.size();
+	out.resize(at + sizeof(entry) + length);
+	memcpy(out.data() + at, &entry, sizeof(entry));
+	if (length > 0) {
+		memcpy(out.data() + at + sizeof(entry), payload, length);
+	}
+}
+
+//how many bytes the frame at data takes, or 0 while it is incomplete
+inline std::size_t frameSize(char const* data, std::size_t available, FrameHeader& header) {
+	if (available < sizeof(FrameHeader)) {
+		return 0;
+	}
+	memcpy(&header, data, sizeof(header));
+	std::size_t size = sizeof(FrameHeader) + header.length;
+	return available < size ? 0 : size;
+}
+
+//"unix:path", "host:port" or just "port" for 127.0.0.1, shared by the server and its clients
+bool resolveAddress(char const* address, sockaddr_storage& addr, socklen_t& length);
+
+//a listening socket, or -1 with the reason in error; a Unix socket's path is unlinked first, in case
+//a previous run left it behind, and returned in unixPath so the caller can unlink it when done
+int listenOn(std::string const& address, bool nonBlocking, std::string& unixPath, std::string& error);
+
+//a blocking connection to the server, or -1 with the reason in error
+int connectToServer(std::string const& address, std::string& error);
+
+//blocking io for simple clients, false once the peer has gone
+bool readExact(int fd, void* buffer, std::size_t length);
+bool sendFrame(int fd, Op op, Status status, void const* payload, std::size_t length);
+
+template<typename T>
+inline bool sendFrame(int fd, Op op, T const& payload) {
+	return sendFrame(fd, op, Status::OK, &payload, sizeof(T));
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+//small, fast and reproducible random numbers for generators and load drivers
+
+inline std::uint64_t splitmix64(std::uint64_t& state) {
+	std::uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+//in [0, 1)
+inline double uniform(std::uint64_t& state) {
+	return (splitmix64(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+//exponentially distributed around mean, at least 1
+inline unsigned exponentialAmount(std::uint64_t& state, double mean) {
+	return std::max(1u, static_cast<unsigned>(-mean * std::log(1.0 - uniform(state))));
+}
+
+//account numbers 1..accounts by the Zipf distribution, account 1 being the busiest
+//an exponent of 0 is uniform
+class ZipfSampler {
+public:
+	ZipfSampler(unsigned accounts, double exponent) : cdf(std::max(accounts, 1u)) {
+		double total = 0;
+		for (unsigned k = 0; k < cdf.size(); k++) {
+			total += 1.0 / std::pow(k + 1, exponent);
+			cdf[k] = total;
+		}
+		for (double& c : cdf) {
+			c /= total;
+		}
+	}
+
+	unsigned Sample(std::uint64_t& state) const {
+		return 1 + static_cast<unsigned>(std::upper_bound(cdf.begin(), cdf.end() - 1, uniform(state)) - cdf.begin());
+	}
+
+private:
+	std::vector<double> cdf;
+};
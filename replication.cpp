@@ -0,0 +1,337 @@
+#include "replication.hpp"
+
+#include "block_log.hpp"
+#include "histogram.hpp"
+#include "process.hpp"
+#include "protocol.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+std::uint64_t verifySegment(Block const* blocks, std::uint32_t const* hashes, std::uint64_t start, std::size_t count) {
+	for (std::uint64_t position = start; position < start + count; position++) {
+		Block const& block = blocks[position];
+		unsigned hash = fnv_hash_1a_32(&block, sizeof(Block));
+		if (hash != hashes[position] || hash > block.threshold || (position > 0 && block.prevHash != hashes[position - 1])) {
+			return position;
+		}
+	}
+	return start + count;
+}
+
+//the header and RangeResponse of a HEADERS or SEGMENT answer, leaving the items to be read
+static bool readRange(int fd, Op op, RangeResponse& response, std::size_t itemSize, std::size_t& count) {
+	FrameHeader header;
+	if (!readExact(fd, &header, sizeof(header)) || header.op != op || header.status != Status::OK || header.length < sizeof(response)) {
+		return false;
+	}
+	if (!readExact(fd, &response, sizeof(response))) {
+		return false;
+	}
+	count = (header.length - sizeof(response)) / itemSize;
+	return count * itemSize == header.length - sizeof(response);
+}
+
+//every final block's hash, up to however many were final when the last answer came back
+static bool fetchHeaders(int fd, std::vector<std::uint32_t>& hashes, std::string& error) {
+	for (;;) {
+		RangeRequest request = { hashes.size(), static_cast<std::uint32_t>(maxHeaderHashes), 0 };
+		RangeResponse response;
+		std::size_t count;
+		if (!sendFrame(fd, Op::HEADERS, request) || !readRange(fd, Op::HEADERS, response, sizeof(std::uint32_t), count)) {
+			error = "headers: bad answer from the server";
+			return false;
+		}
+
+		std::size_t at = hashes.size();
+		hashes.resize(at + count);
+		if (!readExact(fd, hashes.data() + at, count * sizeof(std::uint32_t))) {
+			error = "headers: the server hung up";
+			return false;
+		}
+
+		if (hashes.size() >= response.final || count == 0) {
+			return true;
+		}
+	}
+}
+
+//the blocks for every header, a segment at a time over several connections, each verified as it lands
+static bool fetchSnapshot(std::string const& address, unsigned fetchers, std::vector<std::uint32_t> const& hashes, std::vector<Block>& blocks, std::string& error) {
+	blocks.resize(hashes.size());
+	std::size_t segments = (hashes.size() + maxSegmentBlocks - 1) / maxSegmentBlocks;
+	std::atomic<std::size_t> nextSegment(0);
+	std::atomic<bool> failed(false);
+	std::mutex errorMutex;
+
+	auto fail = [&](std::string const& reason) {
+		std::lock_guard<std::mutex> lock(errorMutex);
+		if (!failed.exchange(true)) {
+			error = reason;
+		}
+	};
+
+	auto fetcher = [&] {
+		std::string reason;
+		int fd = connectToServer(address, reason);
+		if (fd < 0) {
+			fail(reason);
+			return;
+		}
+
+		for (std::size_t segment; !failed.load() && (segment = nextSegment.fetch_add(1)) < segments;) {
+			std::uint64_t start = segment * maxSegmentBlocks;
+			std::size_t wanted = std::min<std::size_t>(maxSegmentBlocks, hashes.size() - start);
+
+			RangeRequest request = { start, static_cast<std::uint32_t>(wanted), 0 };
+			RangeResponse response;
+			std::size_t count;
+			if (!sendFrame(fd, Op::SEGMENT, request) || !readRange(fd, Op::SEGMENT, response, sizeof(Block), count) || response.start != start || count != wanted) {
+				fail("segment at " + std::to_string(start) + ": bad answer from the server");
+				break;
+			}
+
+			//straight into place, then checked against the headers
+			if (!readExact(fd, &blocks[start], count * sizeof(Block))) {
+				fail("segment at " + std::to_string(start) + ": the server hung up");
+				break;
+			}
+			std::uint64_t bad = verifySegment(blocks.data(), hashes.data(), start, count);
+			if (bad != start + count) {
+				fail("block " + std::to_string(bad) + " doesn't match its header");
+				break;
+			}
+		}
+		close(fd);
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned i = 0; i < std::max(fetchers, 1u); i++) {
+		threads.emplace_back(fetcher);
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	return !failed.load();
+}
+
+static std::atomic<bool> replicaStopping(false);
+
+static void stopReplica(int) {
+	replicaStopping.store(true);
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int replicaMain(int argc, char* argv[]) {
+	std::string address = "unix:/tmp/sixpence.sock";
+	std::string name = "replica";
+	unsigned fetchers = 4;
+	const char* logFile = nullptr;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--upstream") && i + 1 < argc) {
+			address = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--fetchers") && i + 1 < argc) {
+			fetchers = std::max(1, atoi(argv[++i]));
+		}
+		else if (!strcmp(argv[i], "--log") && i + 1 < argc) {
+			logFile = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--name") && i + 1 < argc) {
+			name = argv[++i];
+		}
+		else {
+			std::cerr << "usage: sixpence replica [--upstream address] [--fetchers N] [--log path] [--name name]" << std::endl;
+			return 1;
+		}
+	}
+
+	signal(SIGINT, stopReplica);
+	signal(SIGTERM, stopReplica);
+
+	std::string error;
+	int fd = connectToServer(address, error);
+	if (fd < 0) {
+		std::cerr << name << ": " << error << std::endl;
+		return 1;
+	}
+
+	//snapshot, headers first
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::uint32_t> hashes;
+	std::vector<Block> snapshot;
+	if (!fetchHeaders(fd, hashes, error)) {
+		std::cerr << name << ": " << error << std::endl;
+		return 1;
+	}
+	double headerSeconds = secondsSince(start);
+
+	if (!fetchSnapshot(address, fetchers, hashes, snapshot, error)) {
+		std::cerr << name << ": " << error << std::endl;
+		return 1;
+	}
+	double snapshotSeconds = secondsSince(start);
+
+	BlockLogWriter blockLog;
+	if (logFile) {
+		unlink(logFile);
+		if (blockLog.Open(logFile)) {
+			setBlockLog(&blockLog);
+		}
+		else {
+			std::cerr << name << ": " << blockLog.GetError() << ", continuing without a log" << std::endl;
+		}
+	}
+
+	resetLedger();
+	reserveLedger(snapshot.size() * 2);
+	for (Block const& block : snapshot) {
+		pushBlock(block);
+	}
+	std::vector<Block>().swap(snapshot);
+
+	//then the tail
+	LatencyHistogram lag(name + " lag");
+	std::uint64_t tailBlocks = 0;
+	std::uint64_t tailFrames = 0;
+	std::vector<Block> segment(maxSegmentBlocks);
+	unsigned lastHash = blockVector.empty() ? 0 : fnv_hash_1a_32(&blockVector.back(), sizeof(Block));
+
+	SubscribeRequest follow = { blockVector.size() };
+	FrameHeader header;
+	if (!sendFrame(fd, Op::FOLLOW, follow) || !readExact(fd, &header, sizeof(header)) || header.op != Op::FOLLOW
+		|| header.status != Status::OK || !readExact(fd, &follow, sizeof(follow))) {
+		std::cerr << name << ": the server wouldn't let us follow it" << std::endl;
+		return 1;
+	}
+
+	int result = 0;
+	while (!replicaStopping.load()) {
+		pollfd pfd = { fd, POLLIN, 0 };
+		if (poll(&pfd, 1, 100) <= 0) {
+			continue;
+		}
+
+		RangeResponse response;
+		std::size_t count;
+		if (!readRange(fd, Op::SEGMENT, response, sizeof(Block), count) || response.start != blockVector.size() || count > segment.size()
+			|| !readExact(fd, segment.data(), count * sizeof(Block))) {
+			std::cerr << name << ": lost the server" << std::endl;
+			result = 1;
+			break;
+		}
+
+		Clock::duration now = Clock::now().time_since_epoch();
+		for (std::size_t i = 0; i < count; i++) {
+			Block const& block = segment[i];
+			unsigned hash = fnv_hash_1a_32(&block, sizeof(Block));
+			if (block.prevHash != lastHash || hash > block.threshold) {
+				std::cerr << name << ": block " << blockVector.size() << " from the tail doesn't verify" << std::endl;
+				result = 1;
+				break;
+			}
+			lastHash = hash;
+			pushBlock(block);
+			lag.Record(now > block.timestamp ? std::chrono::duration_cast<std::chrono::nanoseconds>(now - block.timestamp).count() : 0);
+		}
+		if (result != 0) {
+			break;
+		}
+		tailBlocks += count;
+		tailFrames++;
+	}
+	close(fd);
+	setBlockLog(nullptr);
+
+	double megabytes = hashes.size() * sizeof(Block) / 1e6;
+	std::cout << name << ": headers for " << hashes.size() << " blocks in " << headerSeconds << "s, "
+		<< "snapshot over " << fetchers << " connections in " << snapshotSeconds << "s ("
+		<< hashes.size() / snapshotSeconds << " blocks/s, " << megabytes / snapshotSeconds << " MB/s)\n"
+		<< name << ": followed " << tailBlocks << " blocks in " << tailFrames << " segments, chain length " << blockVector.size()
+		<< (verifyChain(blockVector) == blockVector.size() ? ", verified" : ", FAILED verification") << "\n";
+	lag.WriteText(std::cout);
+	std::cout.flush();
+	return result;
+}
+
+//the harness
+int clusterMain(int argc, char* argv[]) {
+	unsigned replicas = 2;
+	double warmup = 2;
+	std::string fetchers = "4";
+	std::string address = "unix:/tmp/sixpence-cluster-" + std::to_string(getpid()) + ".sock";
+
+	//the harness's own keys, everything else is for the load generator
+	std::vector<std::string> loadArgs = { "sixpence", "loadgen", "address=" + address, "submit_fraction=0.5" };
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (!arg.compare(0, 9, "replicas=")) {
+			replicas = std::max(1, atoi(arg.c_str() + 9));
+		}
+		else if (!arg.compare(0, 7, "warmup=")) {
+			warmup = atof(arg.c_str() + 7);
+		}
+		else if (!arg.compare(0, 9, "fetchers=")) {
+			fetchers = arg.substr(9);
+		}
+		else if (arg.find('=') != std::string::npos && arg[0] != '-') {
+			loadArgs.push_back(arg);
+		}
+		else {
+			std::cerr << "usage: sixpence cluster [replicas=N] [warmup=seconds] [fetchers=N] [loadgen key=value ...]" << std::endl;
+			return 1;
+		}
+	}
+
+	pid_t server = spawnSelf({ "sixpence", "serve", "--listen", address });
+
+	std::string error;
+	if (!waitForListener(address, 5, error)) {
+		std::cerr << "the server didn't start: " << error << std::endl;
+		kill(server, SIGTERM);
+		waitpid(server, nullptr, 0);
+		return 1;
+	}
+
+	pid_t load = spawnSelf(loadArgs);
+	std::this_thread::sleep_for(std::chrono::duration<double>(warmup));
+
+	std::vector<pid_t> replicaPids;
+	for (unsigned i = 0; i < replicas; i++) {
+		replicaPids.push_back(spawnSelf({ "sixpence", "replica", "--upstream", address, "--fetchers", fetchers, "--name", "replica " + std::to_string(i + 1) }));
+	}
+
+	int status = 0;
+	waitpid(load, &status, 0);
+	bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+	//give the replicas a moment to take the tail, then collect their reports one at a time
+	std::this_thread::sleep_for(std::chrono::seconds(1));
+	std::cout << std::endl;
+	for (pid_t pid : replicaPids) {
+		kill(pid, SIGTERM);
+		waitpid(pid, &status, 0);
+		ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	}
+
+	kill(server, SIGINT);
+	waitpid(server, nullptr, 0);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "ledger.hpp"
+
+//replicas: other sixpence processes keeping a copy of a server's chain
+//a replica syncs a snapshot first, headers first: it fetches the hash of every final block, then the
+//blocks themselves in segments over several connections at once; with the hashes in hand each segment
+//can be verified on its own, on the thread that fetched it, without waiting for the segments before it
+//then it follows the tail, appending SEGMENT frames as the server's blocks become final
+//replication lag is measured against block timestamps, so it includes the time a block spent as the
+//server's unfinished tip
+
+//check blocks against hashes, both indexed by chain position: every block in [start, start + count)
+//must hash to its header, meet its own threshold and link to the header before it
+//returns the position of the first bad block, or start + count
+std::uint64_t verifySegment(Block const* blocks, std::uint32_t const* hashes, std::uint64_t start, std::size_t count);
+
+//"sixpence replica [--upstream address] [--fetchers N] [--log path] [--name name]", runs until SIGINT/SIGTERM
+int replicaMain(int argc, char* argv[]);
+
+//"sixpence cluster [replicas=N] [warmup=seconds] [fetchers=N] [loadgen key=value ...]"
+//a server, a load generator and replicas as separate processes on one Unix socket; the replicas join
+//after the warmup, so they sync a snapshot and then follow the tail while the load continues
+int clusterMain(int argc, char* argv[]);
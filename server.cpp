@@ -0,0 +1,810 @@
+#include "server.hpp"
+
+#include "ledger.hpp"
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+static MetricGauge serverConnectionsMetric("sixpence_server_connections", "Open client connections");
+static MetricCounter submitRequestsMetric("sixpence_server_requests_total", "Requests served", "op=\"submit\"");
+static MetricCounter balanceRequestsMetric("sixpence_server_requests_total", "Requests served", "op=\"balance\"");
+static MetricCounter blockRequestsMetric("sixpence_server_requests_total", "Requests served", "op=\"block\"");
+static MetricCounter subscribeRequestsMetric("sixpence_server_requests_total", "Requests served", "op=\"subscribe\"");
+static MetricCounter headersRequestsMetric("sixpence_server_requests_total", "Requests served", "op=\"headers\"");
+static MetricCounter segmentRequestsMetric("sixpence_server_requests_total", "Requests served", "op=\"segment\"");
+static MetricCounter followRequestsMetric("sixpence_server_requests_total", "Requests served", "op=\"follow\"");
+static MetricCounter badRequestsMetric("sixpence_server_requests_total", "Requests served", "op=\"bad\"");
+
+//epoll tags, connections are tagged with their fd
+static const std::uint64_t listenTag = std::uint64_t(1) << 32;
+static const std::uint64_t wakeTag = std::uint64_t(2) << 32;
+
+//unprocessed input kept per connection, enough for the largest frame and then some
+static const std::size_t inputLimit = maxFramePayload + sizeof(FrameHeader) + (1 << 16);
+
+struct LedgerServer::Connection {
+	Connection(int fd, std::uint64_t serial) : fd(fd), serial(serial) {}
+
+	std::size_t OutputPending() const { return output.size() - outputSent; }
+
+	int fd;
+	std::uint64_t serial;
+	std::uint32_t events = EPOLLIN;
+
+	std::vector<char> input;
+	std::size_t inputStart = 0;
+	std::size_t inputEnd = 0;
+
+	std::vector<char> output;
+	std::size_t outputSent = 0;
+	std::size_t batchFrame = noBatchFrame; //BATCH frame still being added to at the end of output
+
+	unsigned pendingSubmits = 0; //later requests wait behind these, so responses stay in order
+	bool stalled = false; //on a full submission queue
+	bool dirty = false;
+	bool subscribed = false;
+	bool following = false; //subscribed to final blocks in SEGMENT frames, rather than every block as an event
+	std::uint64_t subscribePosition = 0;
+};
+
+static void indexBlock(std::unordered_map<unsigned, unsigned>& balances, Block const& block) {
+	if (block.transaction.type == TransactionType::RECEIPT) {
+		balances[block.transaction.receipt.account] = block.transaction.receipt.balance;
+	}
+}
+
+LedgerServer::LedgerServer(ServerOptions const& options) :
+	options(options)
+{
+	//EMPTY
+}
+
+LedgerServer::~LedgerServer() {
+	if (worker) {
+		worker->Stop();
+	}
+	setBlockFeed(nullptr);
+
+	for (std::unique_ptr<Connection>& connection : connections) {
+		if (connection) {
+			close(connection->fd);
+		}
+	}
+	for (int fd : listenFds) {
+		close(fd);
+	}
+	for (std::string const& path : unixPaths) {
+		unlink(path.c_str());
+	}
+	if (wakeFd >= 0) {
+		close(wakeFd);
+	}
+	if (epollFd >= 0) {
+		close(epollFd);
+	}
+}
+
+bool LedgerServer::Start(std::string& error) {
+	//tens of thousands of connections need as many descriptors as we are allowed
+	rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (epollFd < 0 || wakeFd < 0) {
+		error = std::string("epoll: ") + strerror(errno);
+		return false;
+	}
+
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.u64 = wakeTag;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+
+	if (options.listen.empty()) {
+		error = "nothing to listen on";
+		return false;
+	}
+
+	for (std::string const& address : options.listen) {
+		std::string unixPath;
+		int fd = listenOn(address, true, unixPath, error);
+		if (fd < 0) {
+			return false;
+		}
+		listenFds.push_back(fd);
+		if (!unixPath.empty()) {
+			unixPaths.push_back(unixPath);
+		}
+
+		event.events = EPOLLIN;
+		event.data.u64 = listenTag | static_cast<std::uint32_t>(fd);
+		epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+	}
+
+	//a new chain, indexed up to its genesis before anything else can touch it
+	threshold = options.threshold;
+	verboseMining = false;
+	resetLedger();
+	reserveLedger(options.reserve);
+	pushBlock(generateBlock(generateBlank("sixpence serve!!"), 42));
+
+	//the genesis is the tip, so it's indexed here and published once the first transfer is pushed
+	for (Block const& block : blockVector) {
+		indexBlock(balances, block);
+	}
+	indexed = blockVector.size() - 1;
+
+	feed.reset(new BlockFeed(1 << 16, indexed));
+	chainSource.reset(new ReservedChainSource(blockVector, feed->PublishedCounter()));
+	subscription.reset(new FeedSubscription(*feed, indexed, chainSource.get()));
+	setBlockFeed(feed.get());
+
+	//never grows on the ledger thread, in flight is capped at the queue's capacity
+	completed.reserve(options.queueCapacity);
+	completing.reserve(options.queueCapacity);
+
+	queue.reset(new SubmissionQueue(options.queueCapacity));
+	worker.reset(new LedgerWorker(*queue));
+	worker->Start();
+	return true;
+}
+
+void LedgerServer::Stop() {
+	stopping.store(true);
+	std::uint64_t one = 1;
+	if (write(wakeFd, &one, sizeof(one)) < 0) {
+		//already woken
+	}
+}
+
+void LedgerServer::Run() {
+	submitPool.Adopt();
+
+	std::vector<epoll_event> events(1024);
+	while (!stopping.load()) {
+		int count = epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), -1);
+		if (count < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			std::cerr << "epoll_wait: " << strerror(errno) << std::endl;
+			break;
+		}
+
+		for (int i = 0; i < count; i++) {
+			std::uint64_t tag = events[i].data.u64;
+			if (tag == wakeTag) {
+				std::uint64_t value;
+				if (read(wakeFd, &value, sizeof(value)) < 0) {
+					//spurious
+				}
+				HandleCompletions();
+				continue;
+			}
+			if (tag & listenTag) {
+				Accept(static_cast<int>(tag & 0xffffffff));
+				continue;
+			}
+
+			//closed earlier in this batch
+			Connection* connection = tag < connections.size() ? connections[tag].get() : nullptr;
+			if (!connection) {
+				continue;
+			}
+
+			std::uint32_t ready = events[i].events;
+			if ((ready & EPOLLERR) || (ready & (EPOLLHUP | EPOLLIN)) == EPOLLHUP) {
+				Close(*connection); //gone while we weren't reading from it
+				continue;
+			}
+			if (ready & EPOLLIN) {
+				Read(*connection);
+				connection = connections[tag].get();
+			}
+			if (connection && (ready & EPOLLOUT)) {
+				Write(*connection);
+			}
+		}
+
+		//one send per connection per iteration, however many responses it gathered
+		for (std::size_t i = 0; i < dirty.size(); i++) {
+			Connection* connection = connections[dirty[i]].get();
+			if (connection) {
+				connection->dirty = false;
+				Write(*connection);
+			}
+		}
+		dirty.clear();
+	}
+
+	//finish what the ledger was given, nobody is left to hear the results
+	worker->Stop();
+	{
+		std::lock_guard<std::mutex> lock(completedMutex);
+		for (PendingSubmit* submit : completed) {
+			submitPool.Delete(submit);
+		}
+		completed.clear();
+	}
+	setBlockFeed(nullptr);
+
+	for (std::unique_ptr<Connection>& connection : connections) {
+		if (connection) {
+			Close(*connection);
+		}
+	}
+}
+
+void LedgerServer::Accept(int listenFd) {
+	for (;;) {
+		int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			return;
+		}
+		if (connectionCount >= options.maxConnections) {
+			close(fd);
+			continue;
+		}
+
+		//fails harmlessly on Unix sockets
+		int yes = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+		if (static_cast<std::size_t>(fd) >= connections.size()) {
+			connections.resize(std::max<std::size_t>(fd + 1, connections.size() * 2));
+		}
+		connections[fd].reset(new Connection(fd, nextSerial++));
+
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.u64 = static_cast<std::uint64_t>(fd);
+		epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+
+		connectionCount++;
+		serverConnectionsMetric.Set(connectionCount);
+	}
+}
+
+void LedgerServer::Read(Connection& connection) {
+	if (connection.inputStart > 0) {
+		memmove(connection.input.data(), connection.input.data() + connection.inputStart, connection.inputEnd - connection.inputStart);
+		connection.inputEnd -= connection.inputStart;
+		connection.inputStart = 0;
+	}
+	if (connection.input.size() - connection.inputEnd < 4096 && connection.input.size() < inputLimit) {
+		connection.input.resize(std::min(inputLimit, std::max<std::size_t>(connection.input.size() * 2, 16384)));
+	}
+
+	ssize_t received = 0;
+	if (connection.inputEnd < connection.input.size()) {
+		received = recv(connection.fd, connection.input.data() + connection.inputEnd, connection.input.size() - connection.inputEnd, 0);
+		if (received == 0 || (received < 0 && errno != EAGAIN && errno != EINTR)) {
+			Close(connection);
+			return;
+		}
+	}
+
+	if (received > 0) {
+		connection.inputEnd += received;
+	}
+	Process(connection);
+}
+
+void LedgerServer::Write(Connection& connection) {
+	finishBatchFrame(connection.output, connection.batchFrame);
+	if (connection.subscribed) {
+		Pump(connection);
+	}
+
+	while (connection.OutputPending() > 0) {
+		ssize_t sent = send(connection.fd, connection.output.data() + connection.outputSent, connection.OutputPending(), MSG_NOSIGNAL);
+		if (sent < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN) {
+				break;
+			}
+			Close(connection);
+			return;
+		}
+		connection.outputSent += sent;
+	}
+
+	if (connection.OutputPending() == 0) {
+		connection.output.clear();
+		connection.outputSent = 0;
+	}
+
+	//room again, carry on with whatever was held back
+	if (connection.inputEnd > connection.inputStart && connection.OutputPending() < options.maxOutput) {
+		Process(connection);
+	}
+	else {
+		UpdateInterest(connection);
+	}
+}
+
+void LedgerServer::Process(Connection& connection) {
+	while (!connection.stalled && connection.OutputPending() < options.maxOutput) {
+		char const* data = connection.input.data() + connection.inputStart;
+		FrameHeader header;
+		std::size_t size = frameSize(data, connection.inputEnd - connection.inputStart, header);
+		if (size == 0) {
+			if (connection.inputEnd - connection.inputStart >= sizeof(FrameHeader) && header.length > maxFramePayload) {
+				Close(connection);
+				return;
+			}
+			break;
+		}
+		char const* payload = data + sizeof(FrameHeader);
+
+		//answered by id, so not held up by the connection's plain transfers
+		if (header.op == Op::BATCH) {
+			if (!ProcessBatch(connection, payload, header.length)) {
+				break;
+			}
+			connection.inputStart += size;
+			continue;
+		}
+
+		bool submit = header.op == Op::SUBMIT && header.length == sizeof(SubmitRequest);
+		bool full = indexed + 1 + 3 * (inFlight + 1) > options.reserve; //the tip, and a transfer appends at most three blocks
+
+		if (submit && !full) {
+			if (inFlight >= options.queueCapacity) {
+				connection.stalled = true;
+				stalled.emplace_back(connection.fd, connection.serial);
+				break;
+			}
+
+			SubmitRequest request;
+			memcpy(&request, payload, sizeof(request));
+
+			PendingSubmit* pending = submitPool.New();
+			pending->sender = request.sender;
+			pending->receiver = request.receiver;
+			pending->amount = request.amount;
+			pending->startTicks = 0;
+			pending->complete = &LedgerServer::SubmitComplete;
+			pending->context = this;
+			pending->fd = connection.fd;
+			pending->serial = connection.serial;
+			pending->batched = false;
+
+			if (!queue->TryPush(pending)) {
+				submitPool.Delete(pending);
+				break; //shutting down
+			}
+			inFlight++;
+			connection.pendingSubmits++;
+			submitRequestsMetric.Increment();
+		}
+		else {
+			//answered in order, after the transfers sent before it
+			if (connection.pendingSubmits > 0) {
+				break;
+			}
+			finishBatchFrame(connection.output, connection.batchFrame);
+
+			if (submit) {
+				appendFrame(connection.output, Op::SUBMIT, Status::FULL, nullptr, 0);
+				submitRequestsMetric.Increment();
+			}
+			else if (header.op == Op::BALANCE && header.length == sizeof(BalanceRequest)) {
+				BalanceRequest request;
+				memcpy(&request, payload, sizeof(request));
+
+				auto found = balances.find(request.account);
+				BalanceResponse response = { found == balances.end() ? 0 : found->second };
+				appendFrame(connection.output, Op::BALANCE, found == balances.end() ? Status::NOT_FOUND : Status::OK, response);
+				balanceRequestsMetric.Increment();
+			}
+			else if (header.op == Op::BLOCK && header.length == sizeof(BlockRequest)) {
+				BlockRequest request;
+				memcpy(&request, payload, sizeof(request));
+
+				Block block;
+				if (request.position < Final() && chainSource->Read(request.position, &block, 1) == 1) {
+					appendFrame(connection.output, Op::BLOCK, Status::OK, block);
+				}
+				else {
+					appendFrame(connection.output, Op::BLOCK, Status::NOT_FOUND, nullptr, 0);
+				}
+				blockRequestsMetric.Increment();
+			}
+			else if (header.op == Op::SUBSCRIBE && header.length == sizeof(SubscribeRequest) && !connection.subscribed) {
+				SubscribeRequest request;
+				memcpy(&request, payload, sizeof(request));
+
+				appendFrame(connection.output, Op::SUBSCRIBE, Status::OK, request);
+				connection.subscribed = true;
+				connection.subscribePosition = request.start;
+				subscribers.emplace_back(connection.fd, connection.serial);
+				subscribeRequestsMetric.Increment();
+			}
+			else if ((header.op == Op::HEADERS || header.op == Op::SEGMENT) && header.length == sizeof(RangeRequest)) {
+				RangeRequest request;
+				memcpy(&request, payload, sizeof(request));
+
+				AppendRange(connection, header.op, request.start, request.count);
+				(header.op == Op::HEADERS ? headersRequestsMetric : segmentRequestsMetric).Increment();
+			}
+			else if (header.op == Op::FOLLOW && header.length == sizeof(SubscribeRequest) && !connection.subscribed) {
+				SubscribeRequest request;
+				memcpy(&request, payload, sizeof(request));
+
+				appendFrame(connection.output, Op::FOLLOW, Status::OK, request);
+				connection.subscribed = true;
+				connection.following = true;
+				connection.subscribePosition = request.start;
+				subscribers.emplace_back(connection.fd, connection.serial);
+				followRequestsMetric.Increment();
+			}
+			else {
+				appendFrame(connection.output, header.op, Status::BAD_REQUEST, nullptr, 0);
+				badRequestsMetric.Increment();
+			}
+			MarkDirty(connection);
+		}
+
+		connection.inputStart += size;
+	}
+
+	if (connection.inputStart == connection.inputEnd) {
+		connection.inputStart = connection.inputEnd = 0;
+	}
+	UpdateInterest(connection);
+}
+
+bool LedgerServer::ProcessBatch(Connection& connection, char const* payload, std::size_t length) {
+	//room for all of the frame's transfers or none of them, so a batch is never half taken
+	std::size_t submits = 0;
+	for (std::size_t offset = 0; offset + sizeof(BatchEntry) <= length;) {
+		BatchEntry entry;
+		memcpy(&entry, payload + offset, sizeof(entry));
+		std::size_t size = batchRequestSize(entry.op);
+		if (size == 0) {
+			break;
+		}
+		submits += entry.op == Op::SUBMIT;
+		offset += sizeof(BatchEntry) + size;
+	}
+	if (inFlight > 0 && inFlight + submits > options.queueCapacity) {
+		connection.stalled = true;
+		stalled.emplace_back(connection.fd, connection.serial);
+		return false;
+	}
+
+	std::vector<char>& out = connection.output;
+	for (std::size_t offset = 0; offset + sizeof(BatchEntry) <= length;) {
+		BatchEntry entry;
+		memcpy(&entry, payload + offset, sizeof(entry));
+		char const* request = payload + offset + sizeof(BatchEntry);
+		std::size_t size = batchRequestSize(entry.op);
+
+		//without a size the rest of the frame can't be parsed, so it stops here
+		if (size == 0 || offset + sizeof(BatchEntry) + size > length) {
+			appendBatchEntry(out, connection.batchFrame, entry.op, Status::BAD_REQUEST, entry.id, nullptr, 0);
+			badRequestsMetric.Increment();
+			break;
+		}
+		offset += sizeof(BatchEntry) + size;
+
+		if (entry.op == Op::BALANCE) {
+			BalanceRequest query;
+			memcpy(&query, request, sizeof(query));
+
+			auto found = balances.find(query.account);
+			BalanceResponse response = { found == balances.end() ? 0 : found->second };
+			appendBatchEntry(out, connection.batchFrame, Op::BALANCE, found == balances.end() ? Status::NOT_FOUND : Status::OK, entry.id, &response, sizeof(response));
+			balanceRequestsMetric.Increment();
+		}
+		else if (entry.op == Op::BLOCK) {
+			BlockRequest query;
+			memcpy(&query, request, sizeof(query));
+
+			Block block;
+			if (query.position < Final() && chainSource->Read(query.position, &block, 1) == 1) {
+				appendBatchEntry(out, connection.batchFrame, Op::BLOCK, Status::OK, entry.id, &block, sizeof(block));
+			}
+			else {
+				appendBatchEntry(out, connection.batchFrame, Op::BLOCK, Status::NOT_FOUND, entry.id, nullptr, 0);
+			}
+			blockRequestsMetric.Increment();
+		}
+		else {
+			submitRequestsMetric.Increment();
+			if (indexed + 1 + 3 * (inFlight + 1) > options.reserve) {
+				appendBatchEntry(out, connection.batchFrame, Op::SUBMIT, Status::FULL, entry.id, nullptr, 0);
+				continue;
+			}
+			if (inFlight >= options.queueCapacity) {
+				appendBatchEntry(out, connection.batchFrame, Op::SUBMIT, Status::BUSY, entry.id, nullptr, 0);
+				continue;
+			}
+
+			SubmitRequest transfer;
+			memcpy(&transfer, request, sizeof(transfer));
+
+			PendingSubmit* pending = submitPool.New();
+			pending->sender = transfer.sender;
+			pending->receiver = transfer.receiver;
+			pending->amount = transfer.amount;
+			pending->startTicks = 0;
+			pending->complete = &LedgerServer::SubmitComplete;
+			pending->context = this;
+			pending->fd = connection.fd;
+			pending->serial = connection.serial;
+			pending->batched = true;
+			pending->id = entry.id;
+
+			if (!queue->TryPush(pending)) {
+				submitPool.Delete(pending);
+				appendBatchEntry(out, connection.batchFrame, Op::SUBMIT, Status::BUSY, entry.id, nullptr, 0);
+				continue;
+			}
+			inFlight++;
+		}
+	}
+
+	MarkDirty(connection);
+	return true;
+}
+
+void LedgerServer::Pump(Connection& connection) {
+	finishBatchFrame(connection.output, connection.batchFrame);
+
+	//followers get final blocks only, as many to a frame as fit
+	if (connection.following) {
+		while (connection.subscribePosition < Final() && connection.OutputPending() < options.maxOutput) {
+			AppendRange(connection, Op::SEGMENT, connection.subscribePosition, maxSegmentBlocks);
+			connection.subscribePosition = std::min(Final(), connection.subscribePosition + maxSegmentBlocks);
+		}
+		return;
+	}
+
+	Block blocks[64];
+	while (connection.subscribePosition < Final() && connection.OutputPending() < options.maxOutput) {
+		std::size_t wanted = static_cast<std::size_t>(std::min<std::uint64_t>(64, Final() - connection.subscribePosition));
+		std::size_t count = chainSource->Read(connection.subscribePosition, blocks, wanted);
+		if (count == 0) {
+			break;
+		}
+
+		for (std::size_t i = 0; i < count; i++) {
+			BlockEvent event = { connection.subscribePosition++, blocks[i] };
+			appendFrame(connection.output, Op::BLOCK_EVENT, Status::OK, event);
+		}
+	}
+}
+
+void LedgerServer::AppendRange(Connection& connection, Op op, std::uint64_t start, std::size_t count) {
+	std::uint64_t final = Final();
+	bool headers = op == Op::HEADERS;
+	std::size_t available = start < final ? static_cast<std::size_t>(std::min<std::uint64_t>({ count, headers ? maxHeaderHashes : maxSegmentBlocks, final - start })) : 0;
+	std::size_t itemSize = headers ? sizeof(std::uint32_t) : sizeof(Block);
+
+	std::vector<char>& out = connection.output;
+	std::size_t at = out.size() + sizeof(FrameHeader);
+	appendFrame(out, op, Status::OK, nullptr, sizeof(RangeResponse) + available * itemSize);
+
+	RangeResponse response = { start, final };
+	memcpy(out.data() + at, &response, sizeof(response));
+	at += sizeof(response);
+
+	//final blocks are complete in the reserved chain and never written again
+	for (std::size_t done = 0; done < available;) {
+		std::size_t count = chainSource->Read(start + done, rangeScratch.data(), std::min(available - done, rangeScratch.size()));
+		if (count == 0) {
+			break;
+		}
+		for (std::size_t i = 0; i < count; i++, at += itemSize) {
+			if (headers) {
+				std::uint32_t hash = fnv_hash_1a_32(&rangeScratch[i], sizeof(Block));
+				memcpy(out.data() + at, &hash, sizeof(hash));
+			}
+			else {
+				memcpy(out.data() + at, &rangeScratch[i], sizeof(Block));
+			}
+		}
+		done += count;
+	}
+}
+
+void LedgerServer::Close(Connection& connection) {
+	int fd = connection.fd;
+	epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+	close(fd);
+
+	connectionCount--;
+	serverConnectionsMetric.Set(connectionCount);
+	connections[fd].reset(); //its pending transfers are dropped when they complete
+}
+
+void LedgerServer::UpdateInterest(Connection& connection) {
+	std::uint32_t wanted = 0;
+	if (!connection.stalled && connection.OutputPending() < options.maxOutput && connection.inputEnd - connection.inputStart < inputLimit) {
+		wanted |= EPOLLIN;
+	}
+	if (connection.OutputPending() > 0 && !connection.dirty) {
+		wanted |= EPOLLOUT;
+	}
+
+	if (wanted != connection.events) {
+		epoll_event event = {};
+		event.events = wanted;
+		event.data.u64 = static_cast<std::uint64_t>(connection.fd);
+		epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+		connection.events = wanted;
+	}
+}
+
+void LedgerServer::MarkDirty(Connection& connection) {
+	if (!connection.dirty) {
+		connection.dirty = true;
+		dirty.push_back(connection.fd);
+	}
+}
+
+LedgerServer::Connection* LedgerServer::Find(int fd, std::uint64_t serial) {
+	Connection* connection = static_cast<std::size_t>(fd) < connections.size() ? connections[fd].get() : nullptr;
+	return connection && connection->serial == serial ? connection : nullptr;
+}
+
+void LedgerServer::SubmitComplete(Submission* submission, int result) {
+	PendingSubmit* pending = static_cast<PendingSubmit*>(submission);
+	LedgerServer* server = static_cast<LedgerServer*>(pending->context);
+	pending->result = result;
+
+	//on the ledger thread, the only one that touches the tip
+	pending->tip = blockVector.back();
+	pending->tipPosition = blockVector.size() - 1;
+
+	//only the first completion since the loop last looked needs to wake it
+	bool wake;
+	{
+		std::lock_guard<std::mutex> lock(server->completedMutex);
+		wake = server->completed.empty();
+		server->completed.push_back(pending);
+	}
+	if (wake) {
+		std::uint64_t one = 1;
+		if (write(server->wakeFd, &one, sizeof(one)) < 0) {
+			//already woken
+		}
+	}
+}
+
+void LedgerServer::FollowChain() {
+	Block blocks[256];
+	while (std::size_t count = subscription->Poll(blocks, 256)) {
+		for (std::size_t i = 0; i < count; i++) {
+			indexBlock(balances, blocks[i]);
+		}
+	}
+	indexed = subscription->Position();
+}
+
+void LedgerServer::HandleCompletions() {
+	{
+		std::lock_guard<std::mutex> lock(completedMutex);
+		completing.swap(completed);
+	}
+
+	//the blocks before the tip were published before their transfers completed, so index them first,
+	//then the newest tip, which won't be published until the next block is pushed, so a client that
+	//reads after its transfer sees the transfer; the feed indexes the tip again, the same, once it's final
+	FollowChain();
+	if (!completing.empty() && completing.back()->tipPosition == indexed) {
+		indexBlock(balances, completing.back()->tip);
+	}
+
+	for (PendingSubmit* pending : completing) {
+		if (Connection* connection = Find(pending->fd, pending->serial)) {
+			SubmitResponse response = { pending->result };
+			if (pending->batched) {
+				appendBatchEntry(connection->output, connection->batchFrame, Op::SUBMIT, Status::OK, pending->id, &response, sizeof(response));
+			}
+			else {
+				finishBatchFrame(connection->output, connection->batchFrame);
+				appendFrame(connection->output, Op::SUBMIT, Status::OK, response);
+				connection->pendingSubmits--;
+			}
+			MarkDirty(*connection);
+		}
+		submitPool.Delete(pending);
+		inFlight--;
+	}
+	completing.clear();
+
+	//room in the queue again
+	std::vector<std::pair<int, std::uint64_t>> retry;
+	retry.swap(stalled);
+	for (auto const& entry : retry) {
+		if (Connection* connection = Find(entry.first, entry.second)) {
+			connection->stalled = false;
+			Process(*connection);
+		}
+	}
+
+	//new blocks for the subscribers, dropping any that have gone
+	auto end = std::remove_if(subscribers.begin(), subscribers.end(), [this](std::pair<int, std::uint64_t> const& entry) {
+		Connection* connection = Find(entry.first, entry.second);
+		if (connection && connection->subscribePosition < Final()) {
+			MarkDirty(*connection);
+		}
+		return connection == nullptr;
+	});
+	subscribers.erase(end, subscribers.end());
+}
+
+static LedgerServer* runningServer = nullptr;
+
+static void stopServer(int) {
+	if (runningServer) {
+		runningServer->Stop();
+	}
+}
+
+int serveMain(int argc, char* argv[]) {
+	ServerOptions options;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--listen") && i + 1 < argc) {
+			options.listen.push_back(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "--threshold") && i + 1 < argc) {
+			options.threshold = strtoul(argv[++i], nullptr, 0);
+		}
+		else if (!strcmp(argv[i], "--reserve") && i + 1 < argc) {
+			options.reserve = strtoull(argv[++i], nullptr, 0);
+		}
+		else if (!strcmp(argv[i], "--max-connections") && i + 1 < argc) {
+			options.maxConnections = strtoull(argv[++i], nullptr, 0);
+		}
+		else {
+			std::cerr << "usage: sixpence serve [--listen unix:path|[host:]port]... [--threshold N] [--reserve blocks] [--max-connections N]" << std::endl;
+			return 1;
+		}
+	}
+	if (options.listen.empty()) {
+		options.listen.push_back("unix:/tmp/sixpence.sock");
+	}
+
+	LedgerServer server(options);
+	std::string error;
+	if (!server.Start(error)) {
+		std::cerr << error << std::endl;
+		return 1;
+	}
+
+	runningServer = &server;
+	signal(SIGINT, stopServer);
+	signal(SIGTERM, stopServer);
+
+	for (std::string const& address : options.listen) {
+		std::cout << "listening on " << address << std::endl;
+	}
+	server.Run();
+
+	runningServer = nullptr;
+	std::cout << "stopped, chain length " << blockVector.size() << std::endl;
+	return 0;
+}
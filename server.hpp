@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "change_feed.hpp"
+#include "pool.hpp"
+#include "protocol.hpp"
+#include "submission_queue.hpp"
+
+//"sixpence serve": the ledger as a local service, speaking the protocol in protocol.hpp
+//one event loop thread owns every connection (epoll, non-blocking sockets, a buffer each way per
+//connection) and hands transfers to the ledger thread through a SubmissionQueue; the ledger thread
+//hands results back through a list and an eventfd
+//queries never touch the ledger thread: the loop follows the chain through the change feed and keeps
+//its own account index, so balances and blocks are answered where the request was read; batched
+//queries don't even wait for the connection's earlier transfers
+
+struct ServerOptions {
+	std::vector<std::string> listen; //addresses, see resolveAddress()
+	unsigned threshold = 0x00ffffff; //mining threshold while serving
+	std::size_t reserve = 1 << 22; //blocks reserved up front, the chain can't grow past this while serving
+	std::size_t queueCapacity = 1 << 14; //transfers queued or in flight at once, across all connections
+	std::size_t maxConnections = 1 << 16;
+	std::size_t maxOutput = 1 << 20; //bytes buffered for one connection before it stops being read from
+};
+
+class LedgerServer {
+public:
+	LedgerServer(ServerOptions const& options);
+	~LedgerServer();
+
+	LedgerServer(LedgerServer const&) = delete;
+	LedgerServer& operator=(LedgerServer const&) = delete;
+
+	//start a new chain, bind every address and start the ledger thread
+	bool Start(std::string& error);
+
+	//the event loop, on the calling thread, until Stop()
+	void Run();
+
+	//from any thread or a signal handler
+	void Stop();
+
+private:
+	struct Connection;
+
+	struct PendingSubmit : Submission {
+		int fd;
+		std::uint64_t serial; //tells a reused fd from the connection that sent this
+		bool batched; //answered in a BATCH frame, with this id
+		std::uint32_t id;
+		int result;
+
+		//the chain's tip once the transfer was done, which the feed holds back until it's final
+		Block tip;
+		std::uint64_t tipPosition;
+	};
+
+	static void SubmitComplete(Submission* submission, int result);
+
+	void Accept(int listenFd);
+	void Read(Connection& connection);
+	void Write(Connection& connection);
+	void Process(Connection& connection);
+	bool ProcessBatch(Connection& connection, char const* payload, std::size_t length);
+	void Pump(Connection& connection);
+	void AppendRange(Connection& connection, Op op, std::uint64_t start, std::size_t count);
+	void Close(Connection& connection);
+	void UpdateInterest(Connection& connection);
+	void MarkDirty(Connection& connection);
+	Connection* Find(int fd, std::uint64_t serial);
+
+	//blocks before this have been followed by another and won't change again; the feed only carries
+	//those, so it's as far as the loop has followed it, and the tip is never read from the chain
+	std::uint64_t Final() const { return indexed; }
+
+	void FollowChain();
+	void HandleCompletions();
+
+	ServerOptions options;
+	int epollFd = -1;
+	int wakeFd = -1; //eventfd, written by the ledger thread and Stop()
+	std::vector<int> listenFds;
+	std::vector<std::string> unixPaths; //unlinked on shutdown
+	std::atomic<bool> stopping{false};
+
+	std::vector<std::unique_ptr<Connection>> connections; //by fd
+	std::size_t connectionCount = 0;
+	std::uint64_t nextSerial = 1;
+	std::vector<int> dirty; //connections with output to flush at the end of this loop iteration
+	std::vector<std::pair<int, std::uint64_t>> stalled; //waiting for room in the submission queue
+	std::vector<std::pair<int, std::uint64_t>> subscribers;
+
+	//the ledger side
+	std::unique_ptr<SubmissionQueue> queue;
+	std::unique_ptr<LedgerWorker> worker;
+	ObjectPool<PendingSubmit> submitPool;
+	std::size_t inFlight = 0;
+
+	std::mutex completedMutex;
+	std::vector<PendingSubmit*> completed; //filled on the ledger thread
+	std::vector<PendingSubmit*> completing; //swapped out by the loop
+
+	//the loop's view of the chain, everything before indexed is in balances, and so is the tip
+	std::unique_ptr<BlockFeed> feed;
+	std::unique_ptr<ReservedChainSource> chainSource;
+	std::unique_ptr<FeedSubscription> subscription;
+	std::uint64_t indexed = 0;
+	std::unordered_map<unsigned, unsigned> balances;
+	std::vector<Block> rangeScratch = std::vector<Block>(256);
+};
+
+//"sixpence serve [--listen address]... [--threshold N] [--reserve blocks] [--max-connections N]"
+int serveMain(int argc, char* argv[]);
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdlib>
+#include <istream>
+#include <string>
+#include <type_traits>
+
+//"key = value" spec files and key=value overrides, shared by the workload driver and the load generator
+
+inline std::string trimOption(std::string const& s) {
+	std::size_t first = s.find_first_not_of(" \t\r");
+	if (first == std::string::npos) {
+		return "";
+	}
+	return s.substr(first, s.find_last_not_of(" \t\r") - first + 1);
+}
+
+//non-negative numbers only, integers in any base strtoull accepts
+template<typename T>
+bool parseOptionNumber(std::string const& value, T& out) {
+	char* end = nullptr;
+	if (std::is_floating_point<T>::value) {
+		double d = strtod(value.c_str(), &end);
+		if (end == value.c_str() || *end || d < 0) {
+			return false;
+		}
+		out = static_cast<T>(d);
+	}
+	else {
+		unsigned long long u = strtoull(value.c_str(), &end, 0);
+		if (end == value.c_str() || *end || value[0] == '-') {
+			return false;
+		}
+		out = static_cast<T>(u);
+	}
+	return true;
+}
+
+//call set(key, value, error) for each "key = value" line, # starts a comment
+template<typename Set>
+bool parseOptionLines(std::istream& is, Set set, std::string& error) {
+	std::string line;
+	for (int lineNumber = 1; std::getline(is, line); lineNumber++) {
+		line = trimOption(line.substr(0, line.find('#')));
+		if (line.empty()) {
+			continue;
+		}
+
+		std::size_t equals = line.find('=');
+		if (equals == std::string::npos) {
+			error = "line " + std::to_string(lineNumber) + ": expected key = value";
+			return false;
+		}
+
+		if (!set(trimOption(line.substr(0, equals)), trimOption(line.substr(equals + 1)), error)) {
+			error = "line " + std::to_string(lineNumber) + ": " + error;
+			return false;
+		}
+	}
+	return true;
+}
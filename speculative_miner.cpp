@@ -0,0 +1,119 @@
+#include "speculative_miner.hpp"
+
+#include "fast_clock.hpp"
+#include "trace.hpp"
+
+#include <ostream>
+
+SpeculativeMiner::SpeculativeMiner() : thread([this] { Run(); }) {
+	//EMPTY
+}
+
+SpeculativeMiner::~SpeculativeMiner() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		generation++;
+	}
+	wake.notify_one();
+	thread.join();
+}
+
+unsigned SpeculativeMiner::Mine(Block& block, unsigned threshold) {
+	std::unique_lock<std::mutex> lock(mutex);
+	if (hasTarget && IsTarget(block, threshold)) {
+		if (hasResult) {
+			hits++;
+		}
+		else {
+			waits++;
+			std::uint64_t startTicks = TscClock::Ticks();
+			done.wait(lock, [this] { return hasResult; });
+			waitLatency.Record(TscClock::ElapsedNanoseconds(TscClock::Ticks() - startTicks));
+		}
+
+		block = result;
+		hasTarget = false;
+		hasResult = false;
+		return resultHash;
+	}
+
+	if (hasTarget) {
+		misses++;
+		Cancel();
+	}
+	lock.unlock();
+	return hashBlock(block, threshold);
+}
+
+void SpeculativeMiner::Speculate(Block const* next, unsigned threshold) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	//a pushed block that's already been mined has nothing left to search
+	if (next == nullptr || (next->threshold != 0 && fnv_hash_1a_32(next, sizeof(Block)) <= next->threshold)) {
+		Cancel();
+		return;
+	}
+	if (hasTarget && IsTarget(*next, threshold)) {
+		return;
+	}
+
+	Cancel();
+	target = *next;
+	targetThreshold = threshold;
+	hasTarget = true;
+	pending = true;
+	speculated++;
+	wake.notify_one();
+}
+
+void SpeculativeMiner::WriteReport(std::ostream& os) const {
+	os << "speculation: " << speculated << " blocks, " << hits << " mined before asked for, " << waits << " waited for, "
+		<< misses << " missed, " << cancelled << " searches cancelled\n";
+	waitLatency.WriteText(os);
+}
+
+void SpeculativeMiner::Run() {
+	setTraceThreadName("speculative miner");
+
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		wake.wait(lock, [this] { return stopping || pending; });
+		if (stopping) {
+			return;
+		}
+
+		pending = false;
+		Block block = target;
+		unsigned threshold = targetThreshold;
+		std::uint32_t job = generation.load();
+		lock.unlock();
+
+		unsigned hash;
+		bool mined = hashBlockUnlessCancelled(block, threshold, generation, job, hash);
+
+		lock.lock();
+		if (mined && generation.load() == job) {
+			result = block;
+			resultHash = hash;
+			hasResult = true;
+			done.notify_one();
+		}
+		else if (!mined) {
+			cancelled++;
+		}
+	}
+}
+
+void SpeculativeMiner::Cancel() {
+	if (hasTarget) {
+		generation++;
+		hasTarget = false;
+		pending = false;
+		hasResult = false;
+	}
+}
+
+bool SpeculativeMiner::IsTarget(Block const& block, unsigned threshold) const {
+	return threshold == targetThreshold && sameBlockTemplate(block, target);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <thread>
+
+#include "histogram.hpp"
+#include "ledger.hpp"
+
+//mining ahead of the ledger on a background thread
+//the ledger hints at the block it will ask for next (see BlockMiner::Speculate): the new chain tip once
+//its blocks are pushed, and each of sendAmount's blocks once its transaction has been validated, and the
+//background thread starts on it straight away; when Mine() asks for that block the search is finished,
+//or at least under way, and when it asks for another, or the hint changes, the search is called off
+//within a chunk of nonces (see hashBlockUnlessCancelled) instead of running on a stale block
+//the background search tries nonces in hashBlock's order, so the chain is the one hashBlock would mine
+
+class SpeculativeMiner : public BlockMiner {
+public:
+	SpeculativeMiner();
+	~SpeculativeMiner();
+
+	SpeculativeMiner(SpeculativeMiner const&) = delete;
+	SpeculativeMiner& operator=(SpeculativeMiner const&) = delete;
+
+	//takes the background search's result for the block when it was the hint, or mines it with hashBlock
+	unsigned Mine(Block& block, unsigned threshold) override;
+
+	//retarget the background search, cancelling the one under way; nullptr or a mined block just cancels
+	void Speculate(Block const* next, unsigned threshold) override;
+
+	void WriteReport(std::ostream& os) const;
+
+private:
+	void Run();
+	void Cancel(); //with the mutex held
+	bool IsTarget(Block const& block, unsigned threshold) const; //with the mutex held
+
+	std::mutex mutex;
+	std::condition_variable wake; //the background thread, for a new target or to stop
+	std::condition_variable done; //Mine(), for the background search to finish
+
+	//moves on whenever the target does, calling off the search for the old one
+	std::atomic<std::uint32_t> generation{0};
+
+	Block target;
+	unsigned targetThreshold = 0;
+	bool hasTarget = false;
+	bool pending = false; //the background thread hasn't picked the target up yet
+	bool hasResult = false;
+	Block result;
+	unsigned resultHash = 0;
+	bool stopping = false;
+
+	std::uint64_t speculated = 0; //targets given
+	std::uint64_t hits = 0; //already mined when asked for
+	std::uint64_t waits = 0; //still being mined when asked for
+	std::uint64_t misses = 0; //asked for another block, the target was dropped
+	std::uint64_t cancelled = 0; //searches called off part way
+	LatencyHistogram waitLatency{"speculation wait"};
+
+	std::thread thread; //last, so it starts once everything above is ready
+};
@@ -0,0 +1,112 @@
+#include "submission_queue.hpp"
+
+#include "ledger.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+
+MetricGauge submissionQueueDepthMetric("sixpence_submission_queue_depth", "Transfers waiting for the ledger thread");
+
+SubmissionQueue::SubmissionQueue(std::size_t capacity) :
+	ring(capacity ? capacity : 1)
+{
+	//EMPTY
+}
+
+bool SubmissionQueue::Push(Submission* submission) {
+	std::unique_lock<std::mutex> lock(mutex);
+	notFull.wait(lock, [this] { return closed || count < ring.size(); });
+	if (closed) {
+		return false;
+	}
+
+	ring[(head + count++) % ring.size()] = submission;
+	submissionQueueDepthMetric.Set(count);
+	lock.unlock();
+	notEmpty.notify_one();
+	return true;
+}
+
+bool SubmissionQueue::TryPush(Submission* submission) {
+	std::unique_lock<std::mutex> lock(mutex);
+	if (closed || count >= ring.size()) {
+		return false;
+	}
+
+	ring[(head + count++) % ring.size()] = submission;
+	submissionQueueDepthMetric.Set(count);
+	lock.unlock();
+	notEmpty.notify_one();
+	return true;
+}
+
+std::size_t SubmissionQueue::PopBatch(std::vector<Submission*>& out, std::size_t max) {
+	std::unique_lock<std::mutex> lock(mutex);
+	notEmpty.wait(lock, [this] { return closed || count > 0; });
+
+	std::size_t popped = 0;
+	for (; popped < max && count > 0; popped++) {
+		out.push_back(ring[head]);
+		head = (head + 1) % ring.size();
+		count--;
+	}
+	submissionQueueDepthMetric.Set(count);
+	lock.unlock();
+
+	if (popped) {
+		notFull.notify_all();
+	}
+	return popped;
+}
+
+void SubmissionQueue::Close() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+	}
+	notEmpty.notify_all();
+	notFull.notify_all();
+}
+
+std::size_t SubmissionQueue::Depth() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return count;
+}
+
+LedgerWorker::LedgerWorker(SubmissionQueue& queue) :
+	queue(queue)
+{
+	//EMPTY
+}
+
+LedgerWorker::~LedgerWorker() {
+	Stop();
+}
+
+void LedgerWorker::Start() {
+	thread = std::thread(&LedgerWorker::Run, this);
+}
+
+void LedgerWorker::Stop() {
+	queue.Close();
+	if (thread.joinable()) {
+		thread.join();
+	}
+}
+
+void LedgerWorker::Run() {
+	setTraceThreadName("ledger");
+
+	std::vector<Submission*> batch;
+	batch.reserve(batchSize);
+	for (;;) {
+		batch.clear();
+		if (queue.PopBatch(batch, batchSize) == 0) {
+			return;
+		}
+
+		for (Submission* submission : batch) {
+			int result = sendAmount(submission->sender, submission->receiver, submission->amount);
+			submission->complete(submission, result);
+		}
+	}
+}
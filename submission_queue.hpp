@@ -0,0 +1,78 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//transfers waiting for the ledger
+//the ledger isn't thread safe, so any number of producers push here and a single LedgerWorker
+//drains the queue and calls sendAmount
+//submissions are owned by whoever pushed them, e.g. taken from an ObjectPool and handed back in the callback
+
+struct Submission;
+typedef void (*SubmissionCallback)(Submission* submission, int result);
+
+struct Submission {
+	unsigned sender;
+	unsigned receiver;
+	unsigned amount;
+	std::uint64_t startTicks; //TscClock ticks the latency is measured from
+	SubmissionCallback complete; //called on the ledger thread with sendAmount's result
+	void* context;
+};
+
+class SubmissionQueue {
+public:
+	SubmissionQueue(std::size_t capacity);
+
+	SubmissionQueue(SubmissionQueue const&) = delete;
+	SubmissionQueue& operator=(SubmissionQueue const&) = delete;
+
+	//blocks while the queue is full, false once the queue is closed
+	bool Push(Submission* submission);
+
+	//false when full or closed
+	bool TryPush(Submission* submission);
+
+	//blocks until something arrives, returns 0 only once the queue is closed and drained
+	std::size_t PopBatch(std::vector<Submission*>& out, std::size_t max);
+
+	void Close();
+
+	std::size_t Depth() const;
+
+private:
+	mutable std::mutex mutex;
+	std::condition_variable notEmpty;
+	std::condition_variable notFull;
+	std::vector<Submission*> ring; //fixed at construction, so queueing never allocates
+	std::size_t head = 0;
+	std::size_t count = 0;
+	bool closed = false;
+};
+
+//the single thread that owns the ledger while it runs
+class LedgerWorker {
+public:
+	static constexpr std::size_t batchSize = 64; //submissions taken per lock of the queue
+
+	LedgerWorker(SubmissionQueue& queue);
+	~LedgerWorker();
+
+	LedgerWorker(LedgerWorker const&) = delete;
+	LedgerWorker& operator=(LedgerWorker const&) = delete;
+
+	void Start();
+
+	//close the queue, finish what is in it, and join
+	void Stop();
+
+private:
+	void Run();
+
+	SubmissionQueue& queue;
+	std::thread thread;
+};
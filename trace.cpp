@@ -0,0 +1,197 @@
+#include "trace.hpp"
+
+#include "alloc_tracker.hpp"
+#include "fast_clock.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include <unistd.h>
+
+std::atomic<bool> traceEnabled(false);
+
+struct TraceEvent {
+	const char* name;
+	std::uint64_t timestamp; //TscClock ticks
+	char phase;
+};
+
+//single producer (the owning thread), the exporter only ever reads
+struct TraceRing {
+	std::unique_ptr<TraceEvent[]> events;
+	std::uint64_t capacity;
+	std::atomic<std::uint64_t> head{0};
+	std::atomic<const char*> threadName{nullptr};
+	unsigned threadId;
+
+	TraceRing(std::uint64_t capacity, unsigned threadId) : events(new TraceEvent[capacity]), capacity(capacity), threadId(threadId) {}
+};
+
+static std::atomic<std::size_t> traceCapacity(1 << 16);
+
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<TraceRing>> registry;
+
+static TraceRing* localRing() {
+	thread_local TraceRing* ring = nullptr;
+	if (!ring) {
+		AllocationExemptScope exempt;
+		std::lock_guard<std::mutex> lock(registryMutex);
+		registry.emplace_back(new TraceRing(traceCapacity.load(), registry.size()));
+		ring = registry.back().get();
+	}
+	return ring;
+}
+
+static void record(const char* name, char phase) {
+	TraceRing* ring = localRing();
+	std::uint64_t head = ring->head.load(std::memory_order_relaxed);
+	ring->events[head & (ring->capacity - 1)] = { name, TscClock::Ticks(), phase };
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+void enableTrace(bool enabled) {
+	traceEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+void setTraceCapacity(std::size_t capacity) {
+	//round up to a power of two so the ring can mask instead of divide
+	std::size_t rounded = 1;
+	while (rounded < capacity) {
+		rounded <<= 1;
+	}
+	traceCapacity.store(rounded);
+}
+
+void traceBegin(const char* name) {
+	record(name, 'B');
+}
+
+void traceEnd(const char* name) {
+	record(name, 'E');
+}
+
+const char* internTraceName(std::string const& name) {
+	static std::mutex internMutex;
+	static std::set<std::string> names;
+
+	std::lock_guard<std::mutex> lock(internMutex);
+	return names.insert(name).first->c_str();
+}
+
+void setTraceThreadName(const char* name) {
+	localRing()->threadName.store(name, std::memory_order_relaxed);
+}
+
+static void writeJsonString(std::ostream& os, const char* str) {
+	os << '"';
+	for (; *str; str++) {
+		switch (*str) {
+			case '"': os << "\\\""; break;
+			case '\\': os << "\\\\"; break;
+			case '\n': os << "\\n"; break;
+			case '\t': os << "\\t"; break;
+			default:
+				if (static_cast<unsigned char>(*str) < 0x20) {
+					os << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(*str) << std::dec << std::setfill(' ');
+				}
+				else {
+					os << *str;
+				}
+			break;
+		}
+	}
+	os << '"';
+}
+
+//copy out whatever part of the ring is guaranteed not to have been overwritten during the copy
+static std::vector<TraceEvent> snapshot(TraceRing const& ring) {
+	std::uint64_t head = ring.head.load(std::memory_order_acquire);
+	std::uint64_t begin = head > ring.capacity ? head - ring.capacity : 0;
+
+	std::vector<TraceEvent> events;
+	events.reserve(head - begin);
+	for (std::uint64_t i = begin; i < head; i++) {
+		events.push_back(ring.events[i & (ring.capacity - 1)]);
+	}
+
+	std::uint64_t after = ring.head.load(std::memory_order_acquire);
+	std::uint64_t overwritten = after > ring.capacity ? after - ring.capacity : 0;
+	if (overwritten > begin) {
+		events.erase(events.begin(), events.begin() + std::min<std::uint64_t>(overwritten - begin, events.size()));
+	}
+
+	return events;
+}
+
+void writeChromeTrace(std::ostream& os) {
+	std::vector<std::pair<TraceRing const*, std::vector<TraceEvent>>> threads;
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		for (auto& ring : registry) {
+			threads.emplace_back(ring.get(), snapshot(*ring));
+		}
+	}
+
+	//rebase so timestamps start near zero
+	std::uint64_t base = UINT64_MAX;
+	for (auto& thread : threads) {
+		if (!thread.second.empty()) {
+			base = std::min(base, thread.second.front().timestamp);
+		}
+	}
+
+	const int pid = getpid();
+	bool first = true;
+
+	os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+
+	for (auto& thread : threads) {
+		const char* threadName = thread.first->threadName.load(std::memory_order_relaxed);
+		if (threadName) {
+			os << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << thread.first->threadId << ",\"args\":{\"name\":";
+			writeJsonString(os, threadName);
+			os << "}}";
+			first = false;
+		}
+
+		//a wrapped ring can start part way through a scope, drop the ends with no beginning
+		int depth = 0;
+		for (TraceEvent const& event : thread.second) {
+			if (event.phase == 'E') {
+				if (depth == 0) {
+					continue;
+				}
+				depth--;
+			}
+			else {
+				depth++;
+			}
+
+			std::uint64_t relative = TscClock::ElapsedNanoseconds(event.timestamp - base);
+			os << (first ? "" : ",\n") << "{\"name\":";
+			writeJsonString(os, event.name);
+			os << ",\"ph\":\"" << event.phase << "\",\"ts\":" << relative / 1000 << '.' << std::setw(3) << std::setfill('0') << relative % 1000 << std::setfill(' ')
+				<< ",\"pid\":" << pid << ",\"tid\":" << thread.first->threadId << '}';
+			first = false;
+		}
+	}
+
+	os << "\n]}\n";
+}
+
+bool writeChromeTrace(std::string const& fname) {
+	std::ofstream os(fname);
+	if (!os.is_open()) {
+		return false;
+	}
+	writeChromeTrace(os);
+	return os.good();
+}
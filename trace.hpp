@@ -0,0 +1,31 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+
+//records begin/end events into a fixed-size ring per thread, for chrome://tracing or Perfetto
+//the ring is allocated on a thread's first event, after that recording never allocates
+//when a ring wraps the oldest events are overwritten
+
+extern std::atomic<bool> traceEnabled;
+
+void enableTrace(bool enabled);
+
+//events per thread, only affects rings created after the call
+void setTraceCapacity(std::size_t capacity);
+
+//name must outlive the trace (a string literal or an interned name)
+void traceBegin(const char* name);
+void traceEnd(const char* name);
+
+//copy a runtime name into storage that lives until exit
+const char* internTraceName(std::string const& name);
+
+//name the calling thread in the exported trace
+void setTraceThreadName(const char* name);
+
+//chrome trace-event JSON, safe to call while other threads are still recording
+void writeChromeTrace(std::ostream& os);
+bool writeChromeTrace(std::string const& fname);
@@ -0,0 +1,436 @@
+#include "workload.hpp"
+
+#include "block_log.hpp"
+#include "change_feed.hpp"
+#include "fast_clock.hpp"
+#include "histogram.hpp"
+#include "ledger.hpp"
+#include "pool.hpp"
+#include "random.hpp"
+#include "speculative_miner.hpp"
+#include "spec_options.hpp"
+#include "submission_queue.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+//spec parsing
+bool setWorkloadOption(WorkloadSpec& spec, std::string const& key, std::string const& value, std::string& error) {
+	bool ok;
+	if (key == "accounts") ok = parseOptionNumber(value, spec.accounts) && spec.accounts > 0;
+	else if (key == "rate") ok = parseOptionNumber(value, spec.rate);
+	else if (key == "generate_fraction") ok = parseOptionNumber(value, spec.generateFraction) && spec.generateFraction <= 1;
+	else if (key == "invalid_fraction") ok = parseOptionNumber(value, spec.invalidFraction) && spec.invalidFraction <= 1;
+	else if (key == "duration") ok = parseOptionNumber(value, spec.duration);
+	else if (key == "concurrency") ok = parseOptionNumber(value, spec.concurrency) && spec.concurrency > 0;
+	else if (key == "zipf") ok = parseOptionNumber(value, spec.zipfExponent);
+	else if (key == "mean_amount") ok = parseOptionNumber(value, spec.meanAmount) && spec.meanAmount >= 1;
+	else if (key == "preload") ok = parseOptionNumber(value, spec.preload);
+	else if (key == "threshold") ok = parseOptionNumber(value, spec.threshold);
+	else if (key == "retarget") ok = parseOptionNumber(value, spec.retarget);
+	else if (key == "block_interval") ok = parseOptionNumber(value, spec.blockInterval) && spec.blockInterval > 0;
+	else if (key == "seed") ok = parseOptionNumber(value, spec.seed);
+	else if (key == "subscribers") ok = parseOptionNumber(value, spec.subscribers);
+	else if (key == "log") ok = !(spec.log = value).empty();
+	else if (key == "speculate") ok = parseOptionNumber(value, spec.speculate);
+	else {
+		error = "unknown key " + key;
+		return false;
+	}
+
+	if (!ok) {
+		error = "bad value for " + key + ": " + value;
+	}
+	return ok;
+}
+
+bool parseWorkloadSpec(std::istream& is, WorkloadSpec& spec, std::string& error) {
+	return parseOptionLines(is, [&spec](std::string const& key, std::string const& value, std::string& error) {
+		return setWorkloadOption(spec, key, value, error);
+	}, error);
+}
+
+void writeWorkloadSpec(std::ostream& os, WorkloadSpec const& spec) {
+	os << "accounts = " << spec.accounts << "\n"
+		<< "rate = " << spec.rate << (spec.rate > 0 ? " (open-loop)" : " (closed-loop)") << "\n"
+		<< "generate_fraction = " << spec.generateFraction << "\n"
+		<< "invalid_fraction = " << spec.invalidFraction << "\n"
+		<< "duration = " << spec.duration << "\n"
+		<< "concurrency = " << spec.concurrency << "\n"
+		<< "zipf = " << spec.zipfExponent << "\n"
+		<< "mean_amount = " << spec.meanAmount << "\n"
+		<< "preload = " << spec.preload << "\n"
+		<< "threshold = 0x" << std::hex << spec.threshold << std::dec << "\n"
+		<< "retarget = " << spec.retarget << "\n"
+		<< "block_interval = " << spec.blockInterval << "\n"
+		<< "seed = " << spec.seed << "\n"
+		<< "subscribers = " << spec.subscribers << "\n"
+		<< "speculate = " << spec.speculate << "\n";
+	if (!spec.log.empty()) {
+		os << "log = " << spec.log << "\n";
+	}
+}
+
+//running the workload
+struct WorkloadRun;
+
+struct WorkloadClient {
+	WorkloadRun* run;
+	std::uint64_t state;
+
+	//open-loop submissions, retired by the ledger thread
+	ObjectPool<Submission> pool;
+
+	//closed-loop clients wait here for their transfer to come back
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool waiting = false;
+	Submission submission;
+};
+
+struct WorkloadRun {
+	WorkloadSpec const& spec;
+	LatencyHistogram& latency;
+	ZipfSampler zipf;
+	bool openLoop;
+
+	std::atomic<std::uint64_t> submitted{0};
+	std::atomic<std::uint64_t> completed{0};
+	std::atomic<std::uint64_t> results[4] = {};
+
+	//transfers the reserved chain has room for, each appends at most three blocks; the clients stop
+	//once they're all submitted, since the chain must never reallocate under the subscribers
+	std::uint64_t capacity = 0;
+	std::atomic<bool> full{false};
+
+	bool Reserve() {
+		if (submitted.fetch_add(1, std::memory_order_relaxed) < capacity) {
+			return true;
+		}
+		submitted.fetch_sub(1, std::memory_order_relaxed);
+		full.store(true, std::memory_order_relaxed);
+		return false;
+	}
+};
+
+static void completeSubmission(Submission* submission, int result) {
+	std::uint64_t now = TscClock::Ticks();
+	WorkloadClient* client = static_cast<WorkloadClient*>(submission->context);
+	WorkloadRun* run = client->run;
+
+	run->latency.Record(now > submission->startTicks ? TscClock::ElapsedNanoseconds(now - submission->startTicks) : 0);
+	run->results[std::min(-result, 3)].fetch_add(1, std::memory_order_relaxed);
+	run->completed.fetch_add(1, std::memory_order_relaxed);
+
+	if (run->openLoop) {
+		client->pool.Delete(submission);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(client->mutex);
+		client->waiting = false;
+	}
+	client->condition.notify_one();
+}
+
+//pick the next transfer; invalid ones are split between sending to yourself (-1) and
+//overdrawing (-2), while valid-looking ones can still bounce off an empty account
+static void sampleTransfer(WorkloadRun const& run, std::uint64_t& state, Submission& submission) {
+	WorkloadSpec const& spec = run.spec;
+
+	bool invalid = uniform(state) < spec.invalidFraction;
+	submission.sender = !invalid && uniform(state) < spec.generateFraction ? 0 : run.zipf.Sample(state);
+	submission.amount = exponentialAmount(state, spec.meanAmount);
+
+	if (invalid && uniform(state) < 0.5) {
+		submission.receiver = submission.sender;
+		return;
+	}
+
+	do {
+		submission.receiver = run.zipf.Sample(state);
+	} while (submission.receiver == submission.sender && spec.accounts > 1);
+
+	if (invalid) {
+		submission.amount = UINT_MAX / 2;
+	}
+}
+
+WorkloadResult runWorkload(WorkloadSpec const& spec, LatencyHistogram& latency) {
+	WorkloadRun run{spec, latency, ZipfSampler(spec.accounts, spec.zipfExponent), spec.rate > 0};
+
+	unsigned previousThreshold = threshold;
+	RetargetPolicy previousRetarget = retargetPolicy;
+	bool previousVerbose = verboseMining;
+	threshold = spec.threshold;
+	retargetPolicy.window = spec.retarget;
+	retargetPolicy.interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(spec.blockInterval));
+	verboseMining = false;
+
+	//keep appends allocation-free, the run stops early if the estimate falls short
+	resetLedger();
+	reserveLedger(std::max<std::size_t>(1 << 20, static_cast<std::size_t>(spec.rate * spec.duration * 4)) + spec.preload * 3);
+
+	//a new chain gets a new log, so log positions and feed positions agree
+	BlockLogWriter blockLog;
+	if (!spec.log.empty()) {
+		unlink(spec.log.c_str());
+		if (blockLog.Open(spec.log)) {
+			setBlockLog(&blockLog);
+		}
+		else {
+			std::cerr << blockLog.GetError() << ", continuing without a log" << std::endl;
+		}
+	}
+
+	pushBlock(generateBlock(generateBlank("sixpence load!!!"), 42));
+	for (unsigned account = 1; account <= std::min(spec.preload, spec.accounts); account++) {
+		sendAmount(0, account, static_cast<unsigned>(spec.meanAmount * 20));
+	}
+
+	run.capacity = (blockVector.capacity() - blockVector.size()) / 3;
+
+	//subscribers start at the end of the preload and must see every block after it, in order
+	BlockFeed feed(1 << 12, blockVector.size() - 1);
+	ReservedChainSource chainSource(blockVector, feed.PublishedCounter());
+	BlockLogSource logSource(blockLog);
+	BlockSource* fallback = blockLog.Blocks() ? static_cast<BlockSource*>(&logSource) : &chainSource;
+	std::atomic<bool> stopSubscribers(false);
+	std::atomic<std::uint64_t> feedBlocks(0), feedFallback(0), feedLagged(0);
+	std::vector<std::thread> subscribers;
+
+	if (spec.subscribers > 0) {
+		setBlockFeed(&feed);
+	}
+	for (unsigned i = 0; i < spec.subscribers; i++) {
+		subscribers.emplace_back([&] {
+			FeedSubscription subscription(feed, feed.Published(), fallback);
+			std::vector<Block> blocks(256);
+			while (!stopSubscribers.load() || subscription.Position() < feed.Published()) {
+				subscription.Wait(blocks.data(), blocks.size(), std::chrono::milliseconds(10));
+			}
+			feedBlocks += subscription.RingReads();
+			feedFallback += subscription.FallbackReads();
+			feedLagged += subscription.Lagged();
+		});
+	}
+
+	//from the end of the preload, so the first block it's given is the preloaded chain's tip
+	std::unique_ptr<SpeculativeMiner> speculativeMiner;
+	if (spec.speculate) {
+		speculativeMiner.reset(new SpeculativeMiner());
+		setBlockMiner(speculativeMiner.get());
+		speculativeMiner->Speculate(&blockVector.back(), retargetThreshold(blockVector, blockVector.size() - 1, retargetPolicy));
+	}
+
+	SubmissionQueue queue(std::max(1024u, spec.concurrency * 64));
+	LedgerWorker worker(queue);
+	worker.Start();
+
+	std::vector<std::unique_ptr<WorkloadClient>> clients;
+	for (unsigned i = 0; i < spec.concurrency; i++) {
+		clients.emplace_back(new WorkloadClient());
+		clients.back()->run = &run;
+		clients.back()->state = spec.seed * 0x2545f4914f6cdd1dULL + i;
+	}
+
+	const std::uint64_t startTicks = TscClock::Ticks();
+	const std::uint64_t endTicks = startTicks + static_cast<std::uint64_t>(spec.duration * 1e9 * TscClock::TicksPerNanosecond());
+	const double meanGapTicks = spec.rate > 0 ? spec.concurrency * 1e9 * TscClock::TicksPerNanosecond() / spec.rate : 0;
+
+	auto openLoopClient = [&](WorkloadClient& client) {
+		client.pool.Adopt();
+
+		//each client is an independent Poisson process, together they add up to the target rate
+		double due = static_cast<double>(startTicks);
+		for (;;) {
+			due += -meanGapTicks * std::log(1.0 - uniform(client.state));
+			std::uint64_t dueTicks = static_cast<std::uint64_t>(due);
+			if (dueTicks >= endTicks) {
+				return;
+			}
+
+			std::uint64_t now = TscClock::Ticks();
+			if (dueTicks > now) {
+				std::this_thread::sleep_for(std::chrono::nanoseconds(TscClock::ElapsedNanoseconds(dueTicks - now)));
+			}
+
+			Submission* submission = client.pool.New();
+			sampleTransfer(run, client.state, *submission);
+			submission->startTicks = dueTicks;
+			submission->complete = completeSubmission;
+			submission->context = &client;
+
+			if (!run.Reserve()) {
+				client.pool.Delete(submission);
+				return;
+			}
+			queue.Push(submission);
+		}
+	};
+
+	auto closedLoopClient = [&](WorkloadClient& client) {
+		while (TscClock::Ticks() < endTicks) {
+			Submission& submission = client.submission;
+			sampleTransfer(run, client.state, submission);
+			submission.complete = completeSubmission;
+			submission.context = &client;
+
+			if (!run.Reserve()) {
+				return;
+			}
+			client.waiting = true;
+			submission.startTicks = TscClock::Ticks();
+			queue.Push(&submission);
+
+			std::unique_lock<std::mutex> lock(client.mutex);
+			client.condition.wait(lock, [&] { return !client.waiting; });
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned i = 0; i < spec.concurrency; i++) {
+		threads.emplace_back([&, i] {
+			setTraceThreadName(internTraceName("client " + std::to_string(i)));
+			if (run.openLoop) {
+				openLoopClient(*clients[i]);
+			}
+			else {
+				closedLoopClient(*clients[i]);
+			}
+		});
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	//let the ledger drain whatever is still queued, it counts towards the run
+	worker.Stop();
+
+	WorkloadResult result;
+	result.seconds = TscClock::ElapsedNanoseconds(TscClock::Ticks() - startTicks) / 1e9;
+
+	stopSubscribers.store(true);
+	for (std::thread& subscriber : subscribers) {
+		subscriber.join();
+	}
+	setBlockFeed(nullptr);
+	setBlockLog(nullptr);
+	if (speculativeMiner) {
+		setBlockMiner(nullptr);
+		std::ostringstream report;
+		speculativeMiner->WriteReport(report);
+		result.speculation = report.str();
+	}
+	result.feedBlocks = feedBlocks.load();
+	result.feedFallback = feedFallback.load();
+	result.feedLagged = feedLagged.load();
+	result.submitted = run.submitted.load();
+	result.full = run.full.load();
+	result.completed = run.completed.load();
+	for (int i = 0; i < 4; i++) {
+		result.results[i] = run.results[i].load();
+	}
+
+	//the newest block isn't mined yet
+	result.finalThreshold = blockVector.size() > 1 ? blockVector[blockVector.size() - 2].threshold : threshold;
+	result.valid = verifyChain(blockVector) == blockVector.size();
+
+	threshold = previousThreshold;
+	retargetPolicy = previousRetarget;
+	verboseMining = previousVerbose;
+	return result;
+}
+
+int workloadMain(int argc, char* argv[]) {
+	WorkloadSpec spec;
+	std::string error;
+	const char* latencyFile = nullptr;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		std::size_t equals = arg.find('=');
+
+		if (arg == "--latency-json" && i + 1 < argc) {
+			latencyFile = argv[++i];
+		}
+		else if (equals != std::string::npos && arg[0] != '-') {
+			if (!setWorkloadOption(spec, arg.substr(0, equals), arg.substr(equals + 1), error)) {
+				std::cerr << error << std::endl;
+				return 1;
+			}
+		}
+		else if (arg[0] != '-') {
+			std::ifstream is(arg);
+			if (!is) {
+				std::cerr << "failed to open " << arg << std::endl;
+				return 1;
+			}
+			if (!parseWorkloadSpec(is, spec, error)) {
+				std::cerr << arg << ": " << error << std::endl;
+				return 1;
+			}
+		}
+		else {
+			std::cerr << "usage: sixpence workload [spec-file] [key=value ...] [--latency-json file]" << std::endl;
+			std::cerr << "keys: accounts rate generate_fraction invalid_fraction duration concurrency zipf mean_amount preload threshold retarget block_interval seed subscribers log speculate" << std::endl;
+			return 1;
+		}
+	}
+
+	writeWorkloadSpec(std::cout, spec);
+
+	LatencyHistogram latency("workload");
+	WorkloadResult result = runWorkload(spec, latency);
+
+	std::cout << "\n" << result.completed << " of " << result.submitted << " transfers in " << result.seconds << "s ("
+		<< result.completed / result.seconds << " transfers/s";
+	if (spec.rate > 0) {
+		std::cout << ", target " << spec.rate;
+	}
+	std::cout << ")\n"
+		<< "accepted " << result.results[0] << ", same account " << result.results[1]
+		<< ", insufficient funds " << result.results[2] << ", bad receipt " << result.results[3] << "\n"
+		<< "chain length " << blockVector.size() << (result.valid ? ", valid" : ", INVALID");
+	if (result.full) {
+		std::cout << ", stopped early at the chain's reservation";
+	}
+	if (spec.retarget >= 2) {
+		std::cout << ", threshold retargeted to 0x" << std::hex << result.finalThreshold << std::dec;
+	}
+	std::cout << std::endl;
+
+	if (spec.subscribers > 0) {
+		std::cout << spec.subscribers << " subscribers read " << result.feedBlocks << " blocks from the feed, "
+			<< result.feedFallback << (spec.log.empty() ? " from the chain" : " from the log") << " after being lapped, lost " << result.feedLagged << std::endl;
+	}
+
+	std::cout << result.speculation;
+	latency.WriteText(std::cout);
+
+	if (latencyFile) {
+		std::ofstream os(latencyFile);
+		latency.WriteJson(os);
+		os << "\n";
+		if (!os.good()) {
+			std::cerr << "failed to write latencies to " << latencyFile << std::endl;
+		}
+	}
+
+	return 0;
+}
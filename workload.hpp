@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+//drives the ledger with a configurable mix of transfers and reports what it could sustain
+//clients submit through a SubmissionQueue to the single ledger thread, either open-loop (each
+//client issues on a Poisson schedule regardless of how the ledger is keeping up) or closed-loop
+//(each client waits for its previous transfer before sending the next)
+
+struct WorkloadSpec {
+	unsigned accounts = 1000;
+	double rate = 0; //transfers per second across all clients, 0 runs closed-loop
+	double generateFraction = 0.1; //share of transfers that mint new coins
+	double invalidFraction = 0.01; //share of transfers the ledger must reject
+	double duration = 5; //seconds
+	unsigned concurrency = 4; //client threads
+	double zipfExponent = 1.1; //activity skew, 0 is uniform
+	double meanAmount = 50;
+	unsigned preload = 100; //accounts funded before the clock starts
+	unsigned threshold = 0x00ffffff; //mining threshold used while the workload runs
+	unsigned retarget = 0; //retargeting window in blocks, 0 mines every block at threshold
+	double blockInterval = 1; //milliseconds per block the retargeting aims for
+	unsigned subscribers = 0; //change feed consumers following the chain while it grows
+	std::uint64_t seed = 1;
+	std::string log; //block log to append to while running, for "sixpence tail" in another process
+	bool speculate = false; //mine each next block on a background thread while the ledger validates
+};
+
+struct WorkloadResult {
+	std::uint64_t submitted = 0;
+	bool full = false; //stopped early, the chain reached the room reserved for it
+	std::uint64_t completed = 0;
+	std::uint64_t results[4] = {}; //sendAmount results 0, -1, -2 and -3
+	double seconds = 0;
+
+	//summed over the change feed subscribers
+	std::uint64_t feedBlocks = 0; //read from the ring
+	std::uint64_t feedFallback = 0; //read from the chain after being lapped
+	std::uint64_t feedLagged = 0; //lost, should stay 0 while a fallback is available
+
+	std::string speculation; //the speculative miner's report, when speculate is set
+
+	unsigned finalThreshold = 0; //the newest mined block's
+	bool valid = false; //verifyChain passed on the chain the run left
+};
+
+//"key = value" per line, # starts a comment; unknown keys and bad values are errors
+bool parseWorkloadSpec(std::istream& is, WorkloadSpec& spec, std::string& error);
+
+//a single "key=value" override
+bool setWorkloadOption(WorkloadSpec& spec, std::string const& key, std::string const& value, std::string& error);
+
+void writeWorkloadSpec(std::ostream& os, WorkloadSpec const& spec);
+
+class LatencyHistogram;
+
+//run against blockVector, which is reset first; latencies are recorded into latency
+//open-loop latency is measured from when each transfer was due, not when it was sent,
+//so a stalled ledger shows up in the percentiles instead of silently slowing the clients
+WorkloadResult runWorkload(WorkloadSpec const& spec, LatencyHistogram& latency);
+
+//"sixpence workload [spec-file] [key=value ...]"
+int workloadMain(int argc, char* argv[]);